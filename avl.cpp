@@ -126,6 +126,19 @@ AVLNode* avl_del(AVLNode *node) {
     }
 }
 
+void avl_replace(AVLNode **root, AVLNode *old, AVLNode *node) {
+    *node = *old;
+    if (node->left)  node->left->parent  = node;
+    if (node->right) node->right->parent = node;
+    if (!node->parent) {
+        *root = node;
+    } else if (node->parent->left == old) {
+        node->parent->left = node;
+    } else {
+        node->parent->right = node;
+    }
+}
+
 void avl_search_and_insert(AVLNode **root, AVLNode *new_node,
                            bool (*less)(AVLNode*, AVLNode*)) {
     avl_init(new_node);
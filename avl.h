@@ -46,6 +46,9 @@ AVLNode* avl_fix(AVLNode *n);
 // Delete `node` from the tree. Returns new root.
 AVLNode* avl_del(AVLNode *node);
 
+// Put `node` where `old` is (same sort position); `old` is left unlinked.
+void     avl_replace(AVLNode **root, AVLNode *old, AVLNode *node);
+
 // Search+insert and search+delete helpers
 void     avl_search_and_insert(AVLNode **root, AVLNode *new_node,
                                bool (*less)(AVLNode*, AVLNode*));
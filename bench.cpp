@@ -0,0 +1,576 @@
+// bench.cpp
+// Latency under a mixed load: `--conns` clients each keep one small
+// request (get, or set 1 in 10) in flight, while one more connection
+// sends a big command every `--big-every` ms. Reports the small
+// requests' throughput and latency percentiles.
+//
+//   bench [--port <p>] [--conns <n>] [--secs <s>] [--keys <n>]
+//         [--big keys|match|del|load|none] [--big-every <ms>]
+//         [--value-size <bytes>] [--set-size <bytes>] [--server-pid <pid>] [--shm]
+//         [--unix <path>] [--storm] [--setdel] [--v2]
+//
+// `match` is `keys key:*`, which every key matches: the same reply as
+// `keys`, built on the scan workers. `del` pipelines a stream of 100k
+// entries and a `del` of it; the big command's time covers both. `load`
+// pipelines 100k `set`s, as a bulk loader would.
+//
+// With --value-size the small clients all `get` one value of that size
+// instead, and the bench reports the bytes served; with --server-pid it
+// also reports the server's CPU time per GB (from /proc/<pid>/stat).
+// --set-size is the other direction: the small clients all `set` values
+// of that size, and the bytes counted are the ones sent.
+//
+// --shm moves every connection onto shared-memory rings (see shmring.h);
+// the bench then spins on the rings instead of polling its sockets. It
+// needs --unix, as the rings' memfd is passed over the socket.
+//
+// --setdel makes the small clients alternate `set` and `del` of random
+// keys, so nearly every reply is a nil or a 0/1.
+//
+// --v2 has every connection switch to protocol 2 with a `hello` first
+// (varint lengths, 1-byte opcodes for the commands used here); not with
+// --storm.
+//
+// --unix connects to the server's AF_UNIX listener instead of TCP.
+// --storm opens a fresh connection for every request instead: each
+// client connects, sends one `get`, waits for the reply and resets the
+// connection, and the bench reports connections per second and the
+// connect-to-reply latency.
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "shmring.h"
+
+static void die(const char *m) { perror(m); _exit(1); }
+
+static uint64_t now_ns() {
+    struct timespec tv = {0, 0};
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return uint64_t(tv.tv_sec) * 1000000000 + tv.tv_nsec;
+}
+
+static int g_proto = 1;     // --v2: 2 once dial() has sent the hello
+
+// Opcodes 1, 2, ... under protocol 2, in this order
+static const char *const k_ops[] = {"get", "set", "del", "keys", "xadd"};
+const size_t k_nops = sizeof(k_ops) / sizeof(k_ops[0]);
+
+static void put_varint(std::vector<uint8_t> &out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+static void put_cmd1(std::vector<uint8_t> &out, const std::vector<std::string> &args) {
+    uint32_t len = 4;
+    for (const std::string &s : args) len += 4 + (uint32_t)s.size();
+    uint32_t n = (uint32_t)args.size();
+    out.insert(out.end(), (uint8_t*)&len, (uint8_t*)&len + 4);
+    out.insert(out.end(), (uint8_t*)&n, (uint8_t*)&n + 4);
+    for (const std::string &s : args) {
+        uint32_t sl = (uint32_t)s.size();
+        out.insert(out.end(), (uint8_t*)&sl, (uint8_t*)&sl + 4);
+        out.insert(out.end(), s.begin(), s.end());
+    }
+}
+
+// The varint length, the opcode (0 for none), then varint-prefixed strings
+static void put_cmd2(std::vector<uint8_t> &out, const std::vector<std::string> &args) {
+    uint8_t op = 0;
+    for (size_t i = 0; i < k_nops && !args.empty(); ++i) {
+        if (args[0] == k_ops[i]) op = (uint8_t)(i + 1);
+    }
+    std::vector<uint8_t> body(1, op);
+    for (size_t i = op ? 1 : 0; i < args.size(); ++i) {
+        put_varint(body, (uint32_t)args[i].size());
+        body.insert(body.end(), args[i].begin(), args[i].end());
+    }
+    put_varint(out, (uint32_t)body.size());
+    out.insert(out.end(), body.begin(), body.end());
+}
+
+static void put_cmd(std::vector<uint8_t> &out, const std::vector<std::string> &args) {
+    if (g_proto == 2) return put_cmd2(out, args);
+    put_cmd1(out, args);
+}
+
+// The outer length of the reply at `p`, of which `n` bytes are in, and
+// the `hdr` bytes it takes; false if it isn't all here.
+static bool get_len(const uint8_t *p, size_t n, size_t *hdr, uint32_t *len) {
+    if (g_proto == 1) {
+        if (n < 4) return false;
+        memcpy(len, p, 4);
+        *hdr = 4;
+        return true;
+    }
+    uint64_t v = 0;
+    for (size_t i = 0; i < n && i < 5; ++i) {
+        v |= (uint64_t)(p[i] & 0x7f) << (7 * i);
+        if (p[i] < 0x80) {
+            *hdr = i + 1;
+            *len = (uint32_t)v;
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char *g_unix_path = nullptr;  // --unix
+
+// Connect to the server, over AF_UNIX with --unix. Nonblocking sockets
+// may come back still connecting.
+static int dial_with(int port, bool nonblock) {
+    int type = SOCK_STREAM | (nonblock ? SOCK_NONBLOCK : 0);
+    int fd = socket(g_unix_path ? AF_UNIX : AF_INET, type, 0);
+    if (fd < 0) die("socket");
+    int rv = 0;
+    if (g_unix_path) {
+        struct sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", g_unix_path);
+        rv = connect(fd, (const sockaddr*)&addr, sizeof(addr));
+    } else {
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        rv = connect(fd, (const sockaddr*)&addr, sizeof(addr));
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    if (rv && !(nonblock && errno == EINPROGRESS)) {
+        if (nonblock && errno == EAGAIN) {  // AF_UNIX backlog full
+            close(fd);
+            return -1;
+        }
+        die("connect");
+    }
+    return fd;
+}
+
+static void read_full(int fd, uint8_t *buf, size_t n) {
+    for (size_t got = 0; got < n;) {
+        ssize_t rv = read(fd, buf + got, n - got);
+        if (rv <= 0) die("read");
+        got += (size_t)rv;
+    }
+}
+
+// Blocking; with --v2, switches the connection over first
+static int dial(int port) {
+    int fd = dial_with(port, false);
+    if (g_proto == 1) return fd;
+    std::vector<std::string> hello = {"hello", "2"};
+    hello.insert(hello.end(), k_ops, k_ops + k_nops);
+    std::vector<uint8_t> out;
+    put_cmd1(out, hello);
+    if (write(fd, out.data(), out.size()) != (ssize_t)out.size()) die("write");
+    uint8_t reply[4 + 9];   // TAG_INT(2)
+    read_full(fd, reply, sizeof(reply));
+    if (reply[4] != 3 || reply[5] != 2) {
+        fprintf(stderr, "server refused hello 2\n");
+        _exit(1);
+    }
+    return fd;
+}
+
+// Blocking: send `cmds` pipelined in batches and wait for every reply.
+static void run_pipelined(int fd, const std::vector<std::vector<std::string>> &cmds) {
+    const size_t batch = 1000;
+    std::vector<uint8_t> out, in(1 << 16);
+    for (size_t i = 0; i < cmds.size(); i += batch) {
+        size_t n = std::min(batch, cmds.size() - i);
+        out.clear();
+        for (size_t j = 0; j < n; ++j) put_cmd(out, cmds[i + j]);
+        for (size_t off = 0; off < out.size();) {
+            ssize_t rv = write(fd, out.data() + off, out.size() - off);
+            if (rv <= 0) die("write");
+            off += (size_t)rv;
+        }
+        // count complete replies
+        size_t got = 0, have = 0;
+        std::vector<uint8_t> buf;
+        while (got < n) {
+            ssize_t rv = read(fd, in.data(), in.size());
+            if (rv <= 0) die("read");
+            buf.insert(buf.end(), in.begin(), in.begin() + rv);
+            size_t hdr = 0;
+            uint32_t len = 0;
+            while (get_len(&buf[have], buf.size() - have, &hdr, &len)) {
+                if (buf.size() - have < hdr + (size_t)len) break;
+                have += hdr + len;
+                got++;
+            }
+        }
+    }
+}
+
+struct Client {
+    int fd = -1;
+    std::vector<uint8_t> out;
+    std::vector<uint8_t> in;
+    uint64_t sent_ns = 0;   // 0: idle
+    size_t want = 0;        // replies still to come
+    bool big = false;
+    ShmLink link;           // --shm
+};
+
+// Blocking, before the bench starts: `shm` with the link's memfd, and
+// check for NIL.
+static void shm_handshake(Client *c) {
+    int mfd = shm_create(1u << 20, &c->link);
+    if (mfd < 0) die("shm_create");
+    std::vector<uint8_t> out;
+    put_cmd(out, {"shm"});
+    if (!sock_send_fd(c->fd, out.data(), out.size(), mfd)) die("sendmsg");
+    close(mfd);
+    size_t hdr = g_proto == 1 ? 4 : 1;
+    uint8_t reply[5];
+    read_full(c->fd, reply, hdr + 1);
+    if (reply[0] != 1 || reply[hdr] != 0) {
+        fprintf(stderr, "server refused shm\n");
+        _exit(1);
+    }
+}
+
+// Skip one reply at `*pos` in `c->in` if it is complete. A chunked one
+// is 0xffffffff (a varint under --v2), then { u32 len, bytes }* up to a
+// zero len.
+static bool take_reply(Client *c, size_t *pos) {
+    size_t at = *pos;
+    bool chunked = false;
+    while (true) {
+        size_t hdr = 4;
+        uint32_t len = 0;
+        if (chunked) {
+            if (c->in.size() - at < 4) return false;
+            memcpy(&len, c->in.data() + at, 4);
+        } else if (!get_len(c->in.data() + at, c->in.size() - at, &hdr, &len)) {
+            return false;
+        }
+        at += hdr;
+        if (!chunked && len == 0xffffffffu) { chunked = true; continue; }
+        if (chunked && len == 0) break;
+        if (c->in.size() - at < (size_t)len) return false;
+        at += len;
+        if (!chunked) break;
+    }
+    *pos = at;
+    return true;
+}
+
+// utime + stime of `pid`, in seconds
+static double proc_cpu_secs(int pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE *f = fopen(path, "r");
+    if (!f) die("open /proc/<pid>/stat");
+    char buf[1024];
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = 0;
+    // fields after the ")" closing the command name: state is field 3,
+    // utime and stime are 14 and 15
+    const char *p = strrchr(buf, ')');
+    unsigned long long ut = 0, st = 0;
+    if (!p || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+                     &ut, &st) != 2) {
+        die("parse /proc/<pid>/stat");
+    }
+    return (double)(ut + st) / (double)sysconf(_SC_CLK_TCK);
+}
+
+static uint64_t pct(const std::vector<uint64_t> &v, double p) {
+    if (v.empty()) return 0;
+    size_t i = (size_t)(p * (double)(v.size() - 1));
+    return v[i];
+}
+
+// --storm: `nconns` clients each connect, `get` one key, and reset the
+// connection with SO_LINGER 0 (so TCP leaves no TIME_WAIT behind),
+// over and over.
+static void run_storm(int port, size_t nconns, size_t nkeys, double secs) {
+    struct Slot {
+        int fd = -1;
+        uint64_t start_ns = 0;
+        std::vector<uint8_t> out, in;
+    };
+    std::vector<Slot> slots(nconns);
+    std::vector<struct pollfd> pfds(nconns);
+    std::vector<uint64_t> lat;
+    size_t refused = 0, failed = 0;
+    uint64_t rng = 88172645463325252ull;
+    uint64_t start = now_ns();
+    uint64_t end = start + (uint64_t)(secs * 1e9);
+    auto drop = [&](Slot &s) {
+        struct linger lg = {1, 0};
+        setsockopt(s.fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+        close(s.fd);
+        s.fd = -1;
+        s.in.clear();
+    };
+    while (now_ns() < end) {
+        for (Slot &s : slots) {
+            if (s.fd >= 0) continue;
+            s.start_ns = now_ns();
+            s.fd = dial_with(port, true);
+            if (s.fd < 0) { refused++; continue; }
+            rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+            s.out.clear();
+            put_cmd(s.out, {"get", "key:" + std::to_string(rng % nkeys)});
+        }
+        for (size_t i = 0; i < nconns; ++i) {
+            short ev = slots[i].out.empty() ? POLLIN : POLLOUT;
+            pfds[i] = {slots[i].fd, ev, 0};
+        }
+        int rv = poll(pfds.data(), (nfds_t)pfds.size(), 10);
+        if (rv < 0 && errno != EINTR) die("poll");
+        for (size_t i = 0; i < nconns; ++i) {
+            Slot &s = slots[i];
+            short ready = pfds[i].revents;
+            if (s.fd < 0 || !ready) continue;
+            if ((ready & POLLOUT) && !s.out.empty()) {
+                ssize_t n = write(s.fd, s.out.data(), s.out.size());
+                if (n < 0 && errno != EAGAIN) { failed++; drop(s); continue; }
+                if (n > 0) s.out.erase(s.out.begin(), s.out.begin() + n);
+            } else if (ready & (POLLIN | POLLERR | POLLHUP)) {
+                uint8_t buf[4096];
+                ssize_t n = read(s.fd, buf, sizeof(buf));
+                if (n == 0 || (n < 0 && errno != EAGAIN)) { failed++; drop(s); continue; }
+                if (n < 0) continue;
+                s.in.insert(s.in.end(), buf, buf + n);
+                uint32_t len = 0;
+                if (s.in.size() < 4) continue;
+                memcpy(&len, s.in.data(), 4);
+                if (s.in.size() < 4 + (size_t)len) continue;
+                lat.push_back(now_ns() - s.start_ns);
+                drop(s);
+            }
+        }
+    }
+    double elapsed = (double)(now_ns() - start) / 1e9;
+    for (Slot &s : slots) {
+        if (s.fd >= 0) drop(s);
+    }
+
+    std::sort(lat.begin(), lat.end());
+    printf("%zu connections in %.2fs: %.0f conn/s (%zu refused, %zu failed)\n",
+           lat.size(), elapsed, (double)lat.size() / elapsed, refused, failed);
+    printf("connect to reply us: p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.0f\n",
+           pct(lat, 0.5) / 1e3, pct(lat, 0.9) / 1e3, pct(lat, 0.99) / 1e3,
+           pct(lat, 0.999) / 1e3, lat.empty() ? 0.0 : lat.back() / 1e3);
+}
+
+int main(int argc, char **argv) {
+    int port = 1234;
+    size_t nconns = 16, nkeys = 200000;
+    double secs = 5;
+    std::string big = "keys";
+    uint64_t big_every_ms = 200;
+    size_t value_size = 0;
+    size_t set_size = 0;
+    int server_pid = 0;
+    bool use_shm = false;
+    bool storm = false;
+    bool setdel = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--shm") { use_shm = true; continue; }
+        if (a == "--storm") { storm = true; continue; }
+        if (a == "--setdel") { setdel = true; continue; }
+        if (a == "--v2") { g_proto = 2; continue; }
+        const char *v = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!v) { fprintf(stderr, "missing value for %s\n", a.c_str()); return 1; }
+        if (a == "--port") port = atoi(v);
+        else if (a == "--conns") nconns = (size_t)atol(v);
+        else if (a == "--secs") secs = atof(v);
+        else if (a == "--keys") nkeys = (size_t)atol(v);
+        else if (a == "--big") big = v;
+        else if (a == "--big-every") big_every_ms = (uint64_t)atol(v);
+        else if (a == "--value-size") value_size = (size_t)atol(v);
+        else if (a == "--set-size") set_size = (size_t)atol(v);
+        else if (a == "--server-pid") server_pid = atoi(v);
+        else if (a == "--unix") g_unix_path = v;
+        else { fprintf(stderr, "unknown option %s\n", a.c_str()); return 1; }
+        i++;
+    }
+
+    if (storm && g_proto == 2) {
+        fprintf(stderr, "--v2 doesn't go with --storm\n");
+        return 1;
+    }
+    if (use_shm && !g_unix_path) {
+        fprintf(stderr, "--shm needs --unix\n");
+        return 1;
+    }
+
+    int setup = dial(port);
+    {
+        std::vector<std::vector<std::string>> cmds;
+        cmds.push_back({"flushall"});
+        for (size_t i = 0; i < nkeys; ++i) {
+            cmds.push_back({"set", "key:" + std::to_string(i), std::string(16, 'v')});
+        }
+        if (value_size) cmds.push_back({"set", "bench:value", std::string(value_size, 'v')});
+        run_pipelined(setup, cmds);
+    }
+    if (storm) {
+        close(setup);
+        run_storm(port, nconns, nkeys, secs);
+        return 0;
+    }
+    std::vector<uint8_t> big_cmd;
+    size_t big_replies = 1;
+    if (big == "del") {
+        for (size_t i = 0; i < 100000; ++i) {
+            put_cmd(big_cmd, {"xadd", "bench:stream", "*", "f", std::string(16, 'x')});
+        }
+        put_cmd(big_cmd, {"del", "bench:stream"});
+        big_replies = 100001;
+    } else if (big == "load") {
+        for (size_t i = 0; i < 100000; ++i) {
+            put_cmd(big_cmd, {"set", "load:" + std::to_string(i), std::string(16, 'l')});
+        }
+        big_replies = 100000;
+    } else if (big == "match") {
+        put_cmd(big_cmd, {"keys", "key:*"});
+    } else {
+        put_cmd(big_cmd, {"keys"});
+    }
+
+    std::vector<Client> clients(nconns + (big == "none" ? 0 : 1));
+    for (size_t i = 0; i < clients.size(); ++i) {
+        clients[i].fd = dial(port);
+        if (use_shm) shm_handshake(&clients[i]);
+        fcntl(clients[i].fd, F_SETFL, fcntl(clients[i].fd, F_GETFL) | O_NONBLOCK);
+        clients[i].big = i == nconns;
+    }
+
+    std::vector<uint64_t> lat;
+    std::vector<uint64_t> big_lat;
+    uint64_t rng = 88172645463325252ull;
+    uint64_t rx_bytes = 0;
+    uint64_t tx_bytes = 0;
+    const std::string set_value(set_size, 's');
+    double cpu_start = server_pid ? proc_cpu_secs(server_pid) : 0;
+    uint64_t start = now_ns();
+    uint64_t end = start + (uint64_t)(secs * 1e9);
+    uint64_t next_big = start;
+    std::vector<struct pollfd> pfds(clients.size());
+    // take in reply bytes; completes the request once all replies are in
+    auto got = [&](Client &c, const uint8_t *buf, size_t n) {
+        c.in.insert(c.in.end(), buf, buf + n);
+        rx_bytes += (uint64_t)n;
+        size_t pos = 0;
+        while (c.want && take_reply(&c, &pos)) c.want--;
+        c.in.erase(c.in.begin(), c.in.begin() + pos);
+        if (c.sent_ns && !c.want) {
+            uint64_t d = now_ns() - c.sent_ns;
+            (c.big ? big_lat : lat).push_back(d);
+            c.sent_ns = 0;
+        }
+    };
+    while (true) {
+        uint64_t now = now_ns();
+        if (now >= end) break;
+        for (Client &c : clients) {
+            if (c.sent_ns || !c.out.empty()) continue;
+            if (c.big) {
+                if (now < next_big) continue;
+                c.out = big_cmd;
+                c.want = big_replies;
+                next_big = now + big_every_ms * 1000000;
+            } else {
+                rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+                std::string key = "key:" + std::to_string(rng % nkeys);
+                if (set_size)           put_cmd(c.out, {"set", key, set_value});
+                else if (value_size)    put_cmd(c.out, {"get", "bench:value"});
+                else if (setdel && rng % 2) put_cmd(c.out, {"set", key, "v"});
+                else if (setdel)        put_cmd(c.out, {"del", key});
+                else if (rng % 10 == 0) put_cmd(c.out, {"set", key, std::string(16, 'w')});
+                else                    put_cmd(c.out, {"get", key});
+                c.want = 1;
+            }
+            c.sent_ns = now;
+        }
+        if (use_shm) {
+            // never sleeps, so the server never has to ring us; yields
+            // when idle in case the server shares our CPU
+            bool moved = false;
+            for (Client &c : clients) {
+                ShmHeader *h = c.link.hdr;
+                uint32_t size = c.link.ring_size;
+                if (!c.out.empty()) {
+                    size_t k = ring_push(&h->c2s, c.link.c2s, size, c.out.data(), c.out.size());
+                    if (k && ring_wake_reader(&h->c2s) && !shm_doorbell(c.fd)) die("write");
+                    c.out.erase(c.out.begin(), c.out.begin() + k);
+                }
+                uint8_t buf[64 * 1024];
+                size_t k = ring_pop(&h->s2c, c.link.s2c, size, buf, sizeof(buf));
+                if (!k) continue;
+                if (ring_wake_writer(&h->s2c) && !shm_doorbell(c.fd)) die("write");
+                got(c, buf, k);
+                moved = true;
+            }
+            if (!moved) sched_yield();
+            continue;
+        }
+        for (size_t i = 0; i < clients.size(); ++i) {
+            pfds[i] = {clients[i].fd, (short)(clients[i].out.empty() ? POLLIN : POLLIN | POLLOUT), 0};
+        }
+        int rv = poll(pfds.data(), (nfds_t)pfds.size(), 10);
+        if (rv < 0 && errno != EINTR) die("poll");
+        for (size_t i = 0; i < clients.size(); ++i) {
+            Client &c = clients[i];
+            if (pfds[i].revents & POLLOUT) {
+                ssize_t n = write(c.fd, c.out.data(), c.out.size());
+                if (n < 0 && errno != EAGAIN) die("write");
+                if (n > 0) c.out.erase(c.out.begin(), c.out.begin() + n);
+                if (n > 0) tx_bytes += (uint64_t)n;
+            }
+            if (pfds[i].revents & (POLLIN | POLLERR | POLLHUP)) {
+                uint8_t buf[64 * 1024];
+                ssize_t n = read(c.fd, buf, sizeof(buf));
+                if (n == 0 || (n < 0 && errno != EAGAIN)) die("read");
+                if (n > 0) got(c, buf, (size_t)n);
+            }
+        }
+    }
+    double elapsed = (double)(now_ns() - start) / 1e9;
+    double cpu = server_pid ? proc_cpu_secs(server_pid) - cpu_start : 0;
+
+    std::sort(lat.begin(), lat.end());
+    printf("%zu requests in %.2fs: %.0f req/s\n", lat.size(), elapsed, (double)lat.size() / elapsed);
+    printf("latency us: p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.0f\n",
+           pct(lat, 0.5) / 1e3, pct(lat, 0.9) / 1e3, pct(lat, 0.99) / 1e3,
+           pct(lat, 0.999) / 1e3, lat.empty() ? 0.0 : lat.back() / 1e3);
+    double gb = (double)(set_size ? tx_bytes : rx_bytes) / 1e9;
+    printf("%s %.2f GB: %.0f MB/s\n", set_size ? "sent" : "served", gb, gb * 1e3 / elapsed);
+    if (server_pid) {
+        printf("server cpu: %.2fs, %.3fs per GB\n", cpu, gb > 0 ? cpu / gb : 0.0);
+    }
+    if (!big_lat.empty()) {
+        uint64_t sum = 0;
+        for (uint64_t d : big_lat) sum += d;
+        printf("%zu x %s: avg %.1f ms\n", big_lat.size(), big.c_str(),
+               (double)sum / (double)big_lat.size() / 1e6);
+    }
+    return 0;
+}
@@ -0,0 +1,81 @@
+// coro.h
+#pragma once
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <stdint.h>
+#include <time.h>
+
+// Cooperative time slicing for long commands (C++20 coroutines).
+// A handler written as a Sliced coroutine runs its first slice when it is
+// called and does `co_await slice_yield()` wherever it can stop. Once the
+// slice has used its budget that suspends it; the event loop resumes it on
+// a later pass, after serving everyone else, by calling slice_begin() and
+// then resume(). Between slices the handler must not keep pointers into
+// anything other commands can change.
+inline uint64_t g_slice_budget_us = 500;
+inline uint64_t g_slice_start_us  = 0;
+inline uint32_t g_slice_ticks     = 0;
+
+const uint32_t k_slice_check = 64;  // yield points per clock read
+
+inline uint64_t slice_now_us() {
+    struct timespec tv = {0, 0};
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return uint64_t(tv.tv_sec) * 1000000 + tv.tv_nsec / 1000;
+}
+
+inline void slice_begin() {
+    g_slice_start_us = slice_now_us();
+    g_slice_ticks = 0;
+}
+
+struct SliceYield {
+    bool await_ready() const noexcept {
+        if (++g_slice_ticks % k_slice_check) return true;
+        return slice_now_us() - g_slice_start_us < g_slice_budget_us;
+    }
+    void await_suspend(std::coroutine_handle<>) const noexcept {}
+    void await_resume() const noexcept {}
+};
+
+inline SliceYield slice_yield() { return {}; }
+
+// Owning handle to a sliced handler; destroying it mid-way runs the
+// destructors of the handler's locals.
+struct Sliced {
+    struct promise_type {
+        Sliced get_return_object() {
+            return Sliced(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_never  initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    Sliced() = default;
+    explicit Sliced(std::coroutine_handle<promise_type> h) : h(h) {}
+    Sliced(Sliced &&o) noexcept : h(std::exchange(o.h, nullptr)) {}
+    Sliced &operator=(Sliced &&o) noexcept {
+        if (this != &o) {
+            reset();
+            h = std::exchange(o.h, nullptr);
+        }
+        return *this;
+    }
+    Sliced(const Sliced &) = delete;
+    Sliced &operator=(const Sliced &) = delete;
+    ~Sliced() { reset(); }
+
+    explicit operator bool() const { return (bool)h; }
+    bool done() const { return h.done(); }
+    void resume() { h.resume(); }
+    void reset() {
+        if (h) h.destroy();
+        h = nullptr;
+    }
+
+private:
+    std::coroutine_handle<promise_type> h;
+};
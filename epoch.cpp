@@ -0,0 +1,68 @@
+// epoch.cpp
+#include "epoch.h"
+#include <atomic>
+#include <deque>
+
+struct alignas(64) EpochSlot {
+    std::atomic<uint64_t> active{0};    // epoch seen at enter, 0 if outside
+};
+
+struct Retired {
+    uint64_t epoch;
+    void   (*fn)(void*);
+    void*    arg;
+};
+
+static std::atomic<uint64_t> g_epoch{1};
+static EpochSlot*            g_slots  = nullptr;
+static size_t                g_nslots = 0;
+static std::deque<Retired>   g_retired;     // oldest first
+
+void epoch_init(size_t nreaders) {
+    g_slots  = new EpochSlot[nreaders ? nreaders : 1];
+    g_nslots = nreaders;
+}
+
+void epoch_enter(size_t id) {
+    // acquire pairs with the bump in epoch_reclaim(): a reader that sees
+    // the new epoch also sees everything unlinked before it
+    g_slots[id].active.store(g_epoch.load(std::memory_order_acquire),
+                             std::memory_order_relaxed);
+    // Either the writer's scan sees this slot, or our loads below see
+    // every unlink that came before the scan.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void epoch_exit(size_t id) {
+    g_slots[id].active.store(0, std::memory_order_release);
+}
+
+void epoch_retire(void (*fn)(void*), void* arg) {
+    g_retired.push_back({g_epoch.load(std::memory_order_relaxed), fn, arg});
+}
+
+void epoch_reclaim() {
+    if (g_retired.empty()) return;
+    uint64_t cur = g_epoch.load(std::memory_order_relaxed);
+    if (g_retired.back().epoch == cur) {
+        // close the epoch: readers entering from now on can't see them
+        g_epoch.store(cur + 1, std::memory_order_release);
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    uint64_t oldest = UINT64_MAX;
+    for (size_t i = 0; i < g_nslots; ++i) {
+        uint64_t e = g_slots[i].active.load(std::memory_order_acquire);
+        if (e && e < oldest) oldest = e;
+    }
+    // a reader that entered at epoch E may hold anything retired at >= E
+    while (!g_retired.empty() && g_retired.front().epoch < oldest) {
+        Retired r = g_retired.front();
+        g_retired.pop_front();
+        r.fn(r.arg);
+    }
+}
+
+size_t epoch_pending() {
+    return g_retired.size();
+}
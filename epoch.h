@@ -0,0 +1,23 @@
+// epoch.h
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Epoch-based reclamation for one writer thread and a fixed number of
+// reader threads. A reader brackets each access with enter/exit; the
+// writer unlinks an object, then retires it, and reclaim() runs the
+// retired callbacks once every reader has exited or entered later.
+//
+// Readers never block or write shared state other than their own slot.
+
+// Before any reader starts
+void   epoch_init(size_t nreaders);
+
+// Reader `id` (0 .. nreaders-1)
+void   epoch_enter(size_t id);
+void   epoch_exit(size_t id);
+
+// Writer only
+void   epoch_retire(void (*fn)(void*), void* arg);
+void   epoch_reclaim();
+size_t epoch_pending();     // retired, not yet reclaimed
@@ -0,0 +1,236 @@
+// glob.cpp
+#include "glob.h"
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// ------------------------ substring search ---------------------
+
+static int64_t find_scalar(const char *hay, size_t n, const char *needle, size_t k) {
+    const char *p = hay;
+    const char *end = hay + n - k + 1;
+    while (p < end && (p = (const char*)memchr(p, needle[0], (size_t)(end - p)))) {
+        if (memcmp(p + 1, needle + 1, k - 1) == 0) return p - hay;
+        p++;
+    }
+    return -1;
+}
+
+#if defined(__x86_64__)
+// Vector loads never run past the key: the loops stop while a whole
+// block still fits, and the tail goes to find_scalar().
+static int64_t find_sse2(const char *hay, size_t n, const char *needle, size_t k) {
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last  = _mm_set1_epi8(needle[k - 1]);
+    const size_t npos = n - k + 1;     // candidate start positions
+    size_t i = 0;
+    for (; i + 16 <= npos; i += 16) {
+        const char *a = hay + i;
+        const char *b = hay + i + k - 1;
+        __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(first, _mm_loadu_si128((const __m128i*)a)),
+                                   _mm_cmpeq_epi8(last,  _mm_loadu_si128((const __m128i*)b)));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(eq);
+        while (mask) {
+            uint32_t j = (uint32_t)__builtin_ctz(mask);
+            if (k <= 2 || memcmp(a + j + 1, needle + 1, k - 2) == 0) return (int64_t)(i + j);
+            mask &= mask - 1;
+        }
+    }
+    if (i >= npos) return -1;
+    int64_t r = find_scalar(hay + i, n - i, needle, k);
+    return r < 0 ? -1 : (int64_t)i + r;
+}
+
+__attribute__((target("avx2")))
+static int64_t find_avx2(const char *hay, size_t n, const char *needle, size_t k) {
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last  = _mm256_set1_epi8(needle[k - 1]);
+    const size_t npos = n - k + 1;
+    size_t i = 0;
+    for (; i + 32 <= npos; i += 32) {
+        const char *a = hay + i;
+        const char *b = hay + i + k - 1;
+        __m256i eq = _mm256_and_si256(
+            _mm256_cmpeq_epi8(first, _mm256_loadu_si256((const __m256i*)a)),
+            _mm256_cmpeq_epi8(last,  _mm256_loadu_si256((const __m256i*)b)));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(eq);
+        while (mask) {
+            uint32_t j = (uint32_t)__builtin_ctz(mask);
+            if (k <= 2 || memcmp(a + j + 1, needle + 1, k - 2) == 0) return (int64_t)(i + j);
+            mask &= mask - 1;
+        }
+    }
+    if (i >= npos) return -1;
+    // short keys and the tail take the 16-byte path
+    int64_t r = find_sse2(hay + i, n - i, needle, k);
+    return r < 0 ? -1 : (int64_t)i + r;
+}
+
+typedef int64_t (*find_fn)(const char*, size_t, const char*, size_t);
+
+static find_fn pick_find() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? find_avx2 : find_sse2;
+}
+static const find_fn g_find = pick_find();
+#endif
+
+int64_t glob_find(const char *hay, size_t n, const char *needle, size_t k) {
+    if (k == 0) return 0;
+    if (k > n) return -1;
+    if (k == 1) {
+        const char *p = (const char*)memchr(hay, needle[0], n);
+        return p ? p - hay : -1;
+    }
+#if defined(__x86_64__)
+    return g_find(hay, n, needle, k);
+#else
+    return find_scalar(hay, n, needle, k);
+#endif
+}
+
+// --------------------------- compile ---------------------------
+
+static void cls_set(GlobToken &t, uint8_t c) {
+    t.cls[c >> 6] |= 1ull << (c & 63);
+}
+static bool cls_has(const GlobToken &t, uint8_t c) {
+    return (t.cls[c >> 6] >> (c & 63)) & 1;
+}
+
+static void push_lit(std::vector<GlobToken> &toks, char c) {
+    if (toks.empty() || toks.back().type != GlobToken::LIT) {
+        toks.emplace_back();
+        toks.back().type = GlobToken::LIT;
+    }
+    toks.back().lit.push_back(c);
+}
+
+void glob_compile(const char *pat, size_t n, GlobPattern *g) {
+    *g = GlobPattern();
+    std::vector<GlobToken> &toks = g->toks;
+    for (size_t i = 0; i < n; ++i) {
+        char c = pat[i];
+        if (c == '*') {
+            if (toks.empty() || toks.back().type != GlobToken::STAR) {
+                toks.emplace_back();
+                toks.back().type = GlobToken::STAR;
+            }
+        } else if (c == '?') {
+            toks.emplace_back();
+            toks.back().type = GlobToken::ANY;
+        } else if (c == '[') {
+            GlobToken t;
+            t.type = GlobToken::CLASS;
+            bool negate = i + 1 < n && pat[i + 1] == '^';
+            if (negate) i++;
+            // an unterminated class runs to the end of the pattern
+            for (i++; i < n && pat[i] != ']'; ++i) {
+                uint8_t lo = (uint8_t)pat[i];
+                if (pat[i] == '\\' && i + 1 < n) {
+                    lo = (uint8_t)pat[++i];
+                } else if (i + 2 < n && pat[i + 1] == '-' && pat[i + 2] != ']') {
+                    uint8_t hi = (uint8_t)pat[i + 2];
+                    if (lo > hi) { uint8_t tmp = lo; lo = hi; hi = tmp; }
+                    for (unsigned ch = lo; ch <= hi; ++ch) cls_set(t, (uint8_t)ch);
+                    i += 2;
+                    continue;
+                }
+                cls_set(t, lo);
+            }
+            if (negate) {
+                for (uint64_t &w : t.cls) w = ~w;
+            }
+            toks.push_back(t);
+        } else if (c == '\\' && i + 1 < n) {
+            push_lit(toks, pat[++i]);
+        } else {
+            push_lit(toks, c);
+        }
+    }
+
+    g->match_all = toks.size() == 1 && toks[0].type == GlobToken::STAR;
+    if (!toks.empty() && toks.front().type == GlobToken::LIT) {
+        g->prefix = toks.front().lit;
+    }
+    if (toks.size() > 1 && toks.back().type == GlobToken::LIT) {
+        g->suffix = toks.back().lit;
+    }
+    // the anchored ends are already checked; look for the longest middle one
+    for (size_t i = 1; i + 1 < toks.size(); ++i) {
+        if (toks[i].type == GlobToken::LIT && toks[i].lit.size() > g->needle.size()) {
+            g->needle = toks[i].lit;
+        }
+    }
+}
+
+// ---------------------------- match ----------------------------
+
+// Match a fixed-width token at `s`; returns its width or -1.
+static int64_t tok_match(const GlobToken &t, const char *s, size_t n) {
+    switch (t.type) {
+    case GlobToken::LIT:
+        if (t.lit.size() > n || memcmp(s, t.lit.data(), t.lit.size()) != 0) return -1;
+        return (int64_t)t.lit.size();
+    case GlobToken::ANY:
+        return n ? 1 : -1;
+    case GlobToken::CLASS:
+        return n && cls_has(t, (uint8_t)s[0]) ? 1 : -1;
+    default:
+        return -1;
+    }
+}
+
+bool glob_match(const GlobPattern *g, const char *s, size_t n) {
+    if (g->match_all) return true;
+    // cheap rejections first
+    if (g->prefix.size() > n || memcmp(s, g->prefix.data(), g->prefix.size()) != 0) {
+        return false;
+    }
+    if (g->suffix.size() > n
+        || memcmp(s + n - g->suffix.size(), g->suffix.data(), g->suffix.size()) != 0) {
+        return false;
+    }
+    if (!g->needle.empty() && glob_find(s, n, g->needle.data(), g->needle.size()) < 0) {
+        return false;
+    }
+
+    // Backtracking over fixed-width tokens: only the most recent star
+    // ever needs to grow, one position at a time, or straight to the next
+    // occurrence of the literal that follows it.
+    const std::vector<GlobToken> &toks = g->toks;
+    size_t ti = 0, si = 0;
+    size_t star_ti = SIZE_MAX, star_si = 0;
+    while (ti < toks.size() || si < n) {
+        if (ti == toks.size() && star_ti != SIZE_MAX && star_ti + 1 == ti) {
+            return true;    // a trailing star takes the rest
+        }
+        if (ti < toks.size()) {
+            const GlobToken &t = toks[ti];
+            if (t.type == GlobToken::STAR) {
+                star_ti = ti++;
+                star_si = si;
+                continue;
+            }
+            int64_t w = tok_match(t, s + si, n - si);
+            if (w >= 0) {
+                si += (size_t)w;
+                ti++;
+                continue;
+            }
+        }
+        if (star_ti == SIZE_MAX || star_si >= n) return false;
+        star_si++;
+        const GlobToken &after = star_ti + 1 < toks.size() ? toks[star_ti + 1] : toks[star_ti];
+        if (after.type == GlobToken::LIT) {
+            int64_t off = glob_find(s + star_si, n - star_si, after.lit.data(), after.lit.size());
+            if (off < 0) return false;
+            star_si += (size_t)off;
+        }
+        si = star_si;
+        ti = star_ti + 1;
+    }
+    return true;
+}
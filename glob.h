@@ -0,0 +1,32 @@
+// glob.h
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Glob syntax: `*`, `?`, `[abc]`, `[^a-z]` and `\x` escapes.
+// The pattern is compiled once into fixed-width tokens plus the cheap
+// checks that reject most keys before the backtracking matcher runs:
+// an anchored prefix/suffix and the longest literal every match contains.
+struct GlobToken {
+    enum : uint8_t { LIT, ANY, CLASS, STAR } type = LIT;
+    std::string lit;            // LIT
+    uint64_t    cls[4] = {};    // CLASS: 256-bit membership set
+};
+
+struct GlobPattern {
+    std::vector<GlobToken> toks;
+    bool        match_all = false;  // pattern is only stars
+    std::string prefix;             // leading literal, anchored
+    std::string suffix;             // trailing literal, anchored
+    std::string needle;             // longest literal, anywhere
+};
+
+void   glob_compile(const char *pat, size_t n, GlobPattern *g);
+bool   glob_match(const GlobPattern *g, const char *s, size_t n);
+
+// Offset of the first `needle` in `hay`, or -1. Vectorized on x86-64:
+// candidate positions come from comparing the needle's first and last
+// bytes 16/32 at a time; only those are checked with memcmp.
+int64_t glob_find(const char *hay, size_t n, const char *needle, size_t k);
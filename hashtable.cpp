@@ -5,18 +5,34 @@
 
 static inline bool is_pow2(size_t n) { return n && ((n & (n - 1)) == 0); }
 
+// Pointers a concurrent reader may follow are stored with release
+// semantics (plain moves on x86).
+static inline void publish(HNode** slot, HNode* node) {
+    __atomic_store_n(slot, node, __ATOMIC_RELEASE);
+}
+
 void h_init(HTab* ht, size_t n) {
     assert(is_pow2(n));
-    ht->tab  = (HNode**)calloc(n, sizeof(HNode*));
+    // one extra slot in front holds the mask, so a reader that loads
+    // `tab` can never pair it with another table's size
+    HNode** slots = (HNode**)calloc(n + 1, sizeof(HNode*));
+    slots[0] = (HNode*)(uintptr_t)(n - 1);
     ht->mask = n - 1;
     ht->size = 0;
+    __atomic_store_n(&ht->tab, slots + 1, __ATOMIC_RELEASE);
 }
 
-void h_destroy(HTab* ht) {
-    free(ht->tab);
-    ht->tab  = nullptr;
+// Unlink the slot array; returns the allocation to free
+static void* h_take_slots(HTab* ht) {
+    void* p = ht->tab ? (void*)(ht->tab - 1) : nullptr;
+    __atomic_store_n(&ht->tab, (HNode**)nullptr, __ATOMIC_RELEASE);
     ht->mask = 0;
     ht->size = 0;
+    return p;
+}
+
+void h_destroy(HTab* ht) {
+    free(h_take_slots(ht));
 }
 
 HNode** h_lookup(HTab* ht, HNode* key, h_eq_fn eq) {
@@ -34,54 +50,74 @@ HNode** h_lookup(HTab* ht, HNode* key, h_eq_fn eq) {
 
 void h_insert(HTab* ht, HNode* node) {
     size_t idx = (size_t)node->hcode & ht->mask;
-    node->next = ht->tab[idx];
-    ht->tab[idx] = node;
+    publish(&node->next, ht->tab[idx]);
+    publish(&ht->tab[idx], node);
     ht->size++;
 }
 
 HNode* h_detach(HTab* ht, HNode** from) {
     HNode* node = *from;
-    *from = node->next;
+    publish(from, node->next);  // a reader on `node` still gets through
     ht->size--;
     return node;
 }
 
 // --------------------- HMap (incremental rehashing) ---------------------
 
+// Writer side of the seqcount that tells readers a miss may be spurious
+static void hm_seq_begin(HMap* hmap) {
+    __atomic_store_n(&hmap->seq, hmap->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+static void hm_seq_end(HMap* hmap) {
+    __atomic_store_n(&hmap->seq, hmap->seq + 1, __ATOMIC_RELEASE);
+}
+
+static void hm_free_tab(HMap* hmap, HTab* ht) {
+    void* p = h_take_slots(ht);
+    if (!p) return;
+    if (hmap->free_slots) {
+        hmap->free_slots(p);
+    } else {
+        free(p);
+    }
+}
+
 static void hm_start_resizing(HMap* hmap) {
     assert(hmap->newer.tab && !hmap->older.tab);
+    // the current table becomes `older` and is drained into a bigger `newer`
     size_t n = (hmap->newer.mask + 1) * 2;
     if (n < 4) n = 4;
-    h_init(&hmap->older, n);
+    hm_seq_begin(hmap);
+    hmap->older.mask = hmap->newer.mask;
+    hmap->older.size = hmap->newer.size;
+    __atomic_store_n(&hmap->older.tab, hmap->newer.tab, __ATOMIC_RELEASE);
+    h_init(&hmap->newer, n);
     hmap->resizing_pos = 0;
+    hm_seq_end(hmap);
 }
 
 static void hm_help_rehashing(HMap* hmap) {
     if (!hmap->older.tab) return; // not resizing
 
+    hm_seq_begin(hmap);
     size_t nmove = 0;
     // move a few buckets each time we touch the table
-    while (nmove < 64 && hmap->resizing_pos <= hmap->newer.mask) {
-        HNode* node = hmap->newer.tab[hmap->resizing_pos];
-        hmap->newer.tab[hmap->resizing_pos] = nullptr;
-        while (node) {
-            HNode* next = node->next;
-            h_insert(&hmap->older, node);
-            node = next;
+    while (nmove < 64 && hmap->older.size > 0) {
+        HNode** from = &hmap->older.tab[hmap->resizing_pos];
+        while (*from) {
+            h_insert(&hmap->newer, h_detach(&hmap->older, from));
         }
         hmap->resizing_pos++;
         nmove++;
     }
 
-    if (hmap->resizing_pos > hmap->newer.mask) {
+    if (hmap->older.size == 0) {
         // done
-        h_destroy(&hmap->newer);
-        hmap->newer = hmap->older;
-        hmap->older.tab = nullptr;
-        hmap->older.mask = 0;
-        hmap->older.size = 0;
+        hm_free_tab(hmap, &hmap->older);
         hmap->resizing_pos = 0;
     }
+    hm_seq_end(hmap);
 }
 
 void hm_init(HMap* hmap) {
@@ -90,8 +126,8 @@ void hm_init(HMap* hmap) {
 }
 
 void hm_destroy(HMap* hmap) {
-    h_destroy(&hmap->newer);
-    h_destroy(&hmap->older);
+    hm_free_tab(hmap, &hmap->newer);
+    hm_free_tab(hmap, &hmap->older);
     hmap->resizing_pos = 0;
 }
 
@@ -101,7 +137,7 @@ static HTab* hm_primary(HMap* hmap) {
 
 static void hm_maybe_start_resizing(HMap* hmap) {
     HTab* ht = hm_primary(hmap);
-    if (ht->size >= (ht->mask + 1) * 2) { // load factor 2.0
+    if (!hmap->older.tab && ht->size >= (ht->mask + 1) * 2) { // load factor 2.0
         hm_start_resizing(hmap);
     }
 }
@@ -138,3 +174,106 @@ HNode* hm_delete(HMap* hmap, HNode* key, h_eq_fn eq) {
     }
     return nullptr;
 }
+
+static HNode** h_find_node(HTab* ht, HNode* node) {
+    if (!ht->tab) return nullptr;
+    for (HNode** from = &ht->tab[node->hcode & ht->mask]; *from; from = &(*from)->next) {
+        if (*from == node) return from;
+    }
+    return nullptr;
+}
+
+void hm_replace(HMap* hmap, HNode* old, HNode* node) {
+    assert(old->hcode == node->hcode);
+    HNode** from = h_find_node(&hmap->newer, old);
+    if (!from) from = h_find_node(&hmap->older, old);
+    assert(from);
+    publish(&node->next, old->next);
+    publish(from, node);
+}
+
+void hm_take(HMap* hmap, HMap* out) {
+    *out = *hmap;
+    out->seq = 0;
+    out->free_slots = nullptr;
+    hm_seq_begin(hmap);
+    h_take_slots(&hmap->older);     // owned by `out` now
+    h_init(&hmap->newer, 4);
+    hmap->resizing_pos = 0;
+    hm_seq_end(hmap);
+}
+
+bool hm_rehash_step(HMap* hmap) {
+    hm_help_rehashing(hmap);
+    return hmap->older.tab != nullptr;
+}
+
+// ----------------------- concurrent readers -----------------------
+
+static HNode* h_lookup_concurrent(HTab* ht, HNode* key, h_eq_fn eq) {
+    HNode** tab = __atomic_load_n(&ht->tab, __ATOMIC_ACQUIRE);
+    if (!tab) return nullptr;
+    size_t mask = (size_t)(uintptr_t)tab[-1];
+    HNode* cur = __atomic_load_n(&tab[key->hcode & mask], __ATOMIC_ACQUIRE);
+    for (; cur; cur = __atomic_load_n(&cur->next, __ATOMIC_ACQUIRE)) {
+        if (cur->hcode == key->hcode && eq(cur, key)) return cur;
+    }
+    return nullptr;
+}
+
+HNode* hm_lookup_concurrent(HMap* hmap, HNode* key, h_eq_fn eq) {
+    while (true) {
+        uint64_t seq = __atomic_load_n(&hmap->seq, __ATOMIC_ACQUIRE);
+        HNode* node = h_lookup_concurrent(&hmap->newer, key, eq);
+        if (!node) node = h_lookup_concurrent(&hmap->older, key, eq);
+        if (node) return node;  // a hit is always a real node
+        // a miss only counts if no nodes moved while we looked
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (!(seq & 1) && __atomic_load_n(&hmap->seq, __ATOMIC_RELAXED) == seq) {
+            return nullptr;
+        }
+    }
+}
+
+// ------------------------ cursor scan ------------------------
+
+static uint64_t rev_bits(uint64_t v) {
+    v = ((v >> 1)  & 0x5555555555555555ull) | ((v & 0x5555555555555555ull) << 1);
+    v = ((v >> 2)  & 0x3333333333333333ull) | ((v & 0x3333333333333333ull) << 2);
+    v = ((v >> 4)  & 0x0f0f0f0f0f0f0f0full) | ((v & 0x0f0f0f0f0f0f0f0full) << 4);
+    v = ((v >> 8)  & 0x00ff00ff00ff00ffull) | ((v & 0x00ff00ff00ff00ffull) << 8);
+    v = ((v >> 16) & 0x0000ffff0000ffffull) | ((v & 0x0000ffff0000ffffull) << 16);
+    return (v >> 32) | (v << 32);
+}
+
+// increment the high bits first so growing the table never skips a slot
+static uint64_t scan_next(uint64_t cursor, size_t mask) {
+    cursor |= ~(uint64_t)mask;
+    return rev_bits(rev_bits(cursor) + 1);
+}
+
+static void scan_bucket(HTab* ht, size_t idx, h_scan_fn fn, void* arg) {
+    for (HNode* node = ht->tab[idx]; node;) {
+        HNode* next = node->next;   // fn may unlink the node
+        fn(node, arg);
+        node = next;
+    }
+}
+
+uint64_t hm_scan(HMap* hmap, uint64_t cursor, h_scan_fn fn, void* arg) {
+    HTab* small = &hmap->newer;
+    if (!hmap->older.tab) {
+        scan_bucket(small, cursor & small->mask, fn, arg);
+        return scan_next(cursor, small->mask);
+    }
+    HTab* big = &hmap->older;
+    if (small->mask > big->mask) { HTab* t = small; small = big; big = t; }
+    size_t m0 = small->mask, m1 = big->mask;
+
+    scan_bucket(small, cursor & m0, fn, arg);
+    do {
+        scan_bucket(big, cursor & m1, fn, arg);
+        cursor = scan_next(cursor, m1);
+    } while (cursor & (m0 ^ m1));
+    return cursor;
+}
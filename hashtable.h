@@ -10,7 +10,7 @@ struct HNode {
 };
 
 struct HTab {
-    HNode** tab = nullptr;  // slot array
+    HNode** tab = nullptr;  // slot array; tab[-1] holds its own mask
     size_t  mask = 0;       // size = mask+1; power of 2
     size_t  size = 0;       // number of nodes
 };
@@ -29,6 +29,11 @@ struct HMap {
     HTab   newer;
     HTab   older;
     size_t resizing_pos = 0;
+    // for hm_lookup_concurrent(): odd while nodes move between tables
+    uint64_t seq = 0;
+    // where dropped slot arrays go; nullptr means free(). Set after
+    // hm_init() to defer frees past concurrent readers.
+    void (*free_slots)(void*) = nullptr;
 };
 
 void   hm_init(HMap* hmap);
@@ -36,6 +41,27 @@ void   hm_destroy(HMap* hmap);
 void   hm_insert(HMap* hmap, HNode* node);
 HNode* hm_lookup(HMap* hmap, HNode* key, h_eq_fn eq);
 HNode* hm_delete(HMap* hmap, HNode* key, h_eq_fn eq);
+// Put `node` (same hcode) where `old` is, with one pointer store
+void   hm_replace(HMap* hmap, HNode* old, HNode* node);
+// Move every table and node into `out`; `hmap` starts over empty
+void   hm_take(HMap* hmap, HMap* out);
+// Move a few buckets of a resize in progress, as every insert, lookup
+// and delete does; false once there is none. Lets an idle map finish.
+bool   hm_rehash_step(HMap* hmap);
+
+// Lookup from any thread while one owner thread modifies the map. Every
+// pointer a reader follows is written with a release store, and a miss
+// is retried if nodes moved between tables meanwhile. Never rehashes.
+// The caller keeps returned nodes and old slot arrays alive (e.g. with
+// epoch reclamation) until no reader can hold them.
+HNode* hm_lookup_concurrent(HMap* hmap, HNode* key, h_eq_fn eq);
+
+// Cursor-based iteration (start and end at 0). Visits one bucket of the
+// smaller table plus the buckets it expands to in the larger one, so
+// every node present for the whole scan is seen at least once even if
+// the map resizes in between. Does not advance rehashing.
+typedef void (*h_scan_fn)(HNode*, void*);
+uint64_t hm_scan(HMap* hmap, uint64_t cursor, h_scan_fn fn, void* arg);
 
 // FNV-1a hash for strings
 static inline uint64_t str_hash(const uint8_t* p, size_t n) {
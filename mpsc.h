@@ -0,0 +1,37 @@
+// mpsc.h
+#pragma once
+#include <atomic>
+
+// Intrusive lock-free handoff list. Any thread may push(); a single
+// consumer take()s everything at once, so there is no ABA and no node
+// allocation. T needs a `T *q_next` member and sits in one list at a time.
+//
+// push() reports whether the list was empty, which is when the producer
+// has to wake the consumer. The consumer must clear its wakeup (drain the
+// pipe) before take() so that a push racing with it is never missed.
+template <typename T>
+struct MPSCList {
+    std::atomic<T*> head{nullptr};
+
+    bool push(T *node) {
+        T *old = head.load(std::memory_order_relaxed);
+        do {
+            node->q_next = old;
+        } while (!head.compare_exchange_weak(old, node, std::memory_order_release,
+                                             std::memory_order_relaxed));
+        return old == nullptr;
+    }
+
+    // Returns the taken nodes oldest first, linked through q_next.
+    T *take() {
+        T *list = head.exchange(nullptr, std::memory_order_acquire);
+        T *fifo = nullptr;
+        while (list) {
+            T *next = list->q_next;
+            list->q_next = fifo;
+            fifo = list;
+            list = next;
+        }
+        return fifo;
+    }
+};
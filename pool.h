@@ -0,0 +1,187 @@
+// pool.h
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Byte vectors that grow without zeroing: resize() leaves the new bytes
+// as they are, so a buffer can be extended to read or encode into place.
+// Make room with pool_reserve() first: the vector's own reallocation
+// moves a custom allocator's elements one by one.
+template <typename T>
+struct RawAlloc : std::allocator<T> {
+    template <typename U> struct rebind { using other = RawAlloc<U>; };
+    RawAlloc() = default;
+    template <typename U> RawAlloc(const RawAlloc<U> &) noexcept {}
+    template <typename U> void construct(U *p) noexcept { ::new ((void*)p) U; }
+    template <typename U, typename... Args> void construct(U *p, Args &&...args) {
+        ::new ((void*)p) U(std::forward<Args>(args)...);
+    }
+};
+using Bytes = std::vector<uint8_t, RawAlloc<uint8_t>>;
+
+// Memory a connection needs only while traffic is in flight.
+//
+// The buffer pool keeps per-thread free lists of byte buffers in a few
+// size classes. A conn takes a buffer when data arrives and gives it back
+// once drained, so an idle conn holds none, and a busy one reuses
+// capacity instead of going to malloc. Buffers travel between threads with
+// their conns; a thread only ever touches its own pool.
+const size_t k_pool_classes = 5;
+const size_t k_pool_min = 4096;             // class i: 4 KB << 2i, up to 1 MB
+const size_t k_pool_keep = 4u << 20;        // bytes kept per class and thread
+
+inline size_t pool_class_size(size_t c) { return k_pool_min << (2 * c); }
+
+struct BufPool;
+inline std::mutex g_pools_mu;
+inline std::vector<BufPool*> g_pools;       // every thread's, for stats
+
+struct BufPool {
+    std::vector<Bytes> free[k_pool_classes];
+    std::atomic<size_t> bytes{0};           // pooled; only the owner writes
+
+    BufPool() {
+        std::lock_guard<std::mutex> lock(g_pools_mu);
+        g_pools.push_back(this);
+    }
+    ~BufPool() {
+        std::lock_guard<std::mutex> lock(g_pools_mu);
+        for (size_t i = 0; i < g_pools.size(); ++i) {
+            if (g_pools[i] == this) {
+                g_pools[i] = g_pools.back();
+                g_pools.pop_back();
+                break;
+            }
+        }
+    }
+};
+
+inline BufPool &pool_local() {
+    thread_local BufPool pool;
+    return pool;
+}
+
+// Give the capacity-less `v` room for at least `want` bytes.
+inline void pool_take(Bytes &v, size_t want) {
+    size_t c = 0;
+    while (c < k_pool_classes && pool_class_size(c) < want) c++;
+    if (c == k_pool_classes) {
+        v.reserve(want);    // too big to pool
+        return;
+    }
+    BufPool &pool = pool_local();
+    if (pool.free[c].empty()) {
+        v.reserve(pool_class_size(c));
+        return;
+    }
+    v.swap(pool.free[c].back());
+    pool.free[c].pop_back();
+    pool.bytes.store(pool.bytes.load(std::memory_order_relaxed) - v.capacity(),
+                     std::memory_order_relaxed);
+}
+
+// Take the storage of `v`, dropping what is in it; `v` is left with none.
+// Buffers of a class already full, or too small or too big to pool, are
+// freed.
+inline void pool_give(Bytes &v) {
+    size_t cap = v.capacity();
+    size_t c = 0;
+    while (c + 1 < k_pool_classes && pool_class_size(c + 1) <= cap) c++;
+    BufPool &pool = pool_local();
+    if (cap < k_pool_min || cap > 2 * pool_class_size(k_pool_classes - 1)
+        || (pool.free[c].size() + 1) * pool_class_size(c) > k_pool_keep) {
+        Bytes().swap(v);
+        return;
+    }
+    v.clear();
+    pool.free[c].emplace_back();
+    pool.free[c].back().swap(v);
+    pool.bytes.store(pool.bytes.load(std::memory_order_relaxed) + cap,
+                     std::memory_order_relaxed);
+}
+
+// Make room for `n` more bytes in `v`. If it has to grow, its contents
+// move to a pooled buffer and the old one goes back to the pool.
+inline void pool_reserve(Bytes &v, size_t n) {
+    if (v.capacity() - v.size() >= n) return;
+    if (!v.capacity()) return pool_take(v, n);
+    Bytes bigger;
+    pool_take(bigger, std::max(v.size() + n, 2 * v.capacity()));
+    bigger.resize(v.size());
+    memcpy(bigger.data(), v.data(), v.size());
+    pool_give(v);
+    v.swap(bigger);
+}
+
+// Make room to read `n` more bytes into `s`, which is to end up `left`
+// bytes longer (n <= left), and return where they go; cut `s` back to
+// what was read after. Capacity at most doubles ahead of what `s` holds,
+// and resize() zeroes just the `n` bytes, so a value read piece by piece
+// costs time linear in its size.
+inline char *str_read_room(std::string &s, size_t n, size_t left) {
+    size_t got = s.size();
+    if (s.capacity() - got < n) s.reserve(got + std::min(left, std::max(got, n)));
+    s.resize(got + n);
+    return &s[got];
+}
+
+// Bytes sitting in all threads' pools.
+inline size_t pool_bytes() {
+    std::lock_guard<std::mutex> lock(g_pools_mu);
+    size_t n = 0;
+    for (BufPool *p : g_pools) n += p->bytes.load(std::memory_order_relaxed);
+    return n;
+}
+
+// A FIFO for per-connection queues. Unlike std::deque, which allocates a
+// map and a 512-byte node up front, it holds nothing while empty and lets
+// go of its storage as soon as it drains. Popped slots are reset at once
+// so what they held is freed; the dead prefix is compacted away once it
+// is half the vector.
+template <typename T>
+struct Queue {
+    std::vector<T> items;
+    size_t head = 0;
+
+    bool empty() const { return head == items.size(); }
+    size_t size() const { return items.size() - head; }
+    T &front() { return items[head]; }
+    const T &front() const { return items[head]; }
+    T &back() { return items.back(); }
+    const T &back() const { return items.back(); }
+    T &operator[](size_t i) { return items[head + i]; }
+    const T &operator[](size_t i) const { return items[head + i]; }
+    T *begin() { return items.data() + head; }
+    T *end() { return items.data() + items.size(); }
+    const T *begin() const { return items.data() + head; }
+    const T *end() const { return items.data() + items.size(); }
+
+    void push_back(const T &x) { items.push_back(x); }
+    void push_back(T &&x) { items.push_back(std::move(x)); }
+    void pop_back() {
+        items.pop_back();
+        if (empty()) clear();
+    }
+    void pop_front() {
+        items[head++] = T();
+        if (head == items.size()) {
+            clear();
+        } else if (head >= 32 && 2 * head >= items.size()) {
+            items.erase(items.begin(), items.begin() + (ptrdiff_t)head);
+            head = 0;
+        }
+    }
+    void clear() {
+        std::vector<T>().swap(items);
+        head = 0;
+    }
+};
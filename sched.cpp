@@ -0,0 +1,159 @@
+// sched.cpp
+#include "sched.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// A short lock per deque: pushes and pops are a handful of instructions,
+// and the owner rarely meets a thief on the same deque.
+struct alignas(64) SchedDeque {
+    std::mutex            mu;
+    std::deque<SchedTask> tasks;
+};
+
+static std::vector<std::unique_ptr<SchedDeque>> &g_deques =
+    *new std::vector<std::unique_ptr<SchedDeque>>();
+static std::atomic<size_t>   g_queued{0};       // tasks in all deques
+static std::atomic<size_t>   g_sleeping{0};
+static std::atomic<size_t>   g_next{0};         // round-robin for outside submits
+// Workers are detached and sleep on these until the process ends, so
+// they are never destroyed: destroying a condvar with waiters blocks exit.
+static std::mutex            &g_idle_mu = *new std::mutex();
+static std::condition_variable &g_idle_cv = *new std::condition_variable();
+static thread_local int      t_worker = -1;
+
+static void push(size_t w, SchedTask task) {
+    {
+        std::lock_guard<std::mutex> lock(g_deques[w]->mu);
+        g_deques[w]->tasks.push_back(std::move(task));
+    }
+    g_queued++;
+    // pairs with the sleeper's check of g_queued (both seq_cst)
+    if (g_sleeping.load()) {
+        { std::lock_guard<std::mutex> lock(g_idle_mu); }
+        g_idle_cv.notify_one();
+    }
+}
+
+static bool pop_back(size_t w, SchedTask &task) {
+    SchedDeque &d = *g_deques[w];
+    std::lock_guard<std::mutex> lock(d.mu);
+    if (d.tasks.empty()) return false;
+    task = std::move(d.tasks.back());
+    d.tasks.pop_back();
+    g_queued--;
+    return true;
+}
+
+// A thief only tries the lock, unless `wait`; `*busy` is set if the
+// victim was locked and may have had work.
+static bool steal_front(size_t w, SchedTask &task, bool wait, bool *busy) {
+    SchedDeque &d = *g_deques[w];
+    std::unique_lock<std::mutex> lock(d.mu, std::defer_lock);
+    if (wait) {
+        lock.lock();
+    } else if (!lock.try_lock()) {
+        *busy = true;
+        return false;
+    }
+    if (d.tasks.empty()) return false;
+    task = std::move(d.tasks.front());
+    d.tasks.pop_front();
+    g_queued--;
+    return true;
+}
+
+static bool find_task(size_t self, SchedTask &task, bool wait, bool *busy) {
+    if (pop_back(self, task)) return true;
+    size_t n = g_deques.size();
+    for (size_t i = 1; i < n; ++i) {
+        if (steal_front((self + i) % n, task, wait, busy)) return true;
+    }
+    return false;
+}
+
+static inline void cpu_relax() {
+#if defined(__x86_64__)
+    _mm_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+// Failed rounds against busy deques before a thief waits for their locks
+// rather than trying them; it backs off a little longer after each.
+const int k_steal_tries = 8;
+
+static void worker(size_t self) {
+    t_worker = (int)self;
+    SchedTask task;
+    int misses = 0;
+    while (true) {
+        bool busy = false;
+        if (find_task(self, task, misses >= k_steal_tries, &busy)) {
+            task();
+            task = nullptr;
+            misses = 0;
+            continue;
+        }
+        if (busy) {
+            for (int i = 0; i < 1 << misses; ++i) cpu_relax();
+            misses++;
+            continue;
+        }
+        misses = 0;
+        std::unique_lock<std::mutex> lock(g_idle_mu);
+        g_sleeping++;
+        g_idle_cv.wait(lock, []() { return g_queued.load() > 0; });
+        g_sleeping--;
+    }
+}
+
+void sched_start(size_t nworkers) {
+    for (size_t i = 0; i < nworkers; ++i) {
+        g_deques.emplace_back(new SchedDeque());
+    }
+    for (size_t i = 0; i < nworkers; ++i) {
+        std::thread(worker, i).detach();
+    }
+}
+
+size_t sched_workers() {
+    return g_deques.size();
+}
+
+void sched_submit(SchedTask task) {
+    size_t w = t_worker >= 0 ? (size_t)t_worker : g_next++ % g_deques.size();
+    push(w, std::move(task));
+}
+
+struct ParallelFor {
+    std::function<void(size_t, size_t)> fn;
+    size_t grain;
+};
+
+static void pfor_run(std::shared_ptr<ParallelFor> pf, size_t lo, size_t hi) {
+    // keep the lower half, offer the upper half to thieves
+    while (hi - lo > pf->grain) {
+        size_t mid = lo + (hi - lo) / 2;
+        sched_submit([pf, mid, hi]() { pfor_run(pf, mid, hi); });
+        hi = mid;
+    }
+    pf->fn(lo, hi);
+}
+
+void sched_parallel_for(size_t lo, size_t end, size_t grain,
+                        std::function<void(size_t, size_t)> fn) {
+    if (lo >= end) return;
+    auto pf = std::make_shared<ParallelFor>();
+    pf->fn = std::move(fn);
+    pf->grain = grain ? grain : 1;
+    sched_submit([pf, lo, end]() { pfor_run(pf, lo, end); });
+}
@@ -0,0 +1,24 @@
+// sched.h
+#pragma once
+#include <stddef.h>
+#include <functional>
+
+// Work-stealing task pool. Every worker owns a deque: it pushes and pops
+// its own tasks at the back, newest first while the data is still in
+// cache, and when that runs dry it steals from the front of another
+// worker's deque, where the oldest and usually biggest pieces sit.
+// Tasks must not touch server state; results go back via main_post().
+typedef std::function<void()> SchedTask;
+
+void   sched_start(size_t nworkers);
+size_t sched_workers();
+
+// From any thread. Inside a task, the task lands on the caller's own
+// deque, so recursive splits stay local until someone steals them.
+void   sched_submit(SchedTask task);
+
+// Run fn(lo, hi) over [lo, end) in ranges of at most `grain`. Ranges are
+// split in halves on demand, so idle workers steal big halves and the
+// caller never has to guess the parallelism. Returns at once.
+void   sched_parallel_for(size_t lo, size_t end, size_t grain,
+                          std::function<void(size_t, size_t)> fn);
@@ -3,8 +3,80 @@
 // Commands:
 //   get <key>        -> TAG_STR(value) or TAG_NIL
 //   set <key> <val>  -> TAG_NIL
+//   append <key> <val>  -> TAG_INT(new length)
 //   del <key>        -> TAG_INT(0|1)
-//   keys             -> TAG_ARR(n) then n * TAG_STR(key)
+//   unlink <key>...  -> TAG_INT(n removed); big values are freed in the background
+//   flushall [async|sync]  -> TAG_NIL
+//   keys [pattern]   -> TAG_ARR(n) then n * TAG_STR(key)
+//   dbsize           -> TAG_INT(n)
+//   bigkeys [n]      -> TAG_ARR of [key, TAG_INT(type), TAG_INT(bytes)], largest first
+//   memstats         -> TAG_ARR of name/value pairs: keys and bytes per type,
+//                       and objects waiting for the lazy-free thread
+//   scan <cursor> [match <pattern>] [count <n>]
+//                    -> TAG_ARR of [TAG_STR(next cursor), TAG_ARR of keys]
+//   xadd <key> [maxlen <n>] <id|*> <field> <val> ...  -> TAG_STR(id)
+//   xlen <key>       -> TAG_INT(n)
+//   xrange <key> <start|-> <end|+> [count <n>]        -> TAG_ARR of [id, fields]
+//   xread [count <n>] [block <ms>] streams <key>... <id|$>...
+//                    -> TAG_ARR of [key, entries] or TAG_NIL; may block
+//   xtrim <key> maxlen|minid <arg>                    -> TAG_INT(removed)
+//   ts.add <key> <ts|*> <val>                         -> TAG_INT(ts)
+//   ts.range <key> <from|-> <to|+> [agg <type> <bucket_ms>]
+//                    -> TAG_ARR of [TAG_INT(ts), TAG_DBL(val)]
+//   ts.mrange <from|-> <to|+> [agg <type> <bucket_ms>] <key>...
+//                    -> TAG_ARR of [key, samples]
+//   ts.info <key>    -> TAG_ARR of name/value pairs
+//   vadd <key> <id> <f32>...                          -> TAG_INT(0|1)
+//   vrem <key> <id>  -> TAG_INT(0|1)
+//   vcard <key>      -> TAG_INT(n)
+//   vsim <key> <k> [metric l2|ip] [nprobe <n>] <f32>...
+//                    -> TAG_ARR of [id, TAG_DBL(score)]
+//   vindex <key> <nlist> [iters]  -> TAG_INT(1 if a build started); 0 drops
+//   scanprefix <prefix> <count>   -> TAG_ARR of keys, ordered (--key-index)
+//   keyrange <from> <to> [count]  -> TAG_ARR of keys in [from, to] (--key-index)
+//   keyindex         -> TAG_ARR of name/value pairs: size and memory overhead
+//   info             -> TAG_ARR of name/value pairs: cron timing, command
+//                       rate, idle timeouts, clients and what each idle
+//                       one costs, pooled conns and buffers
+//   shm              -> TAG_NIL, then requests and replies move to the
+//                       shared-memory rings in the memfd the client passed
+//                       with the request (AF_UNIX only; see shmring.h)
+//   hello 1|2 [cmd...]  -> TAG_INT(version); later requests and replies
+//                       use that protocol. 2 is the compact one: varint
+//                       lengths, and the named commands get 1-byte
+//                       opcodes (see parse_req2)
+//
+// keys/bigkeys/memstats over a large keyspace run on the scan workers
+// against a snapshot; other clients are served meanwhile. Without them,
+// `keys` runs in time slices on the event loop, as do `del` of a big
+// value and `flushall sync`.
+//
+// Replies too big to buffer are sent in chunks (see k_len_chunked); a
+// big `keys` reply streams out as it is produced. Likewise the value of a
+// big `set` or `append` (up to 1 GB) is read straight into place rather
+// than buffered as a request first (see upload_begin).
+//
+// Options:
+//   --key-index      maintain an ordered index over all keys
+//   --scan-threads <n>  work-stealing pool size for keyspace scans
+//                       (default 4, 0 = inline)
+//   --io-threads <n>    socket I/O and parsing on n threads; commands
+//                       still run on the main thread, except `get`, which
+//                       the I/O threads answer themselves (default 0)
+//   --slice-us <n>      time a sliced command runs before letting other
+//                       clients in (default 500)
+//   --zerocopy          send string values of 64 KB and up with
+//                       MSG_ZEROCOPY; dropped per conn if the kernel
+//                       copies anyway, as it does over loopback
+//   --unix <path>       also listen on an AF_UNIX socket at path
+//   --output-limit normal|local <hard> <soft> <soft_secs>
+//                       drop a client with more than <hard> reply bytes
+//                       unread, or more than <soft> for <soft_secs>
+//                       (default: normal 256 MB/64 MB/60 s, local
+//                       1 GB/256 MB/60 s; AF_UNIX and loopback are local)
+//   --hz <n>            runs of the periodic cron per second (default 10)
+//   --idle-timeout <secs>  close clients that send nothing for this long;
+//                       blocked ones are exempt (default 0 = never)
 
 #include <assert.h>
 #include <stdint.h>
@@ -15,21 +87,80 @@
 
 #include <fcntl.h>
 #include <poll.h>
+#include <signal.h>
+#include <time.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <netinet/ip.h>
+#include <linux/errqueue.h>
 
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "hashtable.h"   // intrusive chaining HT with progressive rehashing
+#include "avl.h"         // order-statistic AVL tree
+#include "glob.h"        // compiled glob patterns for keys/scan
+#include "stream.h"      // append-only log of packed entry blocks
+#include "tseries.h"     // Gorilla-compressed time series
+#include "vecset.h"      // flat float vectors with SIMD kNN + IVF
+#include "mpsc.h"        // lock-free handoff list for threaded I/O
+#include "epoch.h"       // epoch reclamation for lock-free readers
+#include "sched.h"       // work-stealing pool for heavyweight commands
+#include "coro.h"        // time-sliced coroutine handlers
+#include "shmring.h"     // shared-memory rings for same-host clients
+#include "timer.h"       // hierarchical timer wheel for deadlines and cron
+#include "pool.h"        // buffer pool and empty-when-idle queues for conns
+#include "varint.h"      // LEB128 varints for protocol 2
 
 // ---------------------------- utils ----------------------------
 static void msg(const char *m) { fprintf(stderr, "%s\n", m); }
 static void msg_errno(const char *m) { fprintf(stderr, "[errno:%d] %s\n", errno, m); }
 static void die(const char *m) { fprintf(stderr, "[%d] %s\n", errno, m); abort(); }
 
+static uint64_t get_monotonic_msec() {
+    struct timespec tv = {0, 0};
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return (uint64_t)tv.tv_sec * 1000 + (uint64_t)tv.tv_nsec / 1000 / 1000;
+}
+static uint64_t get_realtime_msec() {
+    struct timespec tv = {0, 0};
+    clock_gettime(CLOCK_REALTIME, &tv);
+    return (uint64_t)tv.tv_sec * 1000 + (uint64_t)tv.tv_nsec / 1000 / 1000;
+}
+
+static bool str2u64(const std::string &s, uint64_t &out) {
+    if (s.empty() || s.size() > 20) return false;
+    char *endp = nullptr;
+    errno = 0;
+    out = strtoull(s.c_str(), &endp, 10);
+    return errno == 0 && endp == s.c_str() + s.size() && s[0] != '-';
+}
+
+static bool str2i64(const std::string &s, int64_t &out) {
+    if (s.empty() || s.size() > 20) return false;
+    char *endp = nullptr;
+    errno = 0;
+    out = strtoll(s.c_str(), &endp, 10);
+    return errno == 0 && endp == s.c_str() + s.size();
+}
+
+static bool str2dbl(const std::string &s, double &out) {
+    if (s.empty()) return false;
+    char *endp = nullptr;
+    out = strtod(s.c_str(), &endp);
+    return endp == s.c_str() + s.size() && out == out;  // no NaN
+}
+
 static void fd_set_nb(int fd) {
     errno = 0;
     int flags = fcntl(fd, F_GETFL, 0);
@@ -40,48 +171,354 @@ static void fd_set_nb(int fd) {
     if (errno) die("fcntl(F_SETFL)");
 }
 
+// ------------------- background -> main loop -------------------
+// Worker threads never touch server state; they post a callback that the
+// event loop runs. A self-pipe in the poll set wakes the loop.
+static int g_wake_rfd = -1;
+static int g_wake_wfd = -1;
+static std::mutex g_posted_mu;
+static std::vector<std::function<void()>> g_posted;
+
+static void main_post(std::function<void()> fn) {
+    {
+        std::lock_guard<std::mutex> lock(g_posted_mu);
+        g_posted.push_back(std::move(fn));
+    }
+    uint8_t one = 1;
+    (void)write(g_wake_wfd, &one, 1);   // a full pipe already means "wake"
+}
+
+static void main_run_posted() {
+    uint8_t drain[256];
+    while (read(g_wake_rfd, drain, sizeof(drain)) > 0) {}
+    std::vector<std::function<void()>> fns;
+    {
+        std::lock_guard<std::mutex> lock(g_posted_mu);
+        fns.swap(g_posted);
+    }
+    for (auto &fn : fns) fn();
+}
+
 const size_t k_max_msg  = 32u << 20;       // 32 MB
 const size_t k_max_args = 200u * 1000u;    // safety
+const size_t k_upload_min = 1u << 20;      // `set` values streamed from this size
+const size_t k_max_upload = 1u << 30;      // 1 GB; over k_max_msg only as an upload
+const size_t k_max_uploading = 2 * k_max_upload;    // declared bytes of all uploads in progress
 
 // ----------------------- connection state ----------------------
+struct ScanJob;
+struct Conn;
+struct IOThread;
+
+// Reply bytes. Big string values aren't copied in: each ref in `refs` is
+// sent as if its bytes sat just before byte `at` (see out_get), and holds
+// the value alive until then even if the key is overwritten.
+struct OutRef {
+    size_t at;
+    std::shared_ptr<const std::string> val;
+};
+struct Buffer : Bytes {
+    Queue<OutRef> refs;
+    size_t ref_sent = 0;    // bytes of refs.front() already written
+    size_t ref_bytes = 0;   // bytes of refs not yet written
+    uint8_t proto = 1;      // wire format of the replies (see do_hello)
+};
+
+// A value sent with MSG_ZEROCOPY, held until the kernel is done with it
+struct ZcPin {
+    uint32_t seq;           // the kernel's count of zerocopy sends
+    std::shared_ptr<const std::string> val;
+};
+
+// Socket reads start at k_read_min and double up to k_read_max while they
+// keep filling the buffer, so interactive clients stay on small buffers
+// and bulk loaders get few, large reads.
+const uint32_t k_read_min = 4 * 1024;
+const uint32_t k_read_max = 64 * 1024;
+
+// Conn isn't standard-layout, so its timers can't be found by offsetof
+struct ConnTimer {
+    Timer timer;
+    Conn *conn = nullptr;
+};
+
+// Kept small for idle clients: flags are packed together, and the byte
+// buffers and queues hold no memory while there is nothing in them (see
+// pool.h). Freed conns are recycled (see conn_new).
 struct Conn {
     int fd = -1;
     bool want_read  = false;
     bool want_write = false;
     bool want_close = false;
+    bool local = false;         // loopback or AF_UNIX peer
+    bool is_unix = false;
+    int passed_fd = -1;         // AF_UNIX: the last fd sent with a request
+    pid_t peer_pid = 0;         // AF_UNIX: SO_PEERCRED
+    uid_t peer_uid = (uid_t)-1;
+    uint32_t read_size = k_read_min;    // adapts to the traffic; see conn_read()
+    bool read_full = false;             // the last read filled its buffer
+
+    // protocol 2 (see do_hello): requests are parsed as `proto` as soon
+    // as a hello is parsed, replies go out as outgoing.proto once it runs
+    uint8_t proto = 1;
+    uint8_t proto_next = 0;         // set by a hello; 0: none
+    std::vector<std::string> ops;   // opcode - 1 -> command name
+
+    Bytes incoming;                 // bytes to parse; pooled
+    Buffer outgoing;                // framed TLV responses; pooled
+
+    // --zerocopy: big refs go out with MSG_ZEROCOPY (see zc_send)
+    bool zc = false;
+    uint32_t zc_seq = 0;            // id of the next zerocopy send
+    std::vector<ZcPin> zc_pins;
+
+    // same-host client on shared-memory rings (see shmring.h); requests
+    // and replies move there once the reply to `shm` has gone out
+    ShmLink *shm = nullptr;
+    bool shm_on = false;
+    bool in_backlog = false;    // in g_backlog: cmds wait for the client to read
+    bool blocked = false;       // see below
+    Queue<std::vector<std::string>> cmds;  // parsed, not yet run
+    uint64_t soft_since_ms = 0; // over the soft output limit since; 0: not over
+
+    // a `set`/`append` whose value is still being read into upload[2]
+    std::vector<std::string> upload;
+    size_t upload_left = 0;
 
-    std::vector<uint8_t> incoming;  // bytes to parse
-    std::vector<uint8_t> outgoing;  // framed TLV responses
+    // threaded I/O: the owning I/O thread, and the link for handoffs
+    IOThread *io = nullptr;
+    Conn *q_next = nullptr;
+
+    // --idle-timeout: on the wheel of the thread that owns the conn, and
+    // pushed back on every read or write; disarmed while main owns it
+    TimerWheel *wheel = nullptr;
+    ConnTimer idle;
+
+    // `blocked`: parked by a blocking command; no more requests are read
+    // until `block_cmd` is re-run with a result or the deadline passes
+    uint64_t block_deadline_ms = 0;       // 0: wait forever
+    Timer block_timer;                    // on g_timers until the deadline
+    std::vector<std::string> block_cmd;   // resolved copy of the command
+    std::vector<std::string> block_keys;  // keys that can wake us
+    ScanJob *job = nullptr;               // parked on a keyspace scan
+
+    Sliced sliced;                        // parked on a sliced command
+
+    // A sliced command or scan job writes its reply at the end of
+    // `outgoing` as it goes. `reply_pos` is the length word being filled
+    // in (the message's, or the current chunk's); bytes before it can be
+    // sent meanwhile.
+    size_t reply_pos = 0;
+    bool   chunked   = false;   // the reply went out as chunks
+    bool   out_wait  = false;   // producer paused until the socket drains
+
+    size_t idle_held = 0;       // its part of g_conn_idle_bytes; 0: not idle
 };
 
-static inline void buf_append(std::vector<uint8_t> &b, const uint8_t *p, size_t n) {
-    b.insert(b.end(), p, p + n);
+static std::vector<Conn*> g_blocked;      // conns parked in any blocking op
+static std::vector<Conn*> g_producing;    // replies from sliced commands or scan jobs
+static std::vector<Conn*> g_shm;          // conns with a shared-memory link
+static std::vector<Conn*> g_backlog;      // requests held back for slow readers
+static std::vector<std::string> g_ready_keys;  // written since last wakeup pass
+
+// ---------------------------- timers ---------------------------
+// The main thread's wheel holds the cron, blocking deadlines and, without
+// --io-threads, idle timeouts; each I/O thread has one for its own conns.
+static TimerWheel g_timers;
+static uint32_t g_hz = 10;                  // --hz
+static uint64_t g_idle_timeout_ms = 0;      // --idle-timeout; 0: never
+static std::atomic<uint64_t> g_idle_closed{0};
+static bool g_block_due = false;            // a blocking deadline has passed
+
+static void conn_idle_fired(Timer *t) {
+    Conn *conn = container_of(t, ConnTimer, timer)->conn;
+    if (conn->blocked) {
+        // waiting on the server, not on the client
+        tw_add(conn->wheel, t, conn->wheel->now + g_idle_timeout_ms);
+        return;
+    }
+    msg("idle timeout");
+    conn->want_close = true;
+    g_idle_closed.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Start the idle clock of a conn the calling thread has just taken on.
+static void conn_idle_arm(Conn *conn) {
+    if (!g_idle_timeout_ms) return;
+    conn->idle.conn = conn;
+    conn->idle.timer.fn = conn_idle_fired;
+    tw_add(conn->wheel, &conn->idle.timer, conn->wheel->now + g_idle_timeout_ms);
+}
+
+// The client did something. The wheel's clock is the start of this loop
+// pass, which is close enough and saves reading the time on every read.
+static void conn_touch(Conn *conn) {
+    if (tw_armed(&conn->idle.timer)) {
+        tw_add(conn->wheel, &conn->idle.timer, conn->wheel->now + g_idle_timeout_ms);
+    }
+}
+
+// Just a wakeup: serve_blocked() compares the deadlines.
+static void block_timer_fired(Timer *) {
+    g_block_due = true;
 }
-static inline void buf_consume(std::vector<uint8_t> &b, size_t n) {
+
+// Commands run, for the cron's rate sample: conn_exec() on the main
+// thread, plus the `get`s the I/O threads answer (IOThread::gets).
+static uint64_t g_stat_cmds = 0;
+
+static inline void buf_append(Bytes &b, const uint8_t *p, size_t n) {
+    pool_reserve(b, n);
+    size_t at = b.size();
+    b.resize(at + n);
+    memcpy(b.data() + at, p, n);
+}
+static inline void buf_consume(Bytes &b, size_t n) {
     b.erase(b.begin(), b.begin() + n);
 }
 
+// A sliced handler returns after its first slice; park `conn` on it
+// until the event loop has run the rest (see serve_producing).
+static void conn_slice(Conn *conn, Sliced task) {
+    if (task.done()) return;
+    conn->sliced = std::move(task);
+    conn->blocked = true;
+}
+
+static void producing_remove(Conn *conn) {
+    for (size_t i = 0; i < g_producing.size(); ++i) {
+        if (g_producing[i] == conn) {
+            g_producing[i] = g_producing.back();
+            g_producing.pop_back();
+            return;
+        }
+    }
+}
+
 // ----------------------- accept callback -----------------------
-static Conn *handle_accept(int fd) {
-    struct sockaddr_in caddr = {};
-    socklen_t alen = sizeof(caddr);
-    int cfd = accept(fd, (struct sockaddr*)&caddr, &alen);
-    if (cfd < 0) {
-        msg_errno("accept()");
-        return nullptr;
-    }
-    uint32_t ip = caddr.sin_addr.s_addr;
-    fprintf(stderr, "new client from %u.%u.%u.%u:%u\n",
-            ip & 255, (ip >> 8) & 255, (ip >> 16) & 255, (ip >> 24) & 255,
-            ntohs(caddr.sin_port));
-    fd_set_nb(cfd);
-
-    Conn *conn = new Conn();
-    conn->fd = cfd;
-    conn->want_read = true;
+static bool g_zerocopy = false;     // --zerocopy
+
+const size_t k_accept_batch = 256;  // per listener per loop pass
+
+// Conns are recycled rather than freed. Whichever thread destroys one
+// resets it and hands it back through g_conn_returned; the main thread
+// keeps up to k_conn_free_max of them for the next accepts.
+const size_t k_conn_free_max = 1024;
+static MPSCList<Conn> g_conn_returned;
+static std::vector<Conn*> g_conn_free;          // main thread
+static std::atomic<size_t> g_conn_live{0};
+static std::atomic<size_t> g_conn_idle{0};          // conns with nothing in flight
+static std::atomic<size_t> g_conn_idle_bytes{0};    // what those hold (see conn_held())
+static std::atomic<size_t> g_upload_bytes{0};   // declared bytes of uploads in progress
+
+// Main thread: move returned conns to the free list, freeing the excess.
+static void conn_reclaim() {
+    for (Conn *c = g_conn_returned.take(); c;) {
+        Conn *next = c->q_next;
+        c->q_next = nullptr;
+        if (g_conn_free.size() < k_conn_free_max) {
+            g_conn_free.push_back(c);
+        } else {
+            delete c;
+        }
+        c = next;
+    }
+}
+
+static Conn *conn_new() {
+    g_conn_live.fetch_add(1, std::memory_order_relaxed);
+    if (g_conn_free.empty()) conn_reclaim();
+    if (g_conn_free.empty()) return new Conn();
+    Conn *conn = g_conn_free.back();
+    g_conn_free.pop_back();
     return conn;
 }
 
+static void conn_free(Conn *conn) {
+    if (conn->idle_held) {
+        g_conn_idle.fetch_sub(1, std::memory_order_relaxed);
+        g_conn_idle_bytes.fetch_sub(conn->idle_held, std::memory_order_relaxed);
+    }
+    if (conn->upload_left) {
+        g_upload_bytes.fetch_sub(conn->upload[2].size() + conn->upload_left,
+                                 std::memory_order_relaxed);
+    }
+    pool_give(conn->incoming);
+    pool_give(conn->outgoing);
+    conn->~Conn();
+    new (conn) Conn();
+    g_conn_returned.push(conn);
+    g_conn_live.fetch_sub(1, std::memory_order_relaxed);
+}
+
+// Bytes a conn holds: itself, and the capacity its buffers and queues
+// kept. Once drained, the buffers are back in the pool and hold none.
+static size_t conn_held(const Conn *conn) {
+    return sizeof(Conn) + conn->incoming.capacity() + conn->outgoing.capacity()
+        + conn->outgoing.refs.items.capacity() * sizeof(OutRef)
+        + conn->cmds.items.capacity() * sizeof(conn->cmds.items[0])
+        + conn->zc_pins.capacity() * sizeof(ZcPin)
+        + (conn->ops.capacity() + conn->upload.capacity() + conn->block_cmd.capacity()
+           + conn->block_keys.capacity()) * sizeof(std::string);
+}
+
+// Recount the conn in g_conn_idle_bytes if it is idle: nothing read,
+// queued, running or unsent. Called on accept and after each read and
+// write, which is where a conn goes idle or stops being so.
+static void conn_idle_note(Conn *conn) {
+    const Buffer &out = conn->outgoing;
+    bool idle = conn->incoming.empty() && out.empty() && out.refs.empty()
+        && conn->cmds.empty() && !conn->upload_left && !conn->blocked
+        && !conn->sliced && !conn->job;
+    size_t held = idle ? conn_held(conn) : 0;
+    if (held == conn->idle_held) return;
+    if (!conn->idle_held) g_conn_idle.fetch_add(1, std::memory_order_relaxed);
+    if (!held) g_conn_idle.fetch_sub(1, std::memory_order_relaxed);
+    g_conn_idle_bytes.fetch_add(held - conn->idle_held, std::memory_order_relaxed);  // wraps
+    conn->idle_held = held;
+}
+
+// Take whatever is queued on the listener `lfd`, up to k_accept_batch,
+// so a connection storm costs one poll() per batch, not per client.
+static void handle_accept(int lfd, bool is_unix, std::vector<Conn*> &out) {
+    for (size_t i = 0; i < k_accept_batch; ++i) {
+        struct sockaddr_in caddr = {};
+        socklen_t alen = sizeof(caddr);
+        int cfd = accept4(lfd, is_unix ? nullptr : (struct sockaddr*)&caddr,
+                          is_unix ? nullptr : &alen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (cfd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN) msg_errno("accept4()");
+            return;
+        }
+        Conn *conn = conn_new();
+        conn->fd = cfd;
+        conn->want_read = true;
+        if (is_unix) {
+            struct ucred cred = {};
+            socklen_t clen = sizeof(cred);
+            if (!getsockopt(cfd, SOL_SOCKET, SO_PEERCRED, &cred, &clen)) {
+                conn->peer_pid = cred.pid;
+                conn->peer_uid = cred.uid;
+            }
+            conn->local = true;
+            conn->is_unix = true;
+            fprintf(stderr, "new local client pid %d uid %u\n",
+                    (int)conn->peer_pid, (unsigned)conn->peer_uid);
+        } else {
+            uint32_t ip = caddr.sin_addr.s_addr;
+            fprintf(stderr, "new client from %u.%u.%u.%u:%u\n",
+                    ip & 255, (ip >> 8) & 255, (ip >> 16) & 255, (ip >> 24) & 255,
+                    ntohs(caddr.sin_port));
+            conn->local = (ntohl(ip) >> 24) == 127;
+            int one = 1;
+            conn->zc = g_zerocopy && !setsockopt(cfd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one));
+        }
+        conn_idle_note(conn);
+        out.push_back(conn);
+    }
+}
+
 // ------------------------ protocol parse -----------------------
 static bool read_u32(const uint8_t *&cur, const uint8_t *end, uint32_t &out) {
     if (cur + 4 > end) return false;
@@ -117,256 +554,3165 @@ static int32_t parse_req(const uint8_t *data, size_t size, std::vector<std::stri
     return 0;
 }
 
-// -------------------- TLV serialization (9.3) ------------------
-using Buffer = std::vector<uint8_t>;
+// Protocol 2 request, after its varint length:
+// +----+-----+------+-----+------+-----+-----+------+
+// | op | len | str1 | len | str2 | ... | len | strn |
+// +----+-----+------+-----+------+-----+-----+------+
+// `len` is a varint, and the strings run to the end of the request. `op`
+// is an opcode set up by hello standing for the command name, or 0 if
+// str1 is the name.
+static int32_t parse_req2(const std::vector<std::string> &ops, const uint8_t *data, size_t size,
+                          std::vector<std::string> &out) {
+    const uint8_t *end = data + size;
+    if (data == end) return -1;
+    uint8_t op = *data++;
+    if (op > ops.size()) return -1;
+    if (op) out.push_back(ops[op - 1]);
 
+    while (data != end) {
+        if (out.size() >= k_max_args) return -1;
+        uint32_t len = 0;
+        if (varint_get32(data, end, len) != 1) return -1;
+        out.emplace_back();
+        if (!read_str(data, end, len, out.back())) return -1;
+    }
+    return 0;
+}
+
+// hello 1|2 [name...]: the protocol of the requests and replies after
+// this one. With 2, the names get opcodes 1, 2, ... for parse_req2().
+// The reply to the hello itself is in the old protocol.
+const size_t k_max_ops = 255;
+
+// The version asked for, or 0 if the hello is bad
+static uint8_t hello_version(const std::vector<std::string> &cmd) {
+    if (cmd.size() < 2 || cmd.size() - 2 > k_max_ops) return 0;
+    if (cmd[1] == "1" && cmd.size() == 2) return 1;
+    if (cmd[1] == "2") return 2;
+    return 0;
+}
+
+// -------------------- TLV serialization (9.3) ------------------
 enum : uint8_t {
     TAG_NIL = 0,
     TAG_ERR = 1,   // error message: TAG_ERR + u32 len + bytes
     TAG_STR = 2,   // string: TAG_STR + u32 len + bytes
     TAG_INT = 3,   // int64: TAG_INT + i64
-    TAG_DBL = 4,   // reserved
+    TAG_DBL = 4,   // double: TAG_DBL + f64
     TAG_ARR = 5,   // array: TAG_ARR + u32 n_items + items...
+    TAG_END = 6,   // closes an array sent with k_arr_streamed items
 };
 
+// Protocol 2 (see do_hello) has the same tags, but lengths, counts and
+// the outer message length are varints (varint.h), ints are zigzagged
+// varints, and the commonest values fit in the tag byte itself:
+//   TAG2_SMALL_INT | v          int v, 0..63
+//   TAG2_SHORT_STR | n, bytes   string of n bytes, 0..63
+// Array counts are written padded (varint_put_padded), as they are
+// filled in after the items, and so are message lengths from 128 bytes
+// up. Chunk lengths stay u32 for the same reason.
+enum : uint8_t {
+    TAG2_SMALL_INT = 0x40,
+    TAG2_SHORT_STR = 0x80,
+};
+const uint32_t k_tag2_short = 64;   // values under this fit in the tag
+
+// Replies too big to hold are framed as chunks instead of one message:
+//   u32 k_len_chunked, then { u32 len, bytes }*, then u32 0
+// and the chunks concatenate to one TLV value. In such a reply, an
+// array whose size isn't known up front has k_arr_streamed items and
+// ends at a TAG_END. In protocol 2, k_len_chunked is a varint too.
+const uint32_t k_len_chunked  = 0xffffffff;
+const uint32_t k_arr_streamed = 0xffffffff;
+
+// Each value is written by reserving its whole size once and storing
+// into it unchecked; a header is a tag byte and one 4- or 8-byte copy.
+// Callers that know a run of items up front (a `keys` slice, a `scan`
+// page) reserve for all of them with out_grow() and use the tlv_put_*
+// encoders directly, reserving for the longest encoding under protocol 2
+// and giving back the rest.
+const size_t k_tlv_hdr  = 5;                    // tag + u32
+const size_t k_tlv2_hdr = 1 + k_varint_max32;   // tag + varint, at most
+
+// Extend `buf` by `n` bytes, not zeroed (see Bytes), and return them
+static inline uint8_t *out_grow(Buffer &buf, size_t n) {
+    pool_reserve(buf, n);
+    size_t at = buf.size();
+    buf.resize(at + n);
+    return buf.data() + at;
+}
+// Give back the part of an out_grow() that `end` didn't reach
+static inline void out_shrink(Buffer &buf, const uint8_t *end) {
+    buf.resize((size_t)(end - buf.data()));
+}
+
+static inline uint8_t *tlv_put_hdr(uint8_t *p, uint8_t tag, uint32_t v) {
+    p[0] = tag;
+    memcpy(p + 1, &v, 4);       // little-endian
+    return p + k_tlv_hdr;
+}
+static inline uint8_t *tlv_put_str(uint8_t *p, const char *s, size_t n) {
+    p = tlv_put_hdr(p, TAG_STR, (uint32_t)n);
+    memcpy(p, s, n);
+    return p + n;
+}
+static inline uint8_t *tlv_put_i64(uint8_t *p, int64_t v) {
+    p[0] = TAG_INT;
+    memcpy(p + 1, &v, 8);       // little-endian
+    return p + 9;
+}
+
+// Exact sizes, for the single values out_*() write
+static inline size_t tlv2_str_size(size_t n) {
+    return n < k_tag2_short ? 1 + n : 1 + varint_size(n) + n;
+}
+static inline size_t tlv2_int_size(int64_t v) {
+    return (uint64_t)v < k_tag2_short ? 1 : 1 + varint_size(zigzag(v));
+}
+
+static inline uint8_t *tlv2_put_hdr(uint8_t *p, uint8_t tag, uint32_t v) {
+    *p++ = tag;
+    return varint_put(p, v);
+}
+static inline uint8_t *tlv2_put_str(uint8_t *p, const char *s, size_t n) {
+    if (n < k_tag2_short) {
+        *p++ = (uint8_t)(TAG2_SHORT_STR | n);
+    } else {
+        p = tlv2_put_hdr(p, TAG_STR, (uint32_t)n);
+    }
+    memcpy(p, s, n);
+    return p + n;
+}
+static inline uint8_t *tlv2_put_i64(uint8_t *p, int64_t v) {
+    if ((uint64_t)v < k_tag2_short) {
+        *p = (uint8_t)(TAG2_SMALL_INT | v);
+        return p + 1;
+    }
+    *p++ = TAG_INT;
+    return varint_put(p, zigzag(v));
+}
+
+// Most a string header takes in the format of `out`
+static inline size_t out_str_hdr(const Buffer &out) {
+    return out.proto == 1 ? k_tlv_hdr : k_tlv2_hdr;
+}
+// Bytes of the outer length in front of each message being built
+static inline size_t out_msg_hdr(const Buffer &out) {
+    return out.proto == 1 ? 4 : k_varint_max32;
+}
+
 static inline void buf_append_u8(Buffer &buf, uint8_t v) {
-    buf.push_back(v);
+    *out_grow(buf, 1) = v;
 }
 static inline void buf_append_u32(Buffer &buf, uint32_t v) {
-    buf_append(buf, (const uint8_t*)&v, 4); // little-endian
+    memcpy(out_grow(buf, 4), &v, 4);    // little-endian
+}
+
+// ------------------- pre-encoded replies ---------------------
+// The values most replies are, encoded once in each protocol. They are
+// copied rather than sent as refs: for a few bytes, a shared_ptr and an
+// iovec cost more than the copy.
+enum FragId : uint8_t {
+    FRAG_NIL,
+    FRAG_INT_0,
+    FRAG_INT_1,
+    FRAG_ERR_ARGS,
+    FRAG_ERR_CMD,
+    FRAG_ERR_NOT_STR,
+    FRAG_ERR_NOT_STREAM,
+    FRAG_ERR_NOT_TS,
+    FRAG_ERR_NOT_VSET,
+    k_nfrags,
+};
+
+struct Frag {
+    uint8_t size = 0;       // bytes of val
+    uint8_t val[32] = {};   // one TLV value
+};
+struct FragTable {
+    Frag f[k_nfrags];
+};
+
+// `body` follows the tag byte
+static constexpr Frag frag_make(uint8_t tag, const uint8_t *body, uint32_t n) {
+    Frag f;
+    f.val[0] = tag;
+    for (uint32_t i = 0; i < n; ++i) f.val[1 + i] = body[i];
+    f.size = (uint8_t)(1 + n);
+    return f;
+}
+static constexpr Frag frag_int(uint8_t proto, int64_t v) {
+    if (proto == 2) return frag_make((uint8_t)(TAG2_SMALL_INT | v), nullptr, 0);
+    uint8_t b[8] = {};
+    for (int i = 0; i < 8; ++i) b[i] = (uint8_t)((uint64_t)v >> (8 * i));
+    return frag_make(TAG_INT, b, 8);
+}
+// the message must fit in Frag::val, so in protocol 2 its length is one byte
+template <size_t N>
+static constexpr Frag frag_err(uint8_t proto, const char (&m)[N]) {
+    static_assert(N <= 28);
+    uint8_t b[4 + N] = {};
+    size_t hdr = proto == 1 ? 4 : 1;
+    for (size_t i = 0; i < hdr; ++i) b[i] = (uint8_t)((N - 1) >> (8 * i));
+    for (size_t i = 0; i + 1 < N; ++i) b[hdr + i] = (uint8_t)m[i];
+    return frag_make(TAG_ERR, b, (uint32_t)(hdr + N - 1));
+}
+
+static constexpr FragTable frag_table(uint8_t proto) {
+    return {{
+        frag_make(TAG_NIL, nullptr, 0),
+        frag_int(proto, 0),
+        frag_int(proto, 1),
+        frag_err(proto, "ERR bad args"),
+        frag_err(proto, "ERR bad command"),
+        frag_err(proto, "ERR not a string"),
+        frag_err(proto, "ERR not a stream"),
+        frag_err(proto, "ERR not a time series"),
+        frag_err(proto, "ERR not a vector set"),
+    }};
 }
-static inline void buf_append_i64(Buffer &buf, int64_t v) {
-    buf_append(buf, (const uint8_t*)&v, 8); // little-endian
+static constexpr FragTable k_frags[2] = {frag_table(1), frag_table(2)};
+
+static inline void out_frag(Buffer &out, FragId id) {
+    const Frag &f = k_frags[out.proto - 1].f[id];
+    memcpy(out_grow(out, f.size), f.val, f.size);
 }
 
 static void out_nil(Buffer &out) {
-    buf_append_u8(out, TAG_NIL);
+    out_frag(out, FRAG_NIL);
 }
 static void out_str(Buffer &out, const char *s, size_t n) {
-    buf_append_u8(out, TAG_STR);
-    buf_append_u32(out, (uint32_t)n);
-    if (n) buf_append(out, (const uint8_t*)s, n);
+    if (out.proto == 1) {
+        tlv_put_str(out_grow(out, k_tlv_hdr + n), s, n);
+    } else {
+        tlv2_put_str(out_grow(out, tlv2_str_size(n)), s, n);
+    }
 }
 static void out_int(Buffer &out, int64_t v) {
-    buf_append_u8(out, TAG_INT);
-    buf_append_i64(out, v);
+    if (out.proto == 1) {
+        tlv_put_i64(out_grow(out, 9), v);
+    } else {
+        tlv2_put_i64(out_grow(out, tlv2_int_size(v)), v);
+    }
+}
+static void out_dbl(Buffer &out, double v) {
+    uint8_t *p = out_grow(out, 9);
+    p[0] = TAG_DBL;
+    memcpy(p + 1, &v, 8);
 }
 static void out_arr(Buffer &out, uint32_t n_items) {
-    buf_append_u8(out, TAG_ARR);
-    buf_append_u32(out, n_items);
+    if (out.proto == 1) {
+        tlv_put_hdr(out_grow(out, k_tlv_hdr), TAG_ARR, n_items);
+    } else {
+        out_shrink(out, tlv2_put_hdr(out_grow(out, k_tlv2_hdr), TAG_ARR, n_items));
+    }
+}
+// Array whose length is only known after its items are written
+static size_t out_arr_begin(Buffer &out) {
+    if (out.proto == 1) {
+        out_arr(out, 0);
+        return out.size() - 4;
+    }
+    *out_grow(out, k_tlv2_hdr) = TAG_ARR;
+    return out.size() - k_varint_max32;
+}
+static void out_arr_end(Buffer &out, size_t pos, uint32_t n_items) {
+    if (out.proto == 1) {
+        memcpy(&out[pos], &n_items, 4);
+    } else {
+        varint_put_padded(&out[pos], n_items);
+    }
 }
 static void out_err_msg(Buffer &out, const char* m) {
-    buf_append_u8(out, TAG_ERR);
     uint32_t mlen = (uint32_t)strlen(m);
-    buf_append_u32(out, mlen);
-    if (mlen) buf_append(out, (const uint8_t*)m, mlen);
+    uint8_t *p = out_grow(out, out_str_hdr(out) + mlen);
+    uint8_t *s = out.proto == 1 ? tlv_put_hdr(p, TAG_ERR, mlen) : tlv2_put_hdr(p, TAG_ERR, mlen);
+    memcpy(s, m, mlen);
+    out_shrink(out, s + mlen);
+}
+
+// Drop everything from byte `pos` on, refs included
+static void out_truncate(Buffer &out, size_t pos) {
+    while (!out.refs.empty() && out.refs.back().at > pos) {
+        out.ref_bytes -= out.refs.back().val->size();
+        out.refs.pop_back();
+    }
+    out.resize(pos);
 }
 
-// Outer 4-byte length prefix for each response message
+// Open up `n` zeroed bytes at `pos`; refs from there on move along
+static void out_insert(Buffer &out, size_t pos, size_t n) {
+    pool_reserve(out, n);
+    out.insert(out.begin() + pos, n, 0);
+    for (size_t i = out.refs.size(); i-- && out.refs[i].at >= pos;) {
+        out.refs[i].at += n;
+    }
+}
+
+// Close up `n` bytes at `pos`; refs after them move back
+static void out_erase(Buffer &out, size_t pos, size_t n) {
+    out.erase(out.begin() + pos, out.begin() + pos + n);
+    for (size_t i = out.refs.size(); i-- && out.refs[i].at > pos;) {
+        out.refs[i].at -= n;
+    }
+}
+
+// Turn the message at `header_pos` into a chunked one: its length
+// becomes k_len_chunked, followed by room for the first chunk's length.
+// Returns where that goes.
+static size_t out_chunked_begin(Buffer &out, size_t header_pos) {
+    size_t mark = out.proto == 1 ? 4 : k_varint_max32;
+    out_insert(out, header_pos + out_msg_hdr(out), mark + 4 - out_msg_hdr(out));
+    if (out.proto == 1) {
+        memcpy(&out[header_pos], &k_len_chunked, 4);
+    } else {
+        varint_put(&out[header_pos], k_len_chunked);
+    }
+    return header_pos + mark;
+}
+
+// Outer length prefix for each response message: 4 bytes, or in
+// protocol 2 room for the longest varint (see response_end())
 static void response_begin(Buffer &out, size_t *header_pos) {
+    if (!out.capacity()) pool_take(out, k_pool_min);
     *header_pos = out.size();
-    buf_append_u32(out, 0); // reserve space
+    out_grow(out, out_msg_hdr(out));    // reserve space
 }
+// A ref at `header_pos` itself ends the message before; later ones are ours.
 static size_t response_size(const Buffer &out, size_t header_pos) {
-    return out.size() - header_pos - 4;
+    size_t n = out.size() - header_pos - out_msg_hdr(out);
+    for (size_t i = out.refs.size(); i-- && out.refs[i].at > header_pos;) {
+        n += out.refs[i].val->size();
+    }
+    return n;
 }
 static void response_end(Buffer &out, size_t header_pos) {
+    size_t hdr = out_msg_hdr(out);
     size_t body = response_size(out, header_pos);
+    if (body > k_max_msg && body < k_len_chunked) {
+        // over the message limit: send the body as a single chunk
+        header_pos = out_chunked_begin(out, header_pos);
+        uint32_t len_le = (uint32_t)body;
+        memcpy(&out[header_pos], &len_le, 4);
+        buf_append_u32(out, 0);
+        return;
+    }
     if (body > k_max_msg) {
-        // Replace body with a small error message
-        out.resize(header_pos + 4);
+        out_truncate(out, header_pos + hdr);
         out_err_msg(out, "response too big");
         body = response_size(out, header_pos);
     }
-    uint32_t len_le = (uint32_t)body;
-    memcpy(&out[header_pos], &len_le, 4);
-}
-
-// ------------------ Intrusive HT-backed database ----------------
-struct Entry {
-    HNode       node;
-    std::string key;
-    std::string val;
-};
-struct LookupKey {
-    HNode       node;
-    std::string key;
-};
-static bool key_eq(HNode *lhs, HNode *rhs) {
-    Entry     *le = container_of(lhs, Entry,    node);
-    LookupKey *rk = container_of(rhs, LookupKey, node);
-    return le->key == rk->key;
+    if (out.proto == 1) {
+        uint32_t len_le = (uint32_t)body;
+        memcpy(&out[header_pos], &len_le, 4);
+    } else if (body < 0x80) {
+        // a small reply takes one length byte; moving it is cheap
+        out_erase(out, header_pos + 1, hdr - 1);
+        out[header_pos] = (uint8_t)body;
+    } else {
+        // a bigger one stays put, behind a padded length
+        varint_put_padded(&out[header_pos], (uint32_t)body);
+    }
 }
 
-static struct {
-    HMap db;
-} g_data;
-
-// Iterate a single HTab with a plain C-style callback
-typedef void (*htab_iter_cb)(HNode* node, void* arg);
+// ----------------------- streamed replies ----------------------
+// A reply produced over time is cut into chunks so that its head can be
+// sent while the rest is made, and the producer stops while the client
+// has more than k_reply_high bytes to read: per-conn memory stays at
+// about that no matter how big the reply gets. Pipelined requests are
+// held back the same way (see conn_exec), and the socket isn't read
+// meanwhile.
+const size_t k_chunk_size = 64 * 1024;
+const size_t k_reply_high = 1024 * 1024;
+const size_t k_reply_low  = 256 * 1024;
 
-static void for_each_htab_slot(HTab *t, htab_iter_cb cb, void* arg) {
-    if (!t || !t->tab) return;
-    size_t cap = t->mask + 1;
-    for (size_t i = 0; i < cap; ++i) {
-        for (HNode *n = t->tab[i]; n; n = n->next) {
-            cb(n, arg);
-        }
-    }
+// Reply bytes the client has yet to read, refs included
+static size_t out_pending(const Buffer &out) {
+    return out.size() + out.ref_bytes;
 }
 
-static size_t ht_total_size(const HMap &m) {
-    return (m.newer.size) + (m.older.tab ? m.older.size : 0);
+// Bytes of `outgoing` a write can take now, along with the refs before them
+static size_t conn_sendable(const Conn *conn) {
+    return conn->sliced || conn->job ? conn->reply_pos : conn->outgoing.size();
+}
+static bool conn_can_send(const Conn *conn) {
+    const Buffer &out = conn->outgoing;
+    return conn_sendable(conn) > 0 || (!out.refs.empty() && out.refs.front().at == 0);
+}
+static bool out_empty(const Buffer &out) {
+    return out.empty() && out.refs.empty();
 }
 
-// ------------------------ command logic ------------------------
-static void do_get(std::vector<std::string> &cmd, Buffer &out) {
-    if (cmd.size() != 2) { out_nil(out); return; }
-    LookupKey lk;
-    lk.key = std::move(cmd[1]);
-    lk.node.hcode = str_hash((const uint8_t*)lk.key.data(), lk.key.size());
-    if (HNode *n = hm_lookup(&g_data.db, &lk.node, &key_eq)) {
-        Entry *e = container_of(n, Entry, node);
-        out_str(out, e->val.data(), e->val.size());
-    } else {
-        out_nil(out);
-    }
+static size_t reply_body_size(const Conn *conn) {
+    size_t hdr = conn->chunked ? 4 : out_msg_hdr(conn->outgoing);
+    return conn->outgoing.size() - conn->reply_pos - hdr;
 }
-static void do_set(std::vector<std::string> &cmd, Buffer &out) {
-    if (cmd.size() != 3) { out_nil(out); return; }
 
-    LookupKey lk;
-    lk.key = cmd[1];
-    lk.node.hcode = str_hash((const uint8_t*)lk.key.data(), lk.key.size());
-    if (HNode *n = hm_lookup(&g_data.db, &lk.node, &key_eq)) {
-        Entry *e = container_of(n, Entry, node);
-        e->val.swap(cmd[2]);
-        out_nil(out);
-        return;
+// Close the current chunk once it has `min_bytes`, making it sendable.
+static void reply_chunk(Conn *conn, size_t min_bytes) {
+    Buffer &out = conn->outgoing;
+    if (reply_body_size(conn) < min_bytes) return;
+    if (!conn->chunked) {
+        // what the reply has so far becomes the first chunk
+        conn->reply_pos = out_chunked_begin(out, conn->reply_pos);
+        conn->chunked = true;
     }
-    Entry *e = new Entry();
-    e->key.swap(cmd[1]);
-    e->val.swap(cmd[2]);
-    e->node.hcode = str_hash((const uint8_t*)e->key.data(), e->key.size());
-    hm_insert(&g_data.db, &e->node);
-    out_nil(out);
+    uint32_t len = (uint32_t)reply_body_size(conn);
+    memcpy(&out[conn->reply_pos], &len, 4);
+    conn->reply_pos = out.size();
+    buf_append_u32(out, 0);         // next chunk, or the end
 }
-static void do_del(std::vector<std::string> &cmd, Buffer &out) {
-    if (cmd.size() != 2) { out_int(out, 0); return; }
-    LookupKey lk;
-    lk.key = std::move(cmd[1]);
-    lk.node.hcode = str_hash((const uint8_t*)lk.key.data(), lk.key.size());
-    if (HNode *n = hm_delete(&g_data.db, &lk.node, &key_eq)) {
-        Entry *e = container_of(n, Entry, node);
-        delete e;
-        out_int(out, 1);
+
+static void reply_end(Conn *conn) {
+    if (conn->chunked) {
+        reply_chunk(conn, 1);       // leaves the terminating 0
+        conn->chunked = false;
     } else {
-        out_int(out, 0);
+        response_end(conn->outgoing, conn->reply_pos);
     }
 }
-static void do_keys(std::vector<std::string> &cmd, Buffer &out) {
-    (void)cmd;
 
-    // Emit array header with current size snapshot
-    uint32_t n = (uint32_t)ht_total_size(g_data.db);
-    out_arr(out, n);
+// An array in a reply that is being produced. It is sent with its count
+// if it stays under one chunk; past that the count goes out as
+// k_arr_streamed and the items follow chunk by chunk.
+struct ReplyArr {
+    size_t   off = 0;           // count position, relative to reply_pos
+    uint32_t n = 0;
+    bool     streamed = false;
+};
 
-    // Emit keys from newer and older tables
-    auto emit_key_cb = [](HNode* node, void* arg) {
-        Buffer &bout = *reinterpret_cast<Buffer*>(arg);
-        const std::string &k = container_of(node, Entry, node)->key;
-        out_str(bout, k.data(), k.size());
-    };
-    for_each_htab_slot(&g_data.db.newer, emit_key_cb, &out);
-    for_each_htab_slot(&g_data.db.older, emit_key_cb, &out);
+static void reply_arr_begin(Conn *conn, ReplyArr *arr) {
+    arr->off = out_arr_begin(conn->outgoing) - conn->reply_pos;
 }
 
-static void do_request(std::vector<std::string> &cmd, Buffer &out) {
-    if (cmd.empty()) { out_nil(out); return; }
-    const std::string &op = cmd[0];
-    if      (op == "get")  return do_get(cmd, out);
-    else if (op == "set")  return do_set(cmd, out);
-    else if (op == "del")  return do_del(cmd, out);
-    else if (op == "keys") return do_keys(cmd, out);
+// After adding items: seal a chunk if there's enough for one.
+static void reply_arr_flush(Conn *conn, ReplyArr *arr) {
+    if (!arr->streamed && reply_body_size(conn) >= k_chunk_size) {
+        out_arr_end(conn->outgoing, conn->reply_pos + arr->off, k_arr_streamed);
+        arr->streamed = true;
+    }
+    if (arr->streamed) reply_chunk(conn, k_chunk_size);
+}
 
-    out_err_msg(out, "ERR bad command");
+static void reply_arr_end(Conn *conn, ReplyArr *arr) {
+    if (arr->streamed) {
+        buf_append_u8(conn->outgoing, TAG_END);
+    } else {
+        out_arr_end(conn->outgoing, conn->reply_pos + arr->off, arr->n);
+    }
 }
 
-// --------------- per-connection request handling ---------------
-static bool try_one_request(Conn *conn) {
-    if (conn->incoming.size() < 4) return false;
+// Suspends a sliced handler while the client has too much to read;
+// handle_write() lets it go on once most of that is sent.
+struct ReplyDrain {
+    Conn *conn;
+    bool await_ready() const noexcept { return conn->outgoing.size() < k_reply_high; }
+    void await_suspend(std::coroutine_handle<>) const noexcept { conn->out_wait = true; }
+    void await_resume() const noexcept {}
+};
 
-    uint32_t len = 0;
-    memcpy(&len, conn->incoming.data(), 4);
-    if (len > k_max_msg) {
-        msg("too long");
-        conn->want_close = true;
+// ------------------------ output limits ------------------------
+// How far behind on its replies a client may fall. Held-back requests
+// keep most clients near k_reply_high, so these catch big single replies
+// and pileups of wakeups: over `hard` the conn is dropped right away,
+// over `soft` for `soft_secs` as well. Only the conn's own bytes count,
+// not refs, which share their values with the keyspace. 0: no limit.
+struct OutLimit {
+    size_t   hard;
+    size_t   soft;
+    uint64_t soft_secs;
+};
+
+enum { CLIENT_NORMAL = 0, CLIENT_LOCAL = 1, k_client_classes = 2 };
+static const char *const k_client_class_names[k_client_classes] = {"normal", "local"};
+static OutLimit g_out_limits[k_client_classes] = {
+    {256u << 20, 64u << 20, 60},    // normal
+    {1u << 30, 256u << 20, 60},     // local: AF_UNIX and loopback peers
+};
+
+// True if `conn` is over its limits and must go. Otherwise lowers
+// `*deadline_ms` to when its soft limit runs out, if it is over that.
+static bool conn_over_limit(Conn *conn, uint64_t now_ms, uint64_t *deadline_ms) {
+    const OutLimit &lim = g_out_limits[conn->local ? CLIENT_LOCAL : CLIENT_NORMAL];
+    size_t n = conn->outgoing.size();
+    if (lim.hard && n > lim.hard) {
+        fprintf(stderr, "output buffer over hard limit (%zu bytes), closing\n", n);
+        return true;
+    }
+    if (!lim.soft || n <= lim.soft) {
+        conn->soft_since_ms = 0;
         return false;
     }
-    if (conn->incoming.size() < 4 + len) return false;
+    if (!conn->soft_since_ms) conn->soft_since_ms = now_ms;
+    uint64_t deadline = conn->soft_since_ms + lim.soft_secs * 1000;
+    if (now_ms >= deadline) {
+        fprintf(stderr, "output buffer over soft limit for %us, closing\n",
+                (unsigned)lim.soft_secs);
+        return true;
+    }
+    *deadline_ms = std::min(*deadline_ms, deadline);
+    return false;
+}
 
-    const uint8_t *body = &conn->incoming[4];
-    std::vector<std::string> cmd;
-    if (parse_req(body, len, cmd) < 0) {
-        msg("bad request");
-        conn->want_close = true;
+static bool parse_out_limit(char **args, OutLimit &out, size_t &cls) {
+    uint64_t hard = 0, soft = 0, secs = 0;
+    for (cls = 0; cls < k_client_classes; ++cls) {
+        if (!strcmp(args[0], k_client_class_names[cls])) break;
+    }
+    if (cls == k_client_classes || !str2u64(args[1], hard) || !str2u64(args[2], soft)
+        || !str2u64(args[3], secs)) {
         return false;
     }
-
-    size_t header_pos = 0;
-    response_begin(conn->outgoing, &header_pos);
-    do_request(cmd, conn->outgoing);
-    response_end(conn->outgoing, header_pos);
-
-    buf_consume(conn->incoming, 4 + len);
+    out = OutLimit{(size_t)hard, (size_t)soft, secs};
     return true;
 }
 
-static void handle_write(Conn *conn) {
-    assert(!conn->outgoing.empty());
-    ssize_t rv = write(conn->fd, conn->outgoing.data(), conn->outgoing.size());
-    if (rv < 0 && errno == EAGAIN) return;
-    if (rv < 0) {
-        msg_errno("write()");
-        conn->want_close = true;
-        return;
-    }
-    buf_consume(conn->outgoing, (size_t)rv);
-    if (conn->outgoing.empty()) {
-        conn->want_write = false;
-        conn->want_read  = true;
+// ------------------ Intrusive HT-backed database ----------------
+enum : uint32_t {
+    T_STR     = 0,
+    T_STREAM  = 1,
+    T_TSERIES = 2,
+    T_VECSET  = 3,
+};
+
+struct Entry {
+    HNode       node;
+    AVLNode     tree;               // ordered key index, if enabled
+    std::string key;
+    uint32_t    type = T_STR;
+    std::string val;                // T_STR under k_str_shared bytes
+    std::shared_ptr<std::string> big;   // T_STR, bigger: replies refer to it
+    Stream     *stream = nullptr;   // T_STREAM
+    TSeries    *ts     = nullptr;   // T_TSERIES
+    VecSet     *vs     = nullptr;   // T_VECSET
+};
+
+// Frees a non-string value; `type` is left alone for concurrent readers
+static void entry_free_value(Entry *e) {
+    if (e->stream) {
+        stream_clear(e->stream);
+        delete e->stream;
+        e->stream = nullptr;
+    }
+    if (e->ts) {
+        ts_clear(e->ts);
+        delete e->ts;
+        e->ts = nullptr;
+    }
+    if (e->vs) {
+        vecset_clear(e->vs);
+        delete e->vs;
+        e->vs = nullptr;
+    }
+}
+
+static void entry_set_type(Entry *e, uint32_t type) {
+    if (e->type == type) return;
+    entry_free_value(e);
+    e->val.clear();
+    e->big.reset();
+    e->type = type;
+    if (type == T_STREAM) {
+        e->stream = new Stream();
+        stream_init(e->stream);
+    } else if (type == T_TSERIES) {
+        e->ts = new TSeries();
+        ts_init(e->ts);
+    } else if (type == T_VECSET) {
+        e->vs = new VecSet();   // dimension is set by the first vadd
+    }
+}
+
+// Keys are immutable, so scan workers can read them from a snapshot of
+// Entry pointers. While any snapshot is alive, deleted entries drop
+// their value right away but the Entry itself waits in the graveyard.
+static uint32_t g_snapshots = 0;
+static std::vector<Entry*> g_graveyard;
+
+// With I/O threads, `get` looks entries up without locks (see
+// hm_lookup_concurrent). What those readers see of an Entry -- key,
+// type and string value -- never changes while it is reachable: `set`
+// swaps in a new Entry, and unlinked entries and slot arrays are freed
+// only once epoch reclamation says no reader can hold them.
+static bool g_rcu = false;
+
+static void entry_free_cb(void *arg) { delete (Entry*)arg; }
+
+// Frees a dead Entry whose value is already gone
+static void entry_release(Entry *e) {
+    if (g_rcu) {
+        epoch_retire(&entry_free_cb, e);
+    } else {
+        delete e;
+    }
+}
+
+static void entry_del_now(Entry *e) {
+    entry_free_value(e);
+    delete e;
+}
+
+static void entry_del(Entry *e) {
+    entry_free_value(e);
+    if (g_snapshots) {
+        g_graveyard.push_back(e);
+        return;
+    }
+    entry_release(e);
+}
+
+// -------------------------- lazy free --------------------------
+// Freeing a big value walks every one of its allocations. `unlink` and
+// `flushall async` detach values from the keyspace in O(1) and leave the
+// walk to a background thread; cheap values are still freed inline.
+const size_t k_lazyfree_min_effort = 64;    // allocations
+
+struct LazyFree {
+    LazyFree *q_next = nullptr;
+    Entry    *value  = nullptr;     // bare Entry owning a detached value
+    HMap      db     = {};          // flushall: the old tables and entries
+};
+
+static MPSCList<LazyFree> g_lazyfree;
+static int g_lazyfree_wfd = -1;
+static std::atomic<uint64_t> g_lazyfree_pending{0};
+static std::vector<LazyFree*> g_lazyfree_held;  // entries a snapshot can see
+
+// Roughly the number of allocations freeing the value takes
+static size_t entry_free_effort(const Entry *e) {
+    switch (e->type) {
+    case T_STREAM:  return e->stream->nblocks;
+    case T_TSERIES: return e->ts->chunks.size();
+    case T_VECSET:  return e->vs->n;
+    default:        return 1;
+    }
+}
+
+// Move a non-string value out of `e` into a new bare Entry
+static Entry *entry_detach_value(Entry *e) {
+    assert(e->type != T_STR);   // effort 1: never worth it
+    Entry *v = new Entry();
+    v->type = e->type;
+    std::swap(v->stream, e->stream);
+    std::swap(v->ts, e->ts);
+    std::swap(v->vs, e->vs);
+    return v;
+}
+
+// Runs on any thread: only touches what `lf` owns.
+static void lazyfree_run(LazyFree *lf) {
+    if (lf->value) entry_del_now(lf->value);
+    for (HTab *t : {&lf->db.newer, &lf->db.older}) {
+        for (size_t i = 0; t->tab && i <= t->mask; ++i) {
+            HNode *n = t->tab[i];
+            while (n) {
+                HNode *next = n->next;
+                entry_del_now(container_of(n, Entry, node));
+                n = next;
+            }
+        }
+    }
+    hm_destroy(&lf->db);
+    delete lf;
+}
+
+static void lazyfree_thread(int rfd) {
+    uint8_t drain[256];
+    while (true) {
+        // blocks until a push onto the empty list writes a byte
+        if (read(rfd, drain, sizeof(drain)) < 0 && errno != EINTR) die("read()");
+        for (LazyFree *lf = g_lazyfree.take(); lf;) {
+            LazyFree *next = lf->q_next;
+            lazyfree_run(lf);
+            g_lazyfree_pending--;
+            lf = next;
+        }
+    }
+}
+
+static void lazyfree_push(void *arg) {
+    g_lazyfree_pending++;
+    if (g_lazyfree.push((LazyFree*)arg)) {
+        uint8_t one = 1;
+        (void)write(g_lazyfree_wfd, &one, 1);
+    }
+}
+
+static void lazyfree_submit(LazyFree *lf) {
+    bool has_entries = lf->db.newer.size + lf->db.older.size > 0;
+    if (g_snapshots && has_entries) {
+        g_lazyfree_held.push_back(lf);  // submitted by snapshot_release()
+    } else if (g_rcu && has_entries) {
+        epoch_retire(&lazyfree_push, lf);
+    } else {
+        lazyfree_push(lf);
+    }
+}
+
+static void lazyfree_start() {
+    int fds[2];
+    if (pipe(fds)) die("pipe()");
+    g_lazyfree_wfd = fds[1];
+    fd_set_nb(g_lazyfree_wfd);      // the read end stays blocking
+    std::thread(lazyfree_thread, fds[0]).detach();
+}
+
+static void snapshot_release() {
+    assert(g_snapshots > 0);
+    if (--g_snapshots) return;
+    for (Entry *e : g_graveyard) entry_release(e);
+    g_graveyard.clear();
+    std::vector<LazyFree*> held;
+    held.swap(g_lazyfree_held);
+    for (LazyFree *lf : held) lazyfree_submit(lf);
+}
+
+// `del` of a big value and `flushall sync` free in time slices instead
+// of stalling the loop; the client gets its reply once the memory is gone.
+// If it hangs up first, what is left goes to the lazy-free thread.
+struct LazyFreeHold {
+    LazyFree *lf;
+    ~LazyFreeHold() { if (lf) lazyfree_submit(lf); }
+};
+
+// Free part of a detached value; false once only the empty containers
+// are left for entry_del_now()
+static bool entry_free_some(Entry *v) {
+    switch (v->type) {
+    case T_STREAM: {
+        Stream *s = v->stream;
+        stream_trim_maxlen(s, s->length > 4096 ? s->length - 4096 : 0);
+        return s->length > 0;
+    }
+    case T_TSERIES: {
+        std::vector<TSChunk*> &chunks = v->ts->chunks;
+        for (size_t i = 0; i < 16 && !chunks.empty(); ++i) {
+            delete chunks.back();
+            chunks.pop_back();
+        }
+        return !chunks.empty();
+    }
+    case T_VECSET: {
+        std::vector<VecItem*> &items = v->vs->items;
+        for (size_t i = 0; i < 256 && !items.empty(); ++i) {
+            free(items.back());
+            items.pop_back();
+        }
+        return !items.empty();
+    }
+    default:
+        return false;
+    }
+}
+
+static Sliced lazyfree_sliced(LazyFree *lf) {
+    LazyFreeHold hold = {lf};
+    if (Entry *v = lf->value) {
+        while (entry_free_some(v)) co_await slice_yield();
+        entry_del_now(v);
+        lf->value = nullptr;
+    }
+    for (HTab *t : {&lf->db.newer, &lf->db.older}) {
+        for (size_t i = 0; t->tab && i <= t->mask; ++i) {
+            // unlink as we go so the lazy-free thread can take the rest
+            while (HNode *n = t->tab[i]) {
+                Entry *e = container_of(n, Entry, node);
+                while (entry_free_some(e)) co_await slice_yield();
+                t->tab[i] = n->next;
+                t->size--;
+                entry_del_now(e);
+            }
+            co_await slice_yield();
+        }
+    }
+    hold.lf = nullptr;
+    hm_destroy(&lf->db);
+    delete lf;
+}
+
+// Approximate memory held by an entry
+static uint64_t entry_mem(const Entry *e) {
+    uint64_t n = sizeof(Entry) + e->key.capacity();
+    switch (e->type) {
+    case T_STR:
+        n += e->val.capacity();
+        if (e->big) n += sizeof(std::string) + e->big->capacity();
+        break;
+    case T_STREAM:
+        n += sizeof(Stream) + e->stream->bytes + e->stream->nblocks * sizeof(StreamBlock);
+        break;
+    case T_TSERIES:
+        n += sizeof(TSeries) + ts_bytes(e->ts) + e->ts->chunks.size() * sizeof(TSChunk);
+        break;
+    case T_VECSET:
+        n += sizeof(VecSet) + e->vs->cap * e->vs->stride * sizeof(float)
+           + e->vs->n * (sizeof(VecItem) + sizeof(VecItem*) + 16);
+        break;
+    }
+    return n;
+}
+struct LookupKey {
+    HNode       node;
+    std::string key;
+};
+static bool key_eq(HNode *lhs, HNode *rhs) {
+    Entry     *le = container_of(lhs, Entry,    node);
+    LookupKey *rk = container_of(rhs, LookupKey, node);
+    return le->key == rk->key;
+}
+
+static struct {
+    HMap db;
+    // optional ordered index over all keys, kept in step with `db`
+    bool     use_key_index = false;
+    AVLNode *key_index = nullptr;
+} g_data;
+
+// Iterate a single HTab with a plain C-style callback
+typedef void (*htab_iter_cb)(HNode* node, void* arg);
+
+static void for_each_htab_slot(HTab *t, htab_iter_cb cb, void* arg) {
+    if (!t || !t->tab) return;
+    size_t cap = t->mask + 1;
+    for (size_t i = 0; i < cap; ++i) {
+        for (HNode *n = t->tab[i]; n; n = n->next) {
+            cb(n, arg);
+        }
+    }
+}
+
+static size_t ht_total_size(const HMap &m) {
+    return (m.newer.size) + (m.older.tab ? m.older.size : 0);
+}
+
+static bool entry_key_less(AVLNode *lhs, AVLNode *rhs) {
+    return container_of(lhs, Entry, tree)->key < container_of(rhs, Entry, tree)->key;
+}
+
+// Add a new entry to the keyspace and the key index
+static void db_insert(Entry *e) {
+    hm_insert(&g_data.db, &e->node);
+    if (g_data.use_key_index) {
+        avl_search_and_insert(&g_data.key_index, &e->tree, &entry_key_less);
+    }
+}
+// Counterpart for an entry already detached with hm_delete()
+static void db_unindex(Entry *e) {
+    if (g_data.use_key_index) {
+        g_data.key_index = avl_del(&e->tree);
+    }
+}
+
+static Entry *entry_lookup(const std::string &key) {
+    LookupKey lk;
+    lk.key = key;
+    lk.node.hcode = str_hash((const uint8_t*)lk.key.data(), lk.key.size());
+    HNode *n = hm_lookup(&g_data.db, &lk.node, &key_eq);
+    return n ? container_of(n, Entry, node) : nullptr;
+}
+static Entry *entry_create(const std::string &key, uint32_t type) {
+    Entry *e = new Entry();
+    e->key = key;
+    e->node.hcode = str_hash((const uint8_t*)e->key.data(), e->key.size());
+    entry_set_type(e, type);
+    db_insert(e);
+    return e;
+}
+
+
+// String values from this size are shared with the replies that send
+// them instead of being copied into each one.
+const size_t k_str_shared = 16 * 1024;
+
+static const std::string &entry_str(const Entry *e) {
+    return e->big ? *e->big : e->val;
+}
+// Install `v` as the string value; the old one is freed, or left to
+// replies still sending it.
+static void entry_put_str(Entry *e, std::string &v) {
+    e->val.swap(v);
+    e->big.reset();
+    if (e->val.size() >= k_str_shared) {
+        e->big = std::make_shared<std::string>(std::move(e->val));
+        e->val.clear();
+    }
+}
+
+// ------------------------ command logic ------------------------
+static void out_get(const Entry *e, Buffer &out) {
+    if (!e) return out_nil(out);
+    if (e->type != T_STR) return out_frag(out, FRAG_ERR_NOT_STR);
+    if (!e->big) return out_str(out, e->val.data(), e->val.size());
+    uint32_t n = (uint32_t)e->big->size();
+    if (out.proto == 1) {
+        tlv_put_hdr(out_grow(out, k_tlv_hdr), TAG_STR, n);
+    } else {
+        out_shrink(out, tlv2_put_hdr(out_grow(out, k_tlv2_hdr), TAG_STR, n));
+    }
+    out.refs.push_back({out.size(), e->big});
+    out.ref_bytes += e->big->size();
+}
+
+static void do_get(std::vector<std::string> &cmd, Buffer &out) {
+    if (cmd.size() != 2) { out_nil(out); return; }
+    LookupKey lk;
+    lk.key = std::move(cmd[1]);
+    lk.node.hcode = str_hash((const uint8_t*)lk.key.data(), lk.key.size());
+    HNode *n = hm_lookup(&g_data.db, &lk.node, &key_eq);
+    out_get(n ? container_of(n, Entry, node) : nullptr, out);
+}
+
+// Called from I/O threads, concurrently with the main thread
+static void do_get_concurrent(size_t reader, std::vector<std::string> &cmd, Buffer &out) {
+    LookupKey lk;
+    lk.key = std::move(cmd[1]);
+    lk.node.hcode = str_hash((const uint8_t*)lk.key.data(), lk.key.size());
+    epoch_enter(reader);
+    HNode *n = hm_lookup_concurrent(&g_data.db, &lk.node, &key_eq);
+    out_get(n ? container_of(n, Entry, node) : nullptr, out);
+    epoch_exit(reader);
+}
+static void do_set(std::vector<std::string> &cmd, Buffer &out) {
+    if (cmd.size() != 3) { out_nil(out); return; }
+
+    LookupKey lk;
+    lk.key = cmd[1];
+    lk.node.hcode = str_hash((const uint8_t*)lk.key.data(), lk.key.size());
+    if (HNode *n = hm_lookup(&g_data.db, &lk.node, &key_eq)) {
+        Entry *e = container_of(n, Entry, node);
+        if (g_rcu) {
+            // readers may be looking at `e`: publish a new Entry instead
+            Entry *ne = new Entry();
+            ne->key.swap(cmd[1]);
+            entry_put_str(ne, cmd[2]);
+            ne->node.hcode = e->node.hcode;
+            hm_replace(&g_data.db, &e->node, &ne->node);
+            if (g_data.use_key_index) avl_replace(&g_data.key_index, &e->tree, &ne->tree);
+            entry_del(e);
+        } else {
+            entry_set_type(e, T_STR);
+            entry_put_str(e, cmd[2]);
+        }
+        out_nil(out);
+        return;
+    }
+    Entry *e = new Entry();
+    e->key.swap(cmd[1]);
+    entry_put_str(e, cmd[2]);
+    e->node.hcode = str_hash((const uint8_t*)e->key.data(), e->key.size());
+    db_insert(e);
+    out_nil(out);
+}
+// Appends to `key` queued right behind the current one join the private
+// copy `v` that it is about to publish, each getting its reply, so a value
+// sent in pipelined parts is copied once per run rather than per part
+// (see append_run_open).
+static void append_run(Conn *conn, const std::string &key, std::string &v, Buffer &out) {
+    while (!conn->cmds.empty()) {
+        std::vector<std::string> &next = conn->cmds.front();
+        if (next.size() != 3 || next[0] != "append" || next[1] != key) break;
+        out_int(out, (int64_t)v.size());
+        response_end(out, conn->reply_pos);
+        response_begin(out, &conn->reply_pos);
+        v.append(next[2]);      // grows geometrically
+        conn->cmds.pop_front();
+        g_stat_cmds++;
+    }
+}
+
+// append key val: grow a string in place, so a big value can be sent
+// in parts; replies with the new length.
+static void do_append(Conn *conn, std::vector<std::string> &cmd, Buffer &out) {
+    if (cmd.size() != 3) return out_frag(out, FRAG_ERR_ARGS);
+    Entry *e = entry_lookup(cmd[1]);
+    if (!e) {
+        e = new Entry();
+        e->key.swap(cmd[1]);
+        entry_put_str(e, cmd[2]);
+        e->node.hcode = str_hash((const uint8_t*)e->key.data(), e->key.size());
+        db_insert(e);
+        return out_int(out, (int64_t)entry_str(e).size());
+    }
+    if (e->type != T_STR) return out_frag(out, FRAG_ERR_NOT_STR);
+    if (!g_rcu && e->big && e->big.use_count() == 1) {
+        e->big->append(cmd[2]);
+    } else if (!g_rcu && !e->big) {
+        e->val.append(cmd[2]);
+        if (e->val.size() >= k_str_shared) {
+            std::string v;
+            v.swap(e->val);
+            entry_put_str(e, v);
+        }
+    } else {
+        // a reply being sent, or a reader, may hold the old bytes
+        std::string v;
+        v.reserve(entry_str(e).size() + cmd[2].size());
+        v.append(entry_str(e)).append(cmd[2]);
+        append_run(conn, e->key, v, out);
+        if (g_rcu) {
+            // readers may be looking at `e`: publish a new Entry instead
+            Entry *ne = new Entry();
+            ne->key = e->key;
+            entry_put_str(ne, v);
+            ne->node.hcode = e->node.hcode;
+            hm_replace(&g_data.db, &e->node, &ne->node);
+            if (g_data.use_key_index) avl_replace(&g_data.key_index, &e->tree, &ne->tree);
+            entry_del(e);
+            e = ne;
+        } else {
+            entry_put_str(e, v);
+        }
+    }
+    out_int(out, (int64_t)entry_str(e).size());
+}
+// Take `key` out of the keyspace and the key index; the caller frees it.
+static Entry *db_remove(std::string &key) {
+    LookupKey lk;
+    lk.key = std::move(key);
+    lk.node.hcode = str_hash((const uint8_t*)lk.key.data(), lk.key.size());
+    HNode *n = hm_delete(&g_data.db, &lk.node, &key_eq);
+    if (!n) return nullptr;
+    Entry *e = container_of(n, Entry, node);
+    db_unindex(e);
+    return e;
+}
+
+static void do_del(Conn *conn, std::vector<std::string> &cmd, Buffer &out) {
+    if (cmd.size() != 2) { out_frag(out, FRAG_INT_0); return; }
+    Entry *e = db_remove(cmd[1]);
+    if (!e) { out_frag(out, FRAG_INT_0); return; }
+    out_frag(out, FRAG_INT_1);
+    if (entry_free_effort(e) < k_lazyfree_min_effort) return entry_del(e);
+    LazyFree *lf = new LazyFree();
+    lf->value = entry_detach_value(e);
+    entry_del(e);
+    conn_slice(conn, lazyfree_sliced(lf));
+}
+
+static void do_unlink(std::vector<std::string> &cmd, Buffer &out) {
+    if (cmd.size() < 2) return out_frag(out, FRAG_ERR_ARGS);
+    int64_t n = 0;
+    for (size_t i = 1; i < cmd.size(); ++i) {
+        Entry *e = db_remove(cmd[i]);
+        if (!e) continue;
+        if (entry_free_effort(e) >= k_lazyfree_min_effort) {
+            LazyFree *lf = new LazyFree();
+            lf->value = entry_detach_value(e);
+            lazyfree_submit(lf);
+        }
+        entry_del(e);
+        n++;
+    }
+    out_int(out, n);
+}
+
+static void do_flushall(Conn *conn, std::vector<std::string> &cmd, Buffer &out) {
+    bool async = cmd.size() == 2 && cmd[1] == "async";
+    if (cmd.size() > 2 || (cmd.size() == 2 && !async && cmd[1] != "sync")) {
+        return out_frag(out, FRAG_ERR_ARGS);
+    }
+    // the tables move to the job as a whole; the keyspace starts over
+    LazyFree *lf = new LazyFree();
+    hm_take(&g_data.db, &lf->db);
+    g_data.key_index = nullptr;
+    out_nil(out);
+    if (async || g_snapshots || g_rcu) {   // entries still in use can't go inline
+        lazyfree_submit(lf);
+    } else {
+        conn_slice(conn, lazyfree_sliced(lf));
+    }
+}
+struct KeyFilter {
+    Buffer            *out;
+    const GlobPattern *pat;
+    uint32_t          *n;
+};
+
+static bool scan_async(Conn *conn, uint32_t kind, const GlobPattern &pat, uint32_t topn);
+enum : uint32_t {
+    SCAN_KEYS     = 0,
+    SCAN_BIGKEYS  = 1,
+    SCAN_MEMSTATS = 2,
+};
+
+// Inline `keys` walks the table with the scan cursor and yields between
+// buckets, so other clients get in while it runs. Keys present for the
+// whole command are listed exactly once: inserts only ever grow the
+// table, and the cursor never revisits buckets that rehashing moves nodes
+// into. A `flushall` between slices swaps in a fresh, empty table; only
+// the cursor is kept, so the walk carries on over the new table and the
+// flushed keys it hadn't reached aren't listed. A big result streams out
+// as it is found.
+static Sliced keys_sliced(Conn *conn, GlobPattern pat) {
+    ReplyArr arr;
+    reply_arr_begin(conn, &arr);
+    KeyFilter kf = {&conn->outgoing, &pat, &arr.n};   // the conn outlives us
+    auto match_key_cb = [](HNode* node, void* arg) {
+        KeyFilter &f = *reinterpret_cast<KeyFilter*>(arg);
+        const std::string &k = container_of(node, Entry, node)->key;
+        if (glob_match(f.pat, k.data(), k.size())) {
+            out_str(*f.out, k.data(), k.size());
+            (*f.n)++;
+        }
+    };
+    uint64_t cursor = 0;
+    do {
+        cursor = hm_scan(&g_data.db, cursor, match_key_cb, &kf);
+        reply_arr_flush(conn, &arr);
+        co_await ReplyDrain{conn};
+        co_await slice_yield();
+    } while (cursor);
+    reply_arr_end(conn, &arr);
+}
+
+static void do_keys(Conn *conn, std::vector<std::string> &cmd, Buffer &out) {
+    if (cmd.size() > 2) return out_frag(out, FRAG_ERR_ARGS);
+    GlobPattern pat;
+    pat.match_all = true;
+    if (cmd.size() == 2) glob_compile(cmd[1].data(), cmd[1].size(), &pat);
+    if (scan_async(conn, SCAN_KEYS, pat, 0)) return;
+    assert(&out == &conn->outgoing);
+    conn_slice(conn, keys_sliced(conn, std::move(pat)));
+}
+
+struct ScanBatch {
+    const GlobPattern       *pat;
+    std::vector<const Entry*> found;
+};
+
+static void do_scan(std::vector<std::string> &cmd, Buffer &out) {
+    uint64_t cursor = 0, count = 10;
+    if (cmd.size() < 2 || !str2u64(cmd[1], cursor)) return out_err_msg(out, "ERR bad cursor");
+    GlobPattern pat;
+    pat.match_all = true;
+    for (size_t i = 2; i < cmd.size(); i += 2) {
+        if (i + 1 >= cmd.size()) return out_frag(out, FRAG_ERR_ARGS);
+        if (cmd[i] == "match") {
+            glob_compile(cmd[i + 1].data(), cmd[i + 1].size(), &pat);
+        } else if (cmd[i] == "count") {
+            if (!str2u64(cmd[i + 1], count) || count == 0) return out_err_msg(out, "ERR bad count");
+        } else {
+            return out_frag(out, FRAG_ERR_ARGS);
+        }
+    }
+
+    // like Redis, `count` is a hint: stop after enough keys or buckets
+    ScanBatch batch = {&pat, {}};
+    auto scan_cb = [](HNode* node, void* arg) {
+        ScanBatch &b = *reinterpret_cast<ScanBatch*>(arg);
+        const Entry *e = container_of(node, Entry, node);
+        if (glob_match(b.pat, e->key.data(), e->key.size())) b.found.push_back(e);
+    };
+    uint64_t budget = count * 10;
+    do {
+        cursor = hm_scan(&g_data.db, cursor, scan_cb, &batch);
+    } while (cursor && batch.found.size() < count && --budget);
+
+    out_arr(out, 2);
+    std::string next = std::to_string(cursor);
+    out_str(out, next.data(), next.size());
+    out_arr(out, (uint32_t)batch.found.size());
+    size_t bytes = 0;
+    for (const Entry *e : batch.found) bytes += out_str_hdr(out) + e->key.size();
+    uint8_t *p = out_grow(out, bytes);
+    for (const Entry *e : batch.found) {
+        const std::string &k = e->key;
+        p = out.proto == 1 ? tlv_put_str(p, k.data(), k.size()) : tlv2_put_str(p, k.data(), k.size());
+    }
+    out_shrink(out, p);
+}
+
+// ------------------- parallel keyspace scans --------------------
+// The main thread copies (Entry*, size, type) for every key, which is a
+// tight walk with no matching or formatting. The work-stealing pool then
+// processes slices of the copy while the event loop keeps serving. Each
+// finished slice is posted back; the main thread folds them into the
+// reply in order as they arrive and replies to the parked client once
+// the last one is in. `keys` output streams to the client as it is
+// folded in, and only a window of parts past the last one folded in is
+// handed to the workers, so a slow reader holds back the scan instead of
+// piling up its output.
+const size_t k_scan_async_min = 50000;      // smaller keyspaces run inline
+const size_t k_scan_slice     = 16 * 1024;  // snapshot items per part
+const size_t k_scan_window    = 2;          // parts in flight per worker
+
+struct SnapItem {
+    const Entry *e;
+    uint64_t     bytes;
+    uint32_t     type;
+};
+
+const uint32_t k_ntypes = 4;
+static const char *const k_type_names[k_ntypes] = {"str", "stream", "tseries", "vecset"};
+
+struct ScanPart {
+    size_t   lo = 0, hi = 0;
+    Buffer   out;                       // SCAN_KEYS: serialized keys
+    uint32_t nkeys = 0;
+    std::vector<SnapItem> top;          // SCAN_BIGKEYS: largest, unordered
+    uint64_t keys[k_ntypes]  = {};      // SCAN_MEMSTATS
+    uint64_t bytes[k_ntypes] = {};
+};
+
+struct ScanJob {
+    Conn       *conn = nullptr;         // nullptr once the client is gone
+    uint32_t    kind = SCAN_KEYS;
+    GlobPattern pat;
+    uint32_t    topn = 0;
+    std::vector<SnapItem> snap;
+    std::vector<ScanPart> parts;
+    // main thread: parts finish in any order and are folded in in order
+    std::vector<uint8_t>  part_done;
+    size_t   submitted = 0;     // parts [0, submitted) went to the workers
+    size_t   merged    = 0;     // parts [0, merged) are folded in
+    ReplyArr arr;               // SCAN_KEYS: the reply so far
+};
+
+static bool snap_bigger(const SnapItem &a, const SnapItem &b) {
+    return a.bytes > b.bytes;
+}
+
+// `keys` part: room for every key in the slice matching, then the ones
+// that do are written without further checks
+static void scan_part_keys(ScanJob *job, ScanPart &part) {
+    size_t max = 0;
+    size_t hdr = out_str_hdr(part.out);
+    for (size_t i = part.lo; i < part.hi; ++i) max += hdr + job->snap[i].e->key.size();
+    uint8_t *p = out_grow(part.out, max);
+    bool v1 = part.out.proto == 1;
+    for (size_t i = part.lo; i < part.hi; ++i) {
+        const std::string &k = job->snap[i].e->key;
+        if (glob_match(&job->pat, k.data(), k.size())) {
+            p = v1 ? tlv_put_str(p, k.data(), k.size()) : tlv2_put_str(p, k.data(), k.size());
+            part.nkeys++;
+        }
+    }
+    out_shrink(part.out, p);
+}
+
+// worker side: touches only the snapshot and its own part
+static void scan_part_run(ScanJob *job, ScanPart &part) {
+    if (job->kind == SCAN_KEYS) return scan_part_keys(job, part);
+    for (size_t i = part.lo; i < part.hi; ++i) {
+        const SnapItem &it = job->snap[i];
+        switch (job->kind) {
+        case SCAN_BIGKEYS:
+            part.top.push_back(it);
+            if (part.top.size() >= 2 * (size_t)job->topn) {
+                std::nth_element(part.top.begin(), part.top.begin() + job->topn,
+                                 part.top.end(), &snap_bigger);
+                part.top.resize(job->topn);
+            }
+            break;
+        case SCAN_MEMSTATS:
+            part.keys[it.type]++;
+            part.bytes[it.type] += it.bytes;
+            break;
+        }
+    }
+}
+
+// main thread: fold finished parts, in order, into the reply so their
+// buffers go away as soon as the parts before them are done
+static void scan_assemble(ScanJob *job) {
+    Conn *c = job->conn;
+    while (job->merged < job->parts.size() && job->part_done[job->merged]) {
+        if (c && c->out_wait) break;    // until handle_write() drains it
+        ScanPart &part = job->parts[job->merged++];
+        if (job->kind != SCAN_KEYS) continue;
+        if (c) {
+            buf_append(c->outgoing, part.out.data(), part.out.size());
+            job->arr.n += part.nkeys;
+            reply_arr_flush(c, &job->arr);
+            c->out_wait = c->outgoing.size() >= k_reply_high;
+        }
+        Buffer().swap(part.out);
+    }
+}
+
+// main thread: the rest of the reply once every part is in
+static void scan_merge(ScanJob *job, Buffer &out) {
+    assert(job->merged == job->parts.size());
+    if (job->kind == SCAN_BIGKEYS) {
+        std::vector<SnapItem> top;
+        for (ScanPart &part : job->parts) top.insert(top.end(), part.top.begin(), part.top.end());
+        size_t n = std::min(top.size(), (size_t)job->topn);
+        std::partial_sort(top.begin(), top.begin() + n, top.end(), &snap_bigger);
+        out_arr(out, (uint32_t)n);
+        for (size_t i = 0; i < n; ++i) {
+            out_arr(out, 3);
+            out_str(out, top[i].e->key.data(), top[i].e->key.size());
+            out_int(out, top[i].type);
+            out_int(out, (int64_t)top[i].bytes);
+        }
+    } else {
+        out_arr(out, 4 * k_ntypes + 2);
+        for (uint32_t t = 0; t < k_ntypes; ++t) {
+            uint64_t keys = 0, bytes = 0;
+            for (ScanPart &part : job->parts) {
+                keys  += part.keys[t];
+                bytes += part.bytes[t];
+            }
+            std::string name = k_type_names[t];
+            out_str(out, (name + ".keys").data(), name.size() + 5);
+            out_int(out, (int64_t)keys);
+            out_str(out, (name + ".bytes").data(), name.size() + 6);
+            out_int(out, (int64_t)bytes);
+        }
+        out_str(out, "lazyfree.pending", 16);
+        out_int(out, (int64_t)g_lazyfree_pending.load());
+    }
+}
+
+static void conn_process(Conn *conn);
+static void conn_unblock(Conn *conn);
+
+static void scan_finish(ScanJob *job) {
+    if (Conn *c = job->conn) {
+        if (job->kind == SCAN_KEYS) {
+            reply_arr_end(c, &job->arr);
+        } else {
+            scan_merge(job, c->outgoing);
+        }
+        reply_end(c);
+        c->job = nullptr;
+        producing_remove(c);
+        conn_unblock(c);
+        conn_process(c);    // resume pipelined requests
+    }
+    snapshot_release();
+    delete job;
+}
+
+// main thread: fold in what is done, keep the workers' window full, and
+// finish once every part is in. Never writes to the socket itself, so
+// handle_write() can't run the job over from under a caller.
+static void scan_pump(ScanJob *job) {
+    scan_assemble(job);
+    if (job->merged == job->parts.size()) return scan_finish(job);
+    if (Conn *c = job->conn) {
+        c->want_write = conn_can_send(c);
+    }
+    size_t limit = std::min(job->parts.size(),
+                            job->merged + k_scan_window * sched_workers());
+    for (; job->submitted < limit; job->submitted++) {
+        size_t i = job->submitted;
+        sched_submit([job, i]() {
+            scan_part_run(job, job->parts[i]);
+            main_post([job, i]() {
+                job->part_done[i] = 1;
+                scan_pump(job);
+            });
+        });
+    }
+}
+
+// Run the scan on the workers and park `conn`. Returns false if the
+// keyspace is small enough to answer inline.
+static bool scan_async(Conn *conn, uint32_t kind, const GlobPattern &pat, uint32_t topn) {
+    size_t nkeys = ht_total_size(g_data.db);
+    if (!sched_workers() || nkeys < k_scan_async_min) return false;
+    // a plain `keys` is pure output; nothing to spread over workers
+    if (kind == SCAN_KEYS && pat.match_all) return false;
+
+    ScanJob *job = new ScanJob();
+    job->conn = conn;
+    job->kind = kind;
+    job->pat  = pat;
+    job->topn = topn;
+    job->snap.reserve(nkeys);
+    auto snap_cb = [](HNode *node, void *arg) {
+        auto &snap = *reinterpret_cast<std::vector<SnapItem>*>(arg);
+        const Entry *e = container_of(node, Entry, node);
+        snap.push_back({e, entry_mem(e), e->type});
+    };
+    for_each_htab_slot(&g_data.db.newer, snap_cb, &job->snap);
+    for_each_htab_slot(&g_data.db.older, snap_cb, &job->snap);
+    g_snapshots++;
+
+    size_t nparts = (job->snap.size() + k_scan_slice - 1) / k_scan_slice;
+    job->parts.resize(nparts);
+    job->part_done.resize(nparts, 0);
+    for (size_t i = 0; i < nparts; ++i) {
+        job->parts[i].lo = i * k_scan_slice;
+        job->parts[i].hi = std::min(job->parts[i].lo + k_scan_slice, job->snap.size());
+        job->parts[i].out.proto = conn->outgoing.proto;
+    }
+    if (kind == SCAN_KEYS) reply_arr_begin(conn, &job->arr);
+
+    conn->blocked = true;   // not in g_blocked: only scan_finish() wakes it
+    conn->job = job;
+    scan_pump(job);
+    return true;
+}
+
+// Inline version of a scan for small keyspaces or no workers
+static void scan_inline(uint32_t kind, uint32_t topn, Buffer &out) {
+    ScanJob job;
+    job.kind = kind;
+    job.topn = topn;
+    auto snap_cb = [](HNode *node, void *arg) {
+        auto &snap = *reinterpret_cast<std::vector<SnapItem>*>(arg);
+        const Entry *e = container_of(node, Entry, node);
+        snap.push_back({e, entry_mem(e), e->type});
+    };
+    for_each_htab_slot(&g_data.db.newer, snap_cb, &job.snap);
+    for_each_htab_slot(&g_data.db.older, snap_cb, &job.snap);
+    job.parts.resize(1);
+    job.parts[0].hi = job.snap.size();
+    scan_part_run(&job, job.parts[0]);
+    job.merged = 1;
+    scan_merge(&job, out);
+}
+
+static void do_dbsize(std::vector<std::string> &cmd, Buffer &out) {
+    if (cmd.size() != 1) return out_frag(out, FRAG_ERR_ARGS);
+    out_int(out, (int64_t)ht_total_size(g_data.db));
+}
+
+static void do_bigkeys(Conn *conn, std::vector<std::string> &cmd, Buffer &out) {
+    uint64_t topn = 10;
+    if (cmd.size() > 2 || (cmd.size() == 2 && (!str2u64(cmd[1], topn) || topn > k_max_args))) {
+        return out_frag(out, FRAG_ERR_ARGS);
+    }
+    if (topn == 0) return out_arr(out, 0);
+    if (scan_async(conn, SCAN_BIGKEYS, GlobPattern(), (uint32_t)topn)) return;
+    scan_inline(SCAN_BIGKEYS, (uint32_t)topn, out);
+}
+
+static void do_memstats(Conn *conn, std::vector<std::string> &cmd, Buffer &out) {
+    if (cmd.size() != 1) return out_frag(out, FRAG_ERR_ARGS);
+    if (scan_async(conn, SCAN_MEMSTATS, GlobPattern(), 0)) return;
+    scan_inline(SCAN_MEMSTATS, 0, out);
+}
+
+// ---------------------- ordered key index ----------------------
+// first entry whose key is >= `key`
+static Entry *key_index_seekge(const std::string &key) {
+    AVLNode *found = nullptr;
+    for (AVLNode *cur = g_data.key_index; cur;) {
+        if (container_of(cur, Entry, tree)->key < key) {
+            cur = cur->right;
+        } else {
+            found = cur;
+            cur = cur->left;
+        }
+    }
+    return found ? container_of(found, Entry, tree) : nullptr;
+}
+
+static Entry *key_index_next(Entry *e) {
+    AVLNode *next = avl_next(&e->tree);
+    return next ? container_of(next, Entry, tree) : nullptr;
+}
+
+static void do_scanprefix(std::vector<std::string> &cmd, Buffer &out) {
+    if (!g_data.use_key_index) return out_err_msg(out, "ERR key index disabled");
+    uint64_t count = 0;
+    if (cmd.size() != 3 || !str2u64(cmd[2], count)) return out_frag(out, FRAG_ERR_ARGS);
+    const std::string &prefix = cmd[1];
+
+    size_t arr_pos = out_arr_begin(out);
+    uint32_t n = 0;
+    for (Entry *e = key_index_seekge(prefix); e && n < count; e = key_index_next(e)) {
+        if (e->key.compare(0, prefix.size(), prefix) != 0) break;
+        out_str(out, e->key.data(), e->key.size());
+        n++;
+    }
+    out_arr_end(out, arr_pos, n);
+}
+
+static void do_keyrange(std::vector<std::string> &cmd, Buffer &out) {
+    if (!g_data.use_key_index) return out_err_msg(out, "ERR key index disabled");
+    uint64_t count = UINT64_MAX;
+    if (cmd.size() == 4) {
+        if (!str2u64(cmd[3], count)) return out_err_msg(out, "ERR bad count");
+    } else if (cmd.size() != 3) {
+        return out_frag(out, FRAG_ERR_ARGS);
+    }
+    const std::string &to = cmd[2];
+
+    size_t arr_pos = out_arr_begin(out);
+    uint32_t n = 0;
+    for (Entry *e = key_index_seekge(cmd[1]); e && n < count; e = key_index_next(e)) {
+        if (to < e->key) break;
+        out_str(out, e->key.data(), e->key.size());
+        n++;
+    }
+    out_arr_end(out, arr_pos, n);
+}
+
+static void do_keyindex(std::vector<std::string> &cmd, Buffer &out) {
+    if (cmd.size() != 1) return out_frag(out, FRAG_ERR_ARGS);
+    int64_t keys = (int64_t)avl_cnt(g_data.key_index);
+    out_arr(out, 6);
+    out_str(out, "enabled", 7);
+    out_int(out, g_data.use_key_index ? 1 : 0);
+    out_str(out, "keys", 4);
+    out_int(out, keys);
+    out_str(out, "bytes", 5);   // tree links carried by every Entry
+    out_int(out, keys * (int64_t)sizeof(AVLNode));
+}
+
+// ----------------------- stream commands -----------------------
+// "-" / "+" or an ID; a bare ms covers the whole millisecond
+static bool parse_range_id(const std::string &s, bool is_end, StreamID &id) {
+    if (s == "-") { id = StreamID(); return true; }
+    if (s == "+") { id.ms = id.seq = UINT64_MAX; return true; }
+    return streamid_parse(s.data(), s.size(), is_end ? UINT64_MAX : 0, id);
+}
+
+// smallest ID strictly greater than `id`
+static bool streamid_incr(StreamID &id) {
+    if (id.seq != UINT64_MAX) { id.seq++; return true; }
+    if (id.ms  != UINT64_MAX) { id.ms++; id.seq = 0; return true; }
+    return false;
+}
+
+static void out_stream_entry(Buffer &out, const StreamEntry &ent) {
+    out_arr(out, 2);
+    std::string id = streamid_fmt(ent.id);
+    out_str(out, id.data(), id.size());
+    out_arr(out, ent.nstr);
+    const uint8_t *p = ent.strs;
+    for (uint32_t i = 0; i < ent.nstr; ++i) {
+        const char *str = nullptr;
+        size_t len = 0;
+        streamentry_str(p, &str, &len);
+        out_str(out, str, len);
+    }
+}
+
+// Entries in [start, end], at most `count`
+static void out_stream_range(Buffer &out, Stream *s,
+                             const StreamID &start, const StreamID &end, uint64_t count) {
+    size_t arr_pos = out_arr_begin(out);
+    uint32_t n = 0;
+    StreamIter it;
+    StreamEntry ent;
+    stream_seek(s, start, &it);
+    while (n < count && stream_next(&it, &ent) && streamid_cmp(ent.id, end) <= 0) {
+        out_stream_entry(out, ent);
+        n++;
+    }
+    out_arr_end(out, arr_pos, n);
+}
+
+static void do_xadd(std::vector<std::string> &cmd, Buffer &out) {
+    size_t idx = 2;
+    uint64_t maxlen = UINT64_MAX;
+    if (cmd.size() > idx + 1 && cmd[idx] == "maxlen") {
+        if (!str2u64(cmd[idx + 1], maxlen)) return out_err_msg(out, "ERR bad maxlen");
+        idx += 2;
+    }
+    size_t nstr = cmd.size() > idx + 1 ? cmd.size() - idx - 1 : 0;
+    if (nstr == 0 || nstr % 2) return out_frag(out, FRAG_ERR_ARGS);
+
+    Entry *e = entry_lookup(cmd[1]);
+    if (e && e->type != T_STREAM) return out_frag(out, FRAG_ERR_NOT_STREAM);
+    StreamID last = e ? e->stream->last_id : StreamID();
+
+    StreamID id;
+    if (cmd[idx] == "*") {
+        id.ms = get_realtime_msec();
+        if (id.ms <= last.ms) {
+            id = last;
+            if (!streamid_incr(id)) return out_err_msg(out, "ERR stream id exhausted");
+        }
+    } else if (!streamid_parse(cmd[idx].data(), cmd[idx].size(), 0, id)) {
+        return out_err_msg(out, "ERR bad stream id");
+    }
+    if (streamid_cmp(id, last) <= 0) {
+        return out_err_msg(out, "ERR stream id not greater than last");
+    }
+
+    if (!e) e = entry_create(cmd[1], T_STREAM);
+    std::vector<std::string> strs(std::make_move_iterator(cmd.begin() + idx + 1),
+                                  std::make_move_iterator(cmd.end()));
+    stream_append(e->stream, id, strs);
+    if (maxlen != UINT64_MAX) stream_trim_maxlen(e->stream, maxlen);
+    g_ready_keys.push_back(cmd[1]);
+
+    std::string ids = streamid_fmt(id);
+    out_str(out, ids.data(), ids.size());
+}
+
+static void do_xlen(std::vector<std::string> &cmd, Buffer &out) {
+    if (cmd.size() != 2) return out_frag(out, FRAG_ERR_ARGS);
+    Entry *e = entry_lookup(cmd[1]);
+    if (e && e->type != T_STREAM) return out_frag(out, FRAG_ERR_NOT_STREAM);
+    out_int(out, e ? (int64_t)e->stream->length : 0);
+}
+
+// Items a sliced range command adds per step, between checks of how
+// much the client has yet to read
+const size_t k_range_page = 256;
+
+// `xrange` streams out like `keys`, a page of entries per step. The key
+// is looked up again for each page, as the stream may have changed or
+// gone while the command waited; entries come in ID order, each once.
+static Sliced xrange_sliced(Conn *conn, std::string key,
+                            StreamID start, StreamID end, uint64_t count) {
+    ReplyArr arr;
+    reply_arr_begin(conn, &arr);
+    while (count) {
+        Entry *e = entry_lookup(key);
+        if (!e || e->type != T_STREAM) break;
+        size_t page = (size_t)std::min<uint64_t>(count, k_range_page);
+        size_t n = 0;
+        StreamIter it;
+        StreamEntry ent;
+        stream_seek(e->stream, start, &it);
+        while (n < page && stream_next(&it, &ent) && streamid_cmp(ent.id, end) <= 0) {
+            out_stream_entry(conn->outgoing, ent);
+            n++;
+        }
+        arr.n += (uint32_t)n;
+        count -= n;
+        if (n < page) break;
+        start = ent.id;
+        if (!streamid_incr(start)) break;
+        reply_arr_flush(conn, &arr);
+        co_await ReplyDrain{conn};
+        co_await slice_yield();
+    }
+    reply_arr_end(conn, &arr);
+}
+
+static void do_xrange(Conn *conn, std::vector<std::string> &cmd, Buffer &out) {
+    uint64_t count = UINT64_MAX;
+    if (cmd.size() == 6 && cmd[4] == "count") {
+        if (!str2u64(cmd[5], count)) return out_err_msg(out, "ERR bad count");
+    } else if (cmd.size() != 4) {
+        return out_frag(out, FRAG_ERR_ARGS);
+    }
+    StreamID start, end;
+    if (!parse_range_id(cmd[2], false, start) || !parse_range_id(cmd[3], true, end)) {
+        return out_err_msg(out, "ERR bad stream id");
+    }
+    Entry *e = entry_lookup(cmd[1]);
+    if (e && e->type != T_STREAM) return out_frag(out, FRAG_ERR_NOT_STREAM);
+    if (!e) return out_arr(out, 0);
+    assert(&out == &conn->outgoing);
+    conn_slice(conn, xrange_sliced(conn, cmd[1], start, end, count));
+}
+
+static void do_xtrim(std::vector<std::string> &cmd, Buffer &out) {
+    if (cmd.size() != 4) return out_frag(out, FRAG_ERR_ARGS);
+    Entry *e = entry_lookup(cmd[1]);
+    if (e && e->type != T_STREAM) return out_frag(out, FRAG_ERR_NOT_STREAM);
+    size_t removed = 0;
+    if (cmd[2] == "maxlen") {
+        uint64_t maxlen = 0;
+        if (!str2u64(cmd[3], maxlen)) return out_err_msg(out, "ERR bad maxlen");
+        if (e) removed = stream_trim_maxlen(e->stream, maxlen);
+    } else if (cmd[2] == "minid") {
+        StreamID minid;
+        if (!streamid_parse(cmd[3].data(), cmd[3].size(), 0, minid)) {
+            return out_err_msg(out, "ERR bad stream id");
+        }
+        if (e) removed = stream_trim_minid(e->stream, minid);
+    } else {
+        return out_frag(out, FRAG_ERR_ARGS);
+    }
+    out_int(out, (int64_t)removed);
+}
+
+struct XReadArgs {
+    uint64_t count    = UINT64_MAX;
+    bool     block    = false;
+    uint64_t block_ms = 0;
+    std::vector<std::string> keys;
+    std::vector<StreamID>    ids;   // exclusive lower bounds, `$` resolved
+};
+
+static const char *xread_parse(const std::vector<std::string> &cmd, XReadArgs &args) {
+    size_t idx = 1;
+    while (idx + 1 < cmd.size() && cmd[idx] != "streams") {
+        if (cmd[idx] == "count") {
+            if (!str2u64(cmd[idx + 1], args.count)) return "ERR bad count";
+        } else if (cmd[idx] == "block") {
+            if (!str2u64(cmd[idx + 1], args.block_ms)) return "ERR bad timeout";
+            args.block = true;
+        } else {
+            return "ERR bad args";
+        }
+        idx += 2;
+    }
+    if (idx >= cmd.size() || cmd[idx] != "streams") return "ERR bad args";
+    size_t nrest = cmd.size() - idx - 1;
+    if (nrest == 0 || nrest % 2) return "ERR bad args";
+
+    size_t nkeys = nrest / 2;
+    for (size_t i = 0; i < nkeys; ++i) {
+        const std::string &key = cmd[idx + 1 + i];
+        const std::string &ids = cmd[idx + 1 + nkeys + i];
+        Entry *e = entry_lookup(key);
+        if (e && e->type != T_STREAM) return "ERR not a stream";
+        StreamID id;
+        if (ids == "$") {
+            if (e) id = e->stream->last_id;
+        } else if (!streamid_parse(ids.data(), ids.size(), 0, id)) {
+            return "ERR bad stream id";
+        }
+        args.keys.push_back(key);
+        args.ids.push_back(id);
+    }
+    return nullptr;
+}
+
+// Writes nothing and returns false if no stream has entries past its ID.
+static bool xread_emit(const XReadArgs &args, Buffer &out) {
+    std::vector<Stream*> ready(args.keys.size(), nullptr);
+    uint32_t nready = 0;
+    for (size_t i = 0; i < args.keys.size(); ++i) {
+        Entry *e = entry_lookup(args.keys[i]);
+        if (e && e->type == T_STREAM
+              && streamid_cmp(e->stream->last_id, args.ids[i]) > 0) {
+            ready[i] = e->stream;
+            nready++;
+        }
+    }
+    if (!nready) return false;
+
+    out_arr(out, nready);
+    for (size_t i = 0; i < args.keys.size(); ++i) {
+        if (!ready[i]) continue;
+        StreamID start = args.ids[i];
+        streamid_incr(start);
+        StreamID end;
+        end.ms = end.seq = UINT64_MAX;
+        out_arr(out, 2);
+        out_str(out, args.keys[i].data(), args.keys[i].size());
+        out_stream_range(out, ready[i], start, end, args.count);
+    }
+    return true;
+}
+
+static void do_xread(Conn *conn, std::vector<std::string> &cmd, Buffer &out) {
+    XReadArgs args;
+    if (const char *err = xread_parse(cmd, args)) return out_err_msg(out, err);
+    if (xread_emit(args, out)) return;
+    if (!args.block) return out_nil(out);
+
+    // park the connection; the request is re-run on a write to any key
+    conn->blocked = true;
+    conn->block_deadline_ms = args.block_ms ? get_monotonic_msec() + args.block_ms : 0;
+    if (conn->block_deadline_ms) {
+        conn->block_timer.fn = block_timer_fired;
+        tw_add(&g_timers, &conn->block_timer, conn->block_deadline_ms);
+    }
+    conn->block_keys = args.keys;
+    conn->block_cmd = {"xread"};
+    if (args.count != UINT64_MAX) {
+        conn->block_cmd.push_back("count");
+        conn->block_cmd.push_back(std::to_string(args.count));
+    }
+    conn->block_cmd.push_back("streams");
+    conn->block_cmd.insert(conn->block_cmd.end(), args.keys.begin(), args.keys.end());
+    for (const StreamID &id : args.ids) conn->block_cmd.push_back(streamid_fmt(id));
+    g_blocked.push_back(conn);
+}
+
+// Re-run a parked command. Returns false if it would still block.
+static bool blocked_retry(Conn *conn, Buffer &out) {
+    XReadArgs args;
+    if (const char *err = xread_parse(conn->block_cmd, args)) {
+        out_err_msg(out, err);
+        return true;
+    }
+    return xread_emit(args, out);
+}
+
+// --------------------- time series commands --------------------
+static bool parse_ts_bound(const std::string &s, int64_t &t) {
+    if (s == "-") { t = INT64_MIN; return true; }
+    if (s == "+") { t = INT64_MAX; return true; }
+    return str2i64(s, t);
+}
+
+// "agg <avg|min|max|sum|count> <bucket_ms>" at cmd[idx]; advances idx
+static const char *parse_ts_agg(const std::vector<std::string> &cmd, size_t &idx,
+                                TSAgg &agg, int64_t &bucket) {
+    agg = TS_AGG_NONE;
+    bucket = 0;
+    if (idx >= cmd.size() || cmd[idx] != "agg") return nullptr;
+    if (idx + 3 > cmd.size()) return "ERR bad args";
+    const std::string &name = cmd[idx + 1];
+    if      (name == "avg")   agg = TS_AGG_AVG;
+    else if (name == "min")   agg = TS_AGG_MIN;
+    else if (name == "max")   agg = TS_AGG_MAX;
+    else if (name == "sum")   agg = TS_AGG_SUM;
+    else if (name == "count") agg = TS_AGG_COUNT;
+    else return "ERR bad aggregation";
+    if (!str2i64(cmd[idx + 2], bucket) || bucket <= 0) return "ERR bad bucket";
+    idx += 3;
+    return nullptr;
+}
+
+static void out_ts_sample(Buffer &out, const TSSample &smp) {
+    out_arr(out, 2);
+    out_int(out, smp.ts);
+    out_dbl(out, smp.val);
+}
+static void out_ts_samples(Buffer &out, const std::vector<TSSample> &samples) {
+    out_arr(out, (uint32_t)samples.size());
+    for (const TSSample &smp : samples) out_ts_sample(out, smp);
+}
+
+static void do_ts_add(std::vector<std::string> &cmd, Buffer &out) {
+    if (cmd.size() != 4) return out_frag(out, FRAG_ERR_ARGS);
+    int64_t t = 0;
+    if (cmd[2] == "*") {
+        t = (int64_t)get_realtime_msec();
+    } else if (!str2i64(cmd[2], t)) {
+        return out_err_msg(out, "ERR bad timestamp");
+    }
+    double val = 0;
+    if (!str2dbl(cmd[3], val)) return out_err_msg(out, "ERR bad value");
+
+    Entry *e = entry_lookup(cmd[1]);
+    if (e && e->type != T_TSERIES) return out_frag(out, FRAG_ERR_NOT_TS);
+    if (e && e->ts->count && t <= e->ts->last_ts) {
+        return out_err_msg(out, "ERR timestamp not greater than last");
+    }
+    if (!e) e = entry_create(cmd[1], T_TSERIES);
+    ts_add(e->ts, t, val);
+    out_int(out, t);
+}
+
+// `ts.range` pages through the series the same way as xrange_sliced()
+static Sliced ts_range_sliced(Conn *conn, std::string key, int64_t from, int64_t to,
+                              TSAgg agg, int64_t bucket) {
+    ReplyArr arr;
+    reply_arr_begin(conn, &arr);
+    std::vector<TSSample> samples;
+    for (;;) {
+        Entry *e = entry_lookup(key);
+        if (!e || e->type != T_TSERIES) break;
+        samples.clear();
+        bool more = ts_range(e->ts, from, to, agg, bucket, samples, k_range_page, &from);
+        for (const TSSample &smp : samples) out_ts_sample(conn->outgoing, smp);
+        arr.n += (uint32_t)samples.size();
+        if (!more) break;
+        reply_arr_flush(conn, &arr);
+        co_await ReplyDrain{conn};
+        co_await slice_yield();
+    }
+    reply_arr_end(conn, &arr);
+}
+
+static void do_ts_range(Conn *conn, std::vector<std::string> &cmd, Buffer &out) {
+    if (cmd.size() < 4) return out_frag(out, FRAG_ERR_ARGS);
+    int64_t from = 0, to = 0;
+    if (!parse_ts_bound(cmd[2], from) || !parse_ts_bound(cmd[3], to)) {
+        return out_err_msg(out, "ERR bad timestamp");
+    }
+    size_t idx = 4;
+    TSAgg agg;
+    int64_t bucket;
+    if (const char *err = parse_ts_agg(cmd, idx, agg, bucket)) return out_err_msg(out, err);
+    if (idx != cmd.size()) return out_frag(out, FRAG_ERR_ARGS);
+
+    Entry *e = entry_lookup(cmd[1]);
+    if (e && e->type != T_TSERIES) return out_frag(out, FRAG_ERR_NOT_TS);
+    if (!e) return out_arr(out, 0);
+    assert(&out == &conn->outgoing);
+    conn_slice(conn, ts_range_sliced(conn, cmd[1], from, to, agg, bucket));
+}
+
+static void do_ts_mrange(std::vector<std::string> &cmd, Buffer &out) {
+    if (cmd.size() < 4) return out_frag(out, FRAG_ERR_ARGS);
+    int64_t from = 0, to = 0;
+    if (!parse_ts_bound(cmd[1], from) || !parse_ts_bound(cmd[2], to)) {
+        return out_err_msg(out, "ERR bad timestamp");
+    }
+    size_t idx = 3;
+    TSAgg agg;
+    int64_t bucket;
+    if (const char *err = parse_ts_agg(cmd, idx, agg, bucket)) return out_err_msg(out, err);
+    if (idx >= cmd.size()) return out_frag(out, FRAG_ERR_ARGS);
+
+    // missing keys and other types are skipped
+    std::vector<Entry*> series;
+    for (size_t i = idx; i < cmd.size(); ++i) {
+        Entry *e = entry_lookup(cmd[i]);
+        if (e && e->type == T_TSERIES) series.push_back(e);
+    }
+    out_arr(out, (uint32_t)series.size());
+    std::vector<TSSample> samples;
+    for (Entry *e : series) {
+        samples.clear();
+        ts_range(e->ts, from, to, agg, bucket, samples);
+        out_arr(out, 2);
+        out_str(out, e->key.data(), e->key.size());
+        out_ts_samples(out, samples);
+    }
+}
+
+static void do_ts_info(std::vector<std::string> &cmd, Buffer &out) {
+    if (cmd.size() != 2) return out_frag(out, FRAG_ERR_ARGS);
+    Entry *e = entry_lookup(cmd[1]);
+    if (!e) return out_nil(out);
+    if (e->type != T_TSERIES) return out_frag(out, FRAG_ERR_NOT_TS);
+    out_arr(out, 6);
+    out_str(out, "samples", 7);
+    out_int(out, (int64_t)e->ts->count);
+    out_str(out, "chunks", 6);
+    out_int(out, (int64_t)e->ts->chunks.size());
+    out_str(out, "bytes", 5);
+    out_int(out, (int64_t)ts_bytes(e->ts));
+}
+
+// ----------------------- vector commands -----------------------
+static bool parse_floats(const std::vector<std::string> &cmd, size_t idx,
+                         std::vector<float> &out) {
+    out.clear();
+    for (size_t i = idx; i < cmd.size(); ++i) {
+        char *endp = nullptr;
+        float f = strtof(cmd[i].c_str(), &endp);
+        if (cmd[i].empty() || endp != cmd[i].c_str() + cmd[i].size() || f != f) return false;
+        out.push_back(f);
+    }
+    return !out.empty();
+}
+
+static void do_vadd(std::vector<std::string> &cmd, Buffer &out) {
+    if (cmd.size() < 4) return out_frag(out, FRAG_ERR_ARGS);
+    std::vector<float> vec;
+    if (!parse_floats(cmd, 3, vec)) return out_err_msg(out, "ERR bad vector");
+    Entry *e = entry_lookup(cmd[1]);
+    if (e && e->type != T_VECSET) return out_frag(out, FRAG_ERR_NOT_VSET);
+    if (e && e->vs->dim != vec.size()) return out_err_msg(out, "ERR dimension mismatch");
+    if (!e) {
+        e = entry_create(cmd[1], T_VECSET);
+        vecset_init(e->vs, (uint32_t)vec.size());
+    }
+    bool added = vecset_add(e->vs, cmd[2].data(), cmd[2].size(), vec.data());
+    out_int(out, added ? 1 : 0);
+}
+
+static void do_vrem(std::vector<std::string> &cmd, Buffer &out) {
+    if (cmd.size() != 3) return out_frag(out, FRAG_ERR_ARGS);
+    Entry *e = entry_lookup(cmd[1]);
+    if (e && e->type != T_VECSET) return out_frag(out, FRAG_ERR_NOT_VSET);
+    bool removed = e && vecset_remove(e->vs, cmd[2].data(), cmd[2].size());
+    out_int(out, removed ? 1 : 0);
+}
+
+static void do_vcard(std::vector<std::string> &cmd, Buffer &out) {
+    if (cmd.size() != 2) return out_frag(out, FRAG_ERR_ARGS);
+    Entry *e = entry_lookup(cmd[1]);
+    if (e && e->type != T_VECSET) return out_frag(out, FRAG_ERR_NOT_VSET);
+    out_int(out, e ? (int64_t)e->vs->n : 0);
+}
+
+static void do_vsim(std::vector<std::string> &cmd, Buffer &out) {
+    if (cmd.size() < 4) return out_frag(out, FRAG_ERR_ARGS);
+    uint64_t k = 0;
+    if (!str2u64(cmd[2], k) || k > k_max_args) return out_err_msg(out, "ERR bad k");
+    VecMetric metric = VEC_L2;
+    uint64_t nprobe = 1;
+    size_t idx = 3;
+    while (idx + 1 < cmd.size()) {
+        if (cmd[idx] == "metric") {
+            if      (cmd[idx + 1] == "l2") metric = VEC_L2;
+            else if (cmd[idx + 1] == "ip") metric = VEC_IP;
+            else return out_err_msg(out, "ERR bad metric");
+        } else if (cmd[idx] == "nprobe") {
+            if (!str2u64(cmd[idx + 1], nprobe) || nprobe > UINT32_MAX) {
+                return out_err_msg(out, "ERR bad nprobe");
+            }
+        } else {
+            break;
+        }
+        idx += 2;
+    }
+    std::vector<float> query;
+    if (!parse_floats(cmd, idx, query)) return out_err_msg(out, "ERR bad vector");
+
+    Entry *e = entry_lookup(cmd[1]);
+    if (e && e->type != T_VECSET) return out_frag(out, FRAG_ERR_NOT_VSET);
+    if (!e) return out_arr(out, 0);
+    if (e->vs->dim != query.size()) return out_err_msg(out, "ERR dimension mismatch");
+
+    std::vector<VecHit> hits;
+    vecset_search(e->vs, query.data(), (uint32_t)k, metric, (uint32_t)nprobe, hits);
+    out_arr(out, (uint32_t)hits.size());
+    for (const VecHit &h : hits) {
+        const VecItem *item = e->vs->items[h.row];
+        out_arr(out, 2);
+        out_str(out, item->id, item->len);
+        out_dbl(out, h.score);
+    }
+}
+
+static void do_vindex(std::vector<std::string> &cmd, Buffer &out) {
+    if (cmd.size() != 3 && cmd.size() != 4) return out_frag(out, FRAG_ERR_ARGS);
+    uint64_t nlist = 0, iters = 10;
+    if (!str2u64(cmd[2], nlist) || nlist > (1u << 20)) return out_err_msg(out, "ERR bad nlist");
+    if (cmd.size() == 4 && (!str2u64(cmd[3], iters) || iters > 1000)) {
+        return out_err_msg(out, "ERR bad iters");
+    }
+    Entry *e = entry_lookup(cmd[1]);
+    if (!e) return out_frag(out, FRAG_INT_0);
+    if (e->type != T_VECSET) return out_frag(out, FRAG_ERR_NOT_VSET);
+    if (nlist == 0) {
+        vecset_drop_index(e->vs);
+        return out_frag(out, FRAG_INT_0);
+    }
+
+    VecBuild *b = vecset_build_begin(e->vs, (uint32_t)nlist, (uint32_t)iters);
+    if (!b) return out_frag(out, FRAG_INT_0);     // already building
+    // k-means runs on a private snapshot; the result is installed on the
+    // main thread if the same set is still there
+    std::string key = cmd[1];
+    std::thread([b, key]() {
+        vecbuild_run(b);
+        main_post([b, key]() {
+            Entry *e = entry_lookup(key);
+            if (e && e->type == T_VECSET && e->vs->build_id == b->id) {
+                vecset_build_finish(e->vs, b);
+            }
+            vecbuild_free(b);
+        });
+    }).detach();
+    out_frag(out, FRAG_INT_1);
+}
+
+// shm: move this conn onto the shared-memory link in the memfd passed
+// with the request (see shmring.h). Unix-socket clients only, and not
+// with --io-threads.
+static void do_shm(Conn *conn, std::vector<std::string> &cmd, Buffer &out) {
+    if (cmd.size() != 1) return out_frag(out, FRAG_ERR_ARGS);
+    if (conn->io) return out_err_msg(out, "ERR shm needs --io-threads 0");
+    if (conn->shm) return out_err_msg(out, "ERR already on shm");
+    if (!conn->is_unix) return out_err_msg(out, "ERR shm is for unix-socket clients");
+    if (conn->passed_fd < 0) return out_err_msg(out, "ERR no link fd passed");
+    ShmLink link;
+    int rv = shm_attach(conn->passed_fd, &link);
+    (void)close(conn->passed_fd);
+    conn->passed_fd = -1;
+    if (rv) return out_err_msg(out, "ERR cannot map link");
+    conn->shm = new ShmLink(link);
+    g_shm.push_back(conn);
+    out_nil(out);
+}
+
+// conn_parse() has switched the request format already; the replies
+// switch after this one (see conn_exec)
+static void do_hello(Conn *conn, std::vector<std::string> &cmd, Buffer &out) {
+    uint8_t ver = hello_version(cmd);
+    if (!ver) return out_frag(out, FRAG_ERR_ARGS);
+    conn->proto_next = ver;
+    out_int(out, ver);
+}
+
+static void do_info(std::vector<std::string> &cmd, Buffer &out);
+
+static void do_request(Conn *conn, std::vector<std::string> &cmd, Buffer &out) {
+    if (cmd.empty()) { out_nil(out); return; }
+    const std::string &op = cmd[0];
+    if      (op == "get")  return do_get(cmd, out);
+    else if (op == "set")  return do_set(cmd, out);
+    else if (op == "append") return do_append(conn, cmd, out);
+    else if (op == "del")  return do_del(conn, cmd, out);
+    else if (op == "unlink")   return do_unlink(cmd, out);
+    else if (op == "flushall") return do_flushall(conn, cmd, out);
+    else if (op == "keys") return do_keys(conn, cmd, out);
+    else if (op == "dbsize")   return do_dbsize(cmd, out);
+    else if (op == "bigkeys")  return do_bigkeys(conn, cmd, out);
+    else if (op == "memstats") return do_memstats(conn, cmd, out);
+    else if (op == "scan") return do_scan(cmd, out);
+    else if (op == "xadd")   return do_xadd(cmd, out);
+    else if (op == "xlen")   return do_xlen(cmd, out);
+    else if (op == "xrange") return do_xrange(conn, cmd, out);
+    else if (op == "xread")  return do_xread(conn, cmd, out);
+    else if (op == "xtrim")  return do_xtrim(cmd, out);
+    else if (op == "ts.add")    return do_ts_add(cmd, out);
+    else if (op == "ts.range")  return do_ts_range(conn, cmd, out);
+    else if (op == "ts.mrange") return do_ts_mrange(cmd, out);
+    else if (op == "ts.info")   return do_ts_info(cmd, out);
+    else if (op == "vadd")   return do_vadd(cmd, out);
+    else if (op == "vrem")   return do_vrem(cmd, out);
+    else if (op == "vcard")  return do_vcard(cmd, out);
+    else if (op == "vsim")   return do_vsim(cmd, out);
+    else if (op == "vindex") return do_vindex(cmd, out);
+    else if (op == "scanprefix") return do_scanprefix(cmd, out);
+    else if (op == "keyrange")   return do_keyrange(cmd, out);
+    else if (op == "keyindex")   return do_keyindex(cmd, out);
+    else if (op == "info") return do_info(cmd, out);
+    else if (op == "shm")  return do_shm(conn, cmd, out);
+    else if (op == "hello") return do_hello(conn, cmd, out);
+
+    out_frag(out, FRAG_ERR_CMD);
+}
+
+// --------------- per-connection request handling ---------------
+// A length in a request: a u32, or a varint in protocol 2. 1 if read,
+// 0 if not all here yet, -1 if malformed.
+static int read_len(const Conn *conn, const uint8_t *&cur, const uint8_t *end, uint32_t &out) {
+    if (conn->proto == 2) return varint_get32(cur, end, out);
+    return read_u32(cur, end, out) ? 1 : 0;
+}
+
+// The length of the request at `p`, of which `n` bytes are in, and the
+// `hdr` bytes it takes; as read_len()
+static int frame_len(const Conn *conn, const uint8_t *p, size_t n, size_t &hdr, uint32_t &len) {
+    const uint8_t *cur = p;
+    int rv = read_len(conn, cur, p + n, len);
+    hdr = (size_t)(cur - p);
+    return rv;
+}
+
+static void upload_done(Conn *conn) {
+    g_upload_bytes.fetch_sub(conn->upload[2].size(), std::memory_order_relaxed);
+    conn->cmds.push_back(std::move(conn->upload));
+    conn->upload.clear();
+}
+
+// A `set` or `append` of at least k_upload_min bytes doesn't wait in
+// `incoming` for the whole request. Once its key and value length are in,
+// the value gets its final string, and conn_read() appends to that
+// directly; the finished command is then run as if parsed normally.
+// The string grows with the bytes that arrive rather than the length
+// declared, and all uploads together may declare k_max_uploading bytes;
+// past that, a request that fits k_max_msg is buffered as usual and a
+// bigger one closes the conn.
+// `data` is the request body after the length; returns the bytes taken
+// from it, 0 if the head isn't all here yet, -1 if not an upload.
+static int64_t upload_begin(Conn *conn, const uint8_t *data, size_t size, uint32_t len) {
+    if (len < k_upload_min || len > k_max_upload) return -1;
+    const uint8_t *cur = data;
+    const uint8_t *end = data + size;
+    std::string op;
+    uint32_t oplen = 0;
+    if (conn->proto == 1) {
+        uint32_t nstr = 0;
+        if (!read_u32(cur, end, nstr) || !read_u32(cur, end, oplen)) return 0;
+        if (nstr != 3 || oplen > 6) return -1;
+        if (!read_str(cur, end, oplen, op)) return 0;
+    } else {
+        if (cur == end) return 0;
+        uint8_t opcode = *cur++;
+        if (opcode > conn->ops.size()) return -1;
+        if (opcode) {
+            op = conn->ops[opcode - 1];
+        } else {
+            int rv = read_len(conn, cur, end, oplen);
+            if (rv <= 0) return rv;
+            if (oplen > 6) return -1;
+            if (!read_str(cur, end, oplen, op)) return 0;
+        }
+    }
+    if (op != "set" && op != "append") return -1;
+    uint32_t klen = 0;
+    int rv = read_len(conn, cur, end, klen);
+    if (rv <= 0) return rv;
+    if (klen > k_max_msg) return -1;
+    std::string key;
+    uint32_t vlen = 0;
+    if (!read_str(cur, end, klen, key)) return 0;
+    rv = read_len(conn, cur, end, vlen);
+    if (rv <= 0) return rv;
+    if ((size_t)(cur - data) + vlen != len) return -1;    // not one value to the end
+    if (g_upload_bytes.fetch_add(vlen, std::memory_order_relaxed) + vlen > k_max_uploading) {
+        g_upload_bytes.fetch_sub(vlen, std::memory_order_relaxed);
+        if (len > k_max_msg) {
+            msg("too many uploads");
+            conn->want_close = true;
+        }
+        return -1;
+    }
+
+    conn->upload.resize(3);
+    conn->upload[0].swap(op);
+    conn->upload[1].swap(key);
+    size_t n = std::min((size_t)(end - cur), (size_t)vlen);
+    conn->upload[2].assign((const char*)cur, n);
+    conn->upload_left = vlen - n;
+    if (!conn->upload_left) upload_done(conn);
+    return (int64_t)((cur - data) + n);
+}
+
+// Split every complete request off `incoming` into `cmds`.
+static void conn_parse(Conn *conn) {
+    size_t pos = 0;
+    while (pos < conn->incoming.size()) {
+        const uint8_t *p = &conn->incoming[pos];
+        size_t avail = conn->incoming.size() - pos;
+        size_t hdr = 0;
+        uint32_t len = 0;
+        int rv = frame_len(conn, p, avail, hdr, len);
+        if (rv < 0) {
+            msg("bad request");
+            conn->want_close = true;
+            break;
+        }
+        if (rv == 0) break;
+        if (len > k_max_msg || avail < hdr + (size_t)len) {
+            int64_t took = upload_begin(conn, p + hdr, avail - hdr, len);
+            if (took > 0) {
+                pos += hdr + (size_t)took;
+                continue;
+            }
+            if (took < 0 && len > k_max_msg && !conn->want_close) {
+                msg("too long");
+                conn->want_close = true;
+            }
+            break;
+        }
+
+        std::vector<std::string> cmd;
+        int32_t err = conn->proto == 1 ? parse_req(p + hdr, len, cmd)
+                                       : parse_req2(conn->ops, p + hdr, len, cmd);
+        if (err < 0) {
+            msg("bad request");
+            conn->want_close = true;
+            break;
+        }
+        if (!cmd.empty() && cmd[0] == "hello") {
+            // the requests behind it are in the new format already
+            if (uint8_t ver = hello_version(cmd)) {
+                conn->proto = ver;
+                conn->ops.assign(cmd.begin() + 2, cmd.end());
+            }
+        }
+        conn->cmds.push_back(std::move(cmd));
+        pos += hdr + len;
     }
+    buf_consume(conn->incoming, pos);
+    if (conn->incoming.empty()) pool_give(conn->incoming);
 }
 
-static void handle_read(Conn *conn) {
-    uint8_t buf[64 * 1024];
-    ssize_t rv = read(conn->fd, buf, sizeof(buf));
+static void backlog_add(Conn *conn) {
+    if (conn->in_backlog) return;
+    conn->in_backlog = true;
+    g_backlog.push_back(conn);
+}
+
+// What one conn may run per pass of the event loop before the others get
+// a turn; a bulk loader's pipeline then costs an interactive client one
+// budget's worth of waiting, not the whole burst.
+const size_t k_exec_cmds  = 64;             // requests
+const size_t k_exec_bytes = 256 * 1024;     // request and reply bytes
+
+static size_t cmd_bytes(const std::vector<std::string> &cmd) {
+    size_t n = 0;
+    for (const std::string &s : cmd) n += 4 + s.size();
+    return n;
+}
+
+// Run parsed requests in order until one of them parks the conn, the
+// conn has used up its budget for this pass, or the client falls
+// k_reply_high behind on its replies. The rest wait for a later pass: in
+// g_backlog, or with its I/O thread.
+static void conn_exec(Conn *conn) {
+    size_t ran = 0;
+    size_t bytes = 0;
+    size_t out_start = out_pending(conn->outgoing);
+    while (!conn->blocked && !conn->cmds.empty()) {
+        size_t out_now = out_pending(conn->outgoing);
+        if (out_now >= k_reply_high || ran >= k_exec_cmds
+            || bytes + out_now - out_start >= k_exec_bytes) {
+            if (!conn->io) backlog_add(conn);
+            break;
+        }
+        std::vector<std::string> cmd = std::move(conn->cmds.front());
+        conn->cmds.pop_front();
+        ran++;
+        bytes += cmd_bytes(cmd);
+        g_stat_cmds++;
+
+        size_t header_pos = 0;
+        response_begin(conn->outgoing, &header_pos);
+        conn->reply_pos = header_pos;
+        do_request(conn, cmd, conn->outgoing);
+        if (conn->sliced || conn->job) {
+            // the rest comes from later slices or the scan workers
+            g_producing.push_back(conn);
+            break;
+        }
+        if (conn->blocked) {
+            // no reply until woken; later pipelined requests wait as well
+            out_truncate(conn->outgoing, header_pos);
+            break;
+        }
+        reply_end(conn);    // chunked if a sliced command ran to the end at once
+        if (conn->proto_next) {
+            conn->outgoing.proto = conn->proto_next;
+            conn->proto_next = 0;
+        }
+    }
+}
+
+const int k_max_iov = 64;
+const size_t k_zerocopy_min = 64 * 1024;    // smaller refs aren't worth pinning
+
+// Gather the first `lim` bytes of `out` with the refs spliced in before
+// them, stopping short of a ref of `zc_min` bytes or more (which
+// zc_send() takes). Returns the number of iovecs.
+static int out_iov(const Buffer &out, size_t lim, size_t zc_min, struct iovec *iov) {
+    int n = 0;
+    size_t pos = 0;     // bytes of `out` covered so far
+    bool tail = true;
+    for (size_t i = 0; i < out.refs.size() && out.refs[i].at <= lim; ++i) {
+        const OutRef &r = out.refs[i];
+        if (n + 2 > k_max_iov) {
+            tail = false;
+            break;
+        }
+        if (r.at > pos) {
+            iov[n++] = {(void*)&out[pos], r.at - pos};
+            pos = r.at;
+        }
+        if (r.val->size() >= zc_min) {
+            tail = false;
+            break;
+        }
+        size_t skip = i == 0 ? out.ref_sent : 0;
+        iov[n++] = {(void*)(r.val->data() + skip), r.val->size() - skip};
+    }
+    if (tail && pos < lim) iov[n++] = {(void*)&out[pos], lim - pos};
+    return n;
+}
+
+static ssize_t out_writev(int fd, const Buffer &out, size_t lim, size_t zc_min) {
+    struct iovec iov[k_max_iov];
+    return writev(fd, iov, out_iov(out, lim, zc_min, iov));
+}
+
+// Send the rest of the ref at the front with MSG_ZEROCOPY. The kernel
+// reads the value's pages after sendmsg() returns, so it stays pinned
+// until the completion comes back on the error queue (see zc_reap).
+// Only refs are sent this way: `outgoing` itself moves as it's consumed.
+static ssize_t zc_send(Conn *conn) {
+    Buffer &out = conn->outgoing;
+    const OutRef &r = out.refs.front();
+    struct iovec iov = {(void*)(r.val->data() + out.ref_sent), r.val->size() - out.ref_sent};
+    struct msghdr mh = {};
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    ssize_t rv = sendmsg(conn->fd, &mh, MSG_ZEROCOPY);
+    if (rv > 0) conn->zc_pins.push_back({conn->zc_seq++, r.val});
+    return rv;
+}
+
+// Unpin the values whose sends the kernel has finished with
+static void zc_reap(Conn *conn) {
+    while (true) {
+        char control[256];
+        struct msghdr mh = {};
+        mh.msg_control = control;
+        mh.msg_controllen = sizeof(control);
+        if (recvmsg(conn->fd, &mh, MSG_ERRQUEUE) < 0) return;  // drained
+        for (cmsghdr *cm = CMSG_FIRSTHDR(&mh); cm; cm = CMSG_NXTHDR(&mh, cm)) {
+            bool v4 = cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR;
+            bool v6 = cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR;
+            if (!v4 && !v6) continue;
+            const sock_extended_err *ee = (const sock_extended_err*)CMSG_DATA(cm);
+            if (ee->ee_errno || ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+            // sends [ee_info, ee_data] are complete
+            uint32_t lo = ee->ee_info, hi = ee->ee_data;
+            std::vector<ZcPin> &pins = conn->zc_pins;
+            for (size_t i = 0; i < pins.size();) {
+                if (pins[i].seq - lo <= hi - lo) {
+                    pins.erase(pins.begin() + (ptrdiff_t)i);
+                } else {
+                    ++i;
+                }
+            }
+            if (ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                // the kernel copied after all (loopback does): pinning and
+                // completions are pure overhead here
+                conn->zc = false;
+            }
+        }
+    }
+}
+
+// POLLERR also signals zerocopy completions; only a socket error or a
+// hangup ends the conn.
+static bool conn_failed(Conn *conn, uint32_t ready) {
+    if (ready & POLLHUP) return true;
+    if (!(ready & POLLERR)) return false;
+    if (!g_zerocopy) return true;
+    zc_reap(conn);
+    int err = 0;
+    socklen_t len = sizeof(err);
+    return getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err, &len) || err;
+}
+
+// ------------------ shared-memory transport -------------------
+// A shm conn is served from its rings on every loop pass; poll() only
+// watches its socket for doorbells and hangups. While any of them has
+// moved bytes in the last g_shm_spin_us the loop doesn't block, so a
+// client sending its next request right away needs no syscall on
+// either side. On a single CPU spinning only delays the client, so
+// there the loop sleeps right away and relies on doorbells.
+static uint64_t g_shm_spin_us = 100;
+static uint64_t g_shm_active_us = 0;
+
+static ssize_t shm_send(Conn *conn) {
+    struct iovec iov[k_max_iov];
+    int n = out_iov(conn->outgoing, conn_sendable(conn), SIZE_MAX, iov);
+    ShmLink *l = conn->shm;
+    ShmRing *r = &l->hdr->s2c;
+    size_t total = 0;
+    for (int i = 0; i < n; ++i) {
+        size_t k = ring_push(r, l->s2c, l->ring_size, iov[i].iov_base, iov[i].iov_len);
+        total += k;
+        if (k < iov[i].iov_len) break;
+    }
+    if (!total) {
+        errno = EAGAIN;
+        return -1;
+    }
+    if (ring_wake_reader(r)) (void)shm_doorbell(conn->fd);
+    g_shm_active_us = slice_now_us();
+    return (ssize_t)total;
+}
+
+static ssize_t shm_recv(Conn *conn, uint8_t *dst, size_t cap) {
+    ShmLink *l = conn->shm;
+    ShmRing *r = &l->hdr->c2s;
+    size_t k = ring_pop(r, l->c2s, l->ring_size, dst, cap);
+    if (!k) {
+        errno = EAGAIN;
+        return -1;
+    }
+    if (ring_wake_writer(r)) (void)shm_doorbell(conn->fd);
+    g_shm_active_us = slice_now_us();
+    return (ssize_t)k;
+}
+
+// The socket of a shm conn only carries doorbells: drop them.
+static void shm_bell(Conn *conn) {
+    uint8_t buf[256];
+    while (true) {
+        ssize_t rv = read(conn->fd, buf, sizeof(buf));
+        if (rv > 0) continue;
+        if (rv == 0) {
+            msg("client closed");
+            conn->want_close = true;
+        } else if (errno != EAGAIN && errno != EINTR) {
+            msg_errno("read()");
+            conn->want_close = true;
+        }
+        return;
+    }
+}
+
+// Before the loop blocks: tell each client to ring if it sends or makes
+// room. False if that already happened, or the loop should keep spinning.
+static bool shm_can_sleep() {
+    if (g_shm.empty()) return true;
+    if (slice_now_us() - g_shm_active_us < g_shm_spin_us) return false;
+    for (Conn *c : g_shm) {
+        if (!c->shm_on) continue;
+        ShmHeader *h = c->shm->hdr;
+        if (c->want_read && !ring_reader_sleep(&h->c2s)) return false;
+        if (c->want_write && !ring_writer_sleep(&h->s2c, c->shm->ring_size)) return false;
+    }
+    return true;
+}
+
+// Awake again: no more doorbells needed until the next shm_can_sleep()
+static void shm_awake() {
+    for (Conn *c : g_shm) {
+        c->shm->hdr->c2s.reader_idle.store(0, std::memory_order_relaxed);
+        c->shm->hdr->s2c.writer_wait.store(0, std::memory_order_relaxed);
+    }
+}
+
+static ssize_t conn_send(Conn *conn) {
+    Buffer &out = conn->outgoing;
+    if (!conn->zc) return out_writev(conn->fd, out, conn_sendable(conn), SIZE_MAX);
+    if (!out.refs.empty() && out.refs.front().at == 0
+        && out.refs.front().val->size() >= k_zerocopy_min) {
+        ssize_t rv = zc_send(conn);
+        if (rv >= 0 || errno != ENOBUFS) return rv;
+        // out of memory for pinning: copy this time
+        return out_writev(conn->fd, out, conn_sendable(conn), SIZE_MAX);
+    }
+    return out_writev(conn->fd, out, conn_sendable(conn), k_zerocopy_min);
+}
+
+// Drop `n` written bytes off the front; returns how many were `out`'s own
+// rather than refs'.
+static size_t out_consume(Buffer &out, size_t n) {
+    size_t own = 0;
+    while (n) {
+        if (out.refs.empty() || out.refs.front().at > own) {
+            size_t k = out.refs.empty() ? n : std::min(n, out.refs.front().at - own);
+            own += k;
+            n -= k;
+            continue;
+        }
+        size_t size = out.refs.front().val->size();
+        size_t k = std::min(n, size - out.ref_sent);
+        out.ref_sent += k;
+        out.ref_bytes -= k;
+        n -= k;
+        if (out.ref_sent == size) {
+            out.refs.pop_front();   // may free a value overwritten meanwhile
+            out.ref_sent = 0;
+        }
+    }
+    buf_consume(out, own);
+    for (OutRef &r : out.refs) r.at -= own;
+    return own;
+}
+
+// Under RCU each append that main runs publishes a copy of the whole
+// value. So while a pipelined run of appends to one key is still coming
+// in, its I/O thread reads on rather than handing the conn over, up to
+// k_max_msg bytes, and main publishes the run once (see append_run).
+static bool append_run_open(const Conn *conn) {
+    if (!conn->io || conn->cmds.empty() || conn->want_close) return false;
+    if (conn->cmds.size() >= k_exec_cmds) return false;
+    if (conn->cmds.front().size() != 3) return false;
+    const std::string &key = conn->cmds.front()[1];
+    size_t bytes = 0;
+    for (const std::vector<std::string> &cmd : conn->cmds) {
+        if (cmd.size() != 3 || cmd[0] != "append" || cmd[1] != key) return false;
+        bytes += cmd_bytes(cmd);
+    }
+    if (bytes >= k_max_msg) return false;
+    if (conn->upload_left) return conn->upload[0] == "append" && conn->upload[1] == key;
+    // the next request is on its way
+    int avail = 0;
+    return !conn->incoming.empty()
+        || (!conn->shm_on && !ioctl(conn->fd, FIONREAD, &avail) && avail > 0);
+}
+
+// Read on while the client keeps up with its replies and nothing parsed
+// is waiting to run.
+static bool conn_can_read(const Conn *conn) {
+    return !conn->blocked && (conn->cmds.empty() || append_run_open(conn))
+        && out_pending(conn->outgoing) < k_reply_high;
+}
+
+// Held-back requests can run again: the client has read enough.
+static bool conn_resumable(const Conn *conn) {
+    return !conn->cmds.empty() && !conn->blocked && !conn->want_close
+        && out_pending(conn->outgoing) < k_reply_low && !append_run_open(conn);
+}
+
+static void handle_write(Conn *conn) {
+    assert(conn_can_send(conn));
+    ssize_t rv = conn->shm_on ? shm_send(conn) : conn_send(conn);
     if (rv < 0 && errno == EAGAIN) return;
     if (rv < 0) {
-        msg_errno("read()");
+        msg_errno("write()");
         conn->want_close = true;
         return;
     }
+    size_t own = out_consume(conn->outgoing, (size_t)rv);
+    if (out_empty(conn->outgoing)) pool_give(conn->outgoing);
+    conn_touch(conn);
+    if (conn->sliced || conn->job) {
+        conn->reply_pos -= own;
+        if (conn->out_wait && conn->outgoing.size() < k_reply_low) {
+            conn->out_wait = false;     // serve_producing() carries on
+        }
+    }
+    conn->want_read = conn_can_read(conn);
+    if (!conn_can_send(conn)) {
+        conn->want_write = false;
+        if (conn->shm && out_empty(conn->outgoing)) conn->shm_on = true;
+    }
+    conn_idle_note(conn);
+}
+
+// Set poll interest from the output state, then try writing right away.
+static void conn_flush(Conn *conn) {
+    conn->want_read  = conn_can_read(conn);
+    conn->want_write = conn_can_send(conn);
+    if (conn->want_write) {
+        // optimistic write
+        handle_write(conn);
+    }
+}
+
+static void io_give(Conn *conn);
+
+// Run buffered requests, then flush what they produced.
+static void conn_process(Conn *conn) {
+    if (conn->io) {
+        // threaded I/O: the I/O thread has parsed and will do the writing
+        conn_exec(conn);
+        if (!conn->blocked) {
+            io_give(conn);
+        } else if (conn->sliced || conn->job) {
+            conn_flush(conn);   // main writes while it holds the conn
+        }
+        return;
+    }
+    conn_parse(conn);
+    conn_exec(conn);
+    conn_flush(conn);
+}
+
+// Bytes to ask the socket for: the conn's adaptive read size, or the
+// rest of a big request whose length is in, so it arrives in one read.
+// Past k_read_max that takes FIONREAD saying the bytes are there: the
+// length alone costs the client nothing. Never more, though; a pipeline
+// of small requests is better parsed in k_read_max pieces than all at
+// once while everyone else waits.
+static size_t conn_read_want(Conn *conn) {
+    size_t want = conn->read_size;
+    const Bytes &in = conn->incoming;
+    size_t hdr = 0;
+    uint32_t len = 0;
+    // conn_parse() left a partial one first
+    if (frame_len(conn, in.data(), in.size(), hdr, len) != 1) return want;
+    if (len > k_max_msg || hdr + (size_t)len <= in.size()) return want;
+    size_t need = hdr + (size_t)len - in.size();
+    want = std::max(want, std::min(need, (size_t)k_read_max));
+    int avail = 0;
+    if (need > want && conn->read_full && !conn->shm_on
+        && !ioctl(conn->fd, FIONREAD, &avail) && avail > 0) {
+        want = std::max(want, std::min(need, (size_t)avail));
+    }
+    return want;
+}
+
+// Append what the socket has to `incoming`, reading straight into its
+// spare capacity, or to the value of an upload in progress; false if
+// there is nothing new to parse or run.
+static bool conn_read(Conn *conn) {
+    Bytes &in = conn->incoming;
+    size_t old = in.size();
+    uint8_t *dst = nullptr;
+    size_t cap = 0;
+    if (conn->upload_left) {
+        cap = std::min(conn->upload_left, (size_t)k_read_max);
+        dst = (uint8_t*)str_read_room(conn->upload[2], cap, conn->upload_left);
+    } else {
+        cap = conn_read_want(conn);
+        pool_reserve(in, cap);
+        in.resize(old + cap);   // not zeroed (see Bytes)
+        dst = &in[old];
+    }
+    ssize_t rv = conn->shm_on ? shm_recv(conn, dst, cap)
+               : conn->is_unix ? sock_recv_fd(conn->fd, dst, cap, &conn->passed_fd)
+               : read(conn->fd, dst, cap);
+    int err = errno;
+    if (conn->upload_left) {
+        std::string &val = conn->upload[2];
+        val.resize(val.size() - cap + (rv > 0 ? (size_t)rv : 0));
+    } else {
+        in.resize(old + (rv > 0 ? (size_t)rv : 0));
+        if (in.empty()) pool_give(in);
+    }
+    conn_idle_note(conn);
+    errno = err;
+    if (rv < 0 && errno == EAGAIN) return false;
+    if (rv < 0) {
+        msg_errno("read()");
+        conn->want_close = true;
+        return false;
+    }
     if (rv == 0) {
-        if (conn->incoming.empty()) msg("client closed");
+        if (conn->incoming.empty() && !conn->upload_left) msg("client closed");
         else msg("unexpected EOF");
         conn->want_close = true;
-        return;
+        return false;
     }
 
-    buf_append(conn->incoming, buf, (size_t)rv);
-    while (try_one_request(conn)) {}
+    conn_touch(conn);
+    if (conn->upload_left) {
+        conn->upload_left -= (size_t)rv;
+        if (conn->upload_left) return false;
+        upload_done(conn);
+        return true;
+    }
+    // double the next read after one that filled the buffer, halve it
+    // after one that used under a quarter
+    conn->read_full = (size_t)rv == cap;
+    if (rv >= conn->read_size && conn->read_size < k_read_max) {
+        conn->read_size *= 2;
+    } else if (rv < conn->read_size / 4 && conn->read_size > k_read_min) {
+        conn->read_size /= 2;
+    }
+    return true;
+}
 
-    if (!conn->outgoing.empty()) {
-        conn->want_read  = false;
-        conn->want_write = true;
-        // optimistic write
-        handle_write(conn);
+static void handle_read(Conn *conn) {
+    if (conn_read(conn)) conn_process(conn);
+}
+
+// ----------------------- blocked clients -----------------------
+static void conn_unblock(Conn *conn) {
+    conn->blocked = false;
+    conn->block_deadline_ms = 0;
+    tw_cancel(&g_timers, &conn->block_timer);
+    conn->block_cmd.clear();
+    conn->block_keys.clear();
+}
+
+static bool keys_intersect(const std::vector<std::string> &a,
+                           const std::vector<std::string> &b) {
+    for (const std::string &x : a) {
+        for (const std::string &y : b) {
+            if (x == y) return true;
+        }
+    }
+    return false;
+}
+
+// Wake parked conns whose keys were written or whose deadline passed.
+static void serve_blocked(uint64_t now_ms) {
+    if (g_ready_keys.empty() && !g_block_due) return;
+    g_block_due = false;
+    std::vector<std::string> ready_keys;
+    ready_keys.swap(g_ready_keys);
+    std::vector<Conn*> parked;
+    parked.swap(g_blocked);
+
+    std::vector<Conn*> still;
+    for (Conn *c : parked) {
+        bool ready   = keys_intersect(c->block_keys, ready_keys);
+        bool expired = c->block_deadline_ms && now_ms >= c->block_deadline_ms;
+        if (!ready && !expired) { still.push_back(c); continue; }
+
+        size_t header_pos = 0;
+        response_begin(c->outgoing, &header_pos);
+        bool served = ready && blocked_retry(c, c->outgoing);
+        if (!served && !expired) {
+            out_truncate(c->outgoing, header_pos);
+            still.push_back(c);
+            continue;
+        }
+        if (!served) out_nil(c->outgoing);  // timed out
+        response_end(c->outgoing, header_pos);
+        conn_unblock(c);
+        conn_process(c);    // resume pipelined requests
+    }
+    // conns re-parked by conn_process() are already in g_blocked
+    g_blocked.insert(g_blocked.end(), still.begin(), still.end());
+}
+
+// Give every sliced command one more slice, in turn, and let scan jobs
+// fold in what their clients have made room for. Each pass of the event
+// loop serves the other clients in between.
+static void serve_producing() {
+    std::vector<Conn*> conns = g_producing;     // finishing ones leave it
+    for (Conn *c : conns) {
+        if (c->out_wait) continue;
+        if (c->job) {
+            scan_pump(c->job);
+            continue;
+        }
+        slice_begin();
+        c->sliced.resume();
+        if (!c->sliced.done()) {
+            conn_flush(c);
+            continue;
+        }
+        c->sliced.reset();
+        reply_end(c);
+        producing_remove(c);
+        conn_unblock(c);
+        conn_process(c);    // resume pipelined requests
+    }
+}
+
+// Run what was held back for clients that have since caught up.
+static void serve_backlog() {
+    std::vector<Conn*> conns;
+    conns.swap(g_backlog);
+    for (Conn *c : conns) {
+        c->in_backlog = false;
+        if (!conn_resumable(c)) {
+            if (!c->cmds.empty() && !c->want_close) backlog_add(c);
+            continue;
+        }
+        conn_process(c);    // holds the rest back again if need be
+    }
+}
+
+static bool backlog_runnable() {
+    for (Conn *c : g_backlog) {
+        if (conn_resumable(c)) return true;
+    }
+    return false;
+}
+
+static bool sliced_runnable() {
+    for (Conn *c : g_producing) {
+        if (c->sliced && !c->out_wait) return true;
+    }
+    return false;
+}
+
+// poll() timeout: the next timer, or 0 if wakeups are pending
+static int next_timeout_ms(uint64_t now_ms) {
+    if (sliced_runnable() || backlog_runnable()) return 0;
+    if (!g_ready_keys.empty() && !g_blocked.empty()) return 0;
+    if (g_block_due) return 0;
+    int64_t ms = tw_timeout_ms(&g_timers, now_ms);
+    return ms < 0 ? -1 : (int)std::min<int64_t>(ms, INT32_MAX);
+}
+
+static void conn_destroy(Conn *conn) {
+    if (conn->wheel) tw_cancel(conn->wheel, &conn->idle.timer);
+    tw_cancel(&g_timers, &conn->block_timer);
+    if (conn->sliced || conn->job) producing_remove(conn);
+    if (conn->job) {
+        conn->job->conn = nullptr;  // the scan finishes without a reply
+    } else if (conn->sliced) {
+        conn->sliced.reset();
+    } else if (conn->blocked) {
+        for (size_t i = 0; i < g_blocked.size(); ++i) {
+            if (g_blocked[i] == conn) {
+                g_blocked[i] = g_blocked.back();
+                g_blocked.pop_back();
+                break;
+            }
+        }
+    }
+    if (conn->in_backlog) {
+        for (size_t i = 0; i < g_backlog.size(); ++i) {
+            if (g_backlog[i] == conn) {
+                g_backlog.erase(g_backlog.begin() + i);     // keeps the order
+                break;
+            }
+        }
+    }
+    if (conn->shm) {
+        for (size_t i = 0; i < g_shm.size(); ++i) {
+            if (g_shm[i] == conn) {
+                g_shm[i] = g_shm.back();
+                g_shm.pop_back();
+                break;
+            }
+        }
+        shm_detach(conn->shm);
+        delete conn->shm;
+    }
+    if (conn->passed_fd >= 0) (void)close(conn->passed_fd);
+    if (!conn->zc_pins.empty()) {
+        // Values still pinned by zerocopy sends are freed with the conn;
+        // reset rather than let the kernel send what reuses that memory.
+        struct linger lg = {1, 0};
+        (void)setsockopt(conn->fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    }
+    (void)close(conn->fd);
+    conn_free(conn);
+}
+
+// ------------------------- threaded I/O ------------------------
+// With --io-threads, each I/O thread runs its own poll loop over the
+// conns assigned to it: reading, splitting requests with parse_req() and
+// writing replies. A conn with parsed commands is handed to the main
+// thread, which alone touches it until the commands have run, and is then
+// handed back with its replies in `outgoing`. Handoffs go through
+// MPSCLists, so the data structures still see a single thread.
+struct IOThread {
+    size_t id = 0;              // epoch reader slot
+    int wake_rfd = -1;
+    int wake_wfd = -1;
+    MPSCList<Conn> inbox;       // new conns, and conns back from main
+    TimerWheel timers;          // idle timeouts of the conns it owns
+    std::atomic<uint64_t> gets{0};  // answered here; only this thread writes
+};
+
+static std::vector<IOThread*> g_io;
+static MPSCList<Conn> g_io_ready;   // conns with commands to run, for main
+
+// Hand a new conn, or one whose commands have run, to its I/O thread.
+static void io_give(Conn *conn) {
+    if (conn->io->inbox.push(conn)) {
+        uint8_t one = 1;
+        (void)write(conn->io->wake_wfd, &one, 1);
+    }
+}
+
+// Main thread: run the commands of every conn the I/O threads handed over.
+// The wake pipe must have been drained first (see MPSCList).
+static void io_run_ready() {
+    for (Conn *c = g_io_ready.take(); c;) {
+        Conn *next = c->q_next;     // io_give() relinks c
+        conn_process(c);
+        c = next;
+    }
+}
+
+// I/O thread: answer leading `get`s, within the conn's budget for this
+// pass and while the client keeps up, and hand the conn to main if other
+// commands follow. False once main owns it.
+static bool io_serve(IOThread *io, Conn *c) {
+    size_t out_start = out_pending(c->outgoing);
+    size_t ran = 0;
+    while (!c->cmds.empty() && c->cmds.front().size() == 2 && c->cmds.front()[0] == "get") {
+        size_t out_now = out_pending(c->outgoing);
+        if (out_now >= k_reply_high || ran >= k_exec_cmds
+            || out_now - out_start >= k_exec_bytes) {
+            return true;    // the rest in a later pass
+        }
+        size_t header_pos = 0;
+        response_begin(c->outgoing, &header_pos);
+        do_get_concurrent(io->id, c->cmds.front(), c->outgoing);
+        response_end(c->outgoing, header_pos);
+        c->cmds.pop_front();
+        ran++;
+    }
+    io->gets.store(io->gets.load(std::memory_order_relaxed) + ran, std::memory_order_relaxed);
+    if (c->cmds.empty() || append_run_open(c)) return true;
+    tw_cancel(&io->timers, &c->idle.timer);   // re-armed when main gives it back
+    if (g_io_ready.push(c)) {
+        uint8_t one = 1;
+        (void)write(g_wake_wfd, &one, 1);
+    }
+    return false;
+}
+
+static void io_loop(IOThread *io) {
+    std::vector<Conn*> fd2conn;     // conns this thread owns right now
+    std::vector<struct pollfd> pfds;
+    while (true) {
+        pfds.clear();
+        pfds.push_back({io->wake_rfd, POLLIN, 0});
+        uint64_t now_ms = get_monotonic_msec();
+        uint64_t deadline_ms = UINT64_MAX;
+        bool more = false;  // requests left over for the next pass
+        for (Conn *c : fd2conn) {
+            if (!c) continue;
+            if (conn_resumable(c)) {
+                // one more budget's worth for a conn with requests left
+                if (!io_serve(io, c)) {
+                    fd2conn[c->fd] = nullptr;
+                    continue;
+                }
+                conn_flush(c);
+                more |= conn_resumable(c);
+            }
+            if (c->want_close || conn_over_limit(c, now_ms, &deadline_ms)) {
+                fd2conn[c->fd] = nullptr;
+                conn_destroy(c);
+                continue;
+            }
+            short ev = POLLERR;
+            if (c->want_read)  ev |= POLLIN;
+            if (c->want_write) ev |= POLLOUT;
+            pfds.push_back({c->fd, ev, 0});
+        }
+
+        int64_t timeout_ms = tw_timeout_ms(&io->timers, now_ms);
+        if (deadline_ms != UINT64_MAX && (timeout_ms < 0 || deadline_ms - now_ms < (uint64_t)timeout_ms)) {
+            timeout_ms = (int64_t)(deadline_ms - now_ms);
+        }
+        if (more) timeout_ms = 0;
+        int rv = poll(pfds.data(), (nfds_t)pfds.size(), (int)std::min<int64_t>(timeout_ms, INT32_MAX));
+        if (rv < 0 && errno == EINTR) continue;
+        if (rv < 0) die("poll()");
+        tw_run(&io->timers, get_monotonic_msec());
+
+        if (pfds[0].revents) {
+            uint8_t drain[256];
+            while (read(io->wake_rfd, drain, sizeof(drain)) > 0) {}
+            for (Conn *c = io->inbox.take(); c;) {
+                Conn *next = c->q_next;
+                if (fd2conn.size() <= (size_t)c->fd) fd2conn.resize(c->fd + 1, nullptr);
+                assert(!fd2conn[c->fd]);
+                fd2conn[c->fd] = c;
+                c->wheel = &io->timers;
+                conn_idle_arm(c);
+                conn_flush(c);
+                if (c->want_close) {
+                    fd2conn[c->fd] = nullptr;
+                    conn_destroy(c);
+                }
+                c = next;
+            }
+        }
+
+        for (size_t i = 1; i < pfds.size(); ++i) {
+            uint32_t ready = pfds[i].revents;
+            if (!ready) continue;
+
+            Conn *c = fd2conn[pfds[i].fd];
+            if (!c) continue;
+
+            if ((ready & POLLIN) && conn_read(c)) {
+                assert(c->want_read);
+                conn_parse(c);
+                if (!io_serve(io, c)) {
+                    // main owns it until io_give(); stop polling it here
+                    fd2conn[c->fd] = nullptr;
+                    continue;
+                }
+            }
+            if (ready & POLLIN) conn_flush(c);
+            if ((ready & POLLOUT) && c->want_write) handle_write(c);
+            if (conn_failed(c, ready) || c->want_close) {
+                fd2conn[c->fd] = nullptr;
+                conn_destroy(c);
+            }
+        }
+    }
+}
+
+static void io_start(size_t nthreads) {
+    epoch_init(nthreads);
+    g_rcu = nthreads > 0;
+    if (g_rcu) g_data.db.free_slots = [](void *p) { epoch_retire(&free, p); };
+    for (size_t i = 0; i < nthreads; ++i) {
+        IOThread *io = new IOThread();
+        io->id = i;
+        tw_init(&io->timers, get_monotonic_msec());
+        int wake[2];
+        if (pipe(wake)) die("pipe()");
+        io->wake_rfd = wake[0];
+        io->wake_wfd = wake[1];
+        fd_set_nb(io->wake_rfd);
+        fd_set_nb(io->wake_wfd);
+        g_io.push_back(io);
+        std::thread(io_loop, io).detach();
+    }
+}
+
+// ----------------------------- cron -----------------------------
+// Housekeeping g_hz times a second off g_timers: moving a resize along
+// while no command touches the table, and sampling the command rate.
+// Each run times itself; `info` reports it.
+const uint64_t k_cron_rehash_us = 1000;     // per run
+const size_t k_cron_samples = 16;           // rate averaged over these runs
+
+static struct {
+    Timer timer;
+    uint64_t runs = 0;
+    uint64_t us_last = 0;
+    uint64_t us_max = 0;
+    uint64_t us_total = 0;
+    // command rate: a ring of per-run samples
+    uint64_t last_cmds = 0;
+    uint64_t last_us = 0;
+    uint64_t rates[k_cron_samples] = {};
+    size_t nrates = 0;
+} g_cron;
+
+static uint64_t cmds_total() {
+    uint64_t n = g_stat_cmds;
+    for (IOThread *io : g_io) n += io->gets.load(std::memory_order_relaxed);
+    return n;
+}
+
+static uint64_t cron_ops_per_sec() {
+    size_t n = std::min(g_cron.nrates, k_cron_samples);
+    if (!n) return 0;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; ++i) sum += g_cron.rates[i];
+    return sum / n;
+}
+
+static void server_cron(Timer *t) {
+    uint64_t start_us = slice_now_us();
+    while (hm_rehash_step(&g_data.db)
+           && slice_now_us() - start_us < k_cron_rehash_us) {}
+    conn_reclaim();     // conns closed since the last accept
+
+    uint64_t cmds = cmds_total();
+    if (g_cron.last_us && start_us > g_cron.last_us) {
+        uint64_t rate = (cmds - g_cron.last_cmds) * 1000000 / (start_us - g_cron.last_us);
+        g_cron.rates[g_cron.nrates++ % k_cron_samples] = rate;
+    }
+    g_cron.last_cmds = cmds;
+    g_cron.last_us = start_us;
+
+    uint64_t used = slice_now_us() - start_us;
+    g_cron.runs++;
+    g_cron.us_last = used;
+    g_cron.us_max = std::max(g_cron.us_max, used);
+    g_cron.us_total += used;
+    tw_add(&g_timers, t, g_timers.now + 1000 / g_hz);
+}
+
+static void do_info(std::vector<std::string> &cmd, Buffer &out) {
+    if (cmd.size() != 1) return out_frag(out, FRAG_ERR_ARGS);
+    size_t idle = g_conn_idle.load(std::memory_order_relaxed);
+    size_t idle_bytes = g_conn_idle_bytes.load(std::memory_order_relaxed);
+    const std::pair<const char*, uint64_t> fields[] = {
+        {"hz", g_hz},
+        {"cron.runs", g_cron.runs},
+        {"cron.us_last", g_cron.us_last},
+        {"cron.us_max", g_cron.us_max},
+        {"cron.us_total", g_cron.us_total},
+        {"ops_per_sec", cron_ops_per_sec()},
+        {"timers", g_timers.count},
+        {"idle_timeout_ms", g_idle_timeout_ms},
+        {"idle_closed", g_idle_closed.load(std::memory_order_relaxed)},
+        {"clients", g_conn_live.load(std::memory_order_relaxed)},
+        {"conn.idle", idle},
+        {"conn.idle_bytes", idle ? idle_bytes / idle : 0},     // per idle conn
+        {"conn.free", g_conn_free.size()},
+        {"bufpool.bytes", pool_bytes()},
+        {"upload.bytes", g_upload_bytes.load(std::memory_order_relaxed)},
+    };
+    out_arr(out, 2 * (uint32_t)(sizeof(fields) / sizeof(fields[0])));
+    for (const auto &f : fields) {
+        out_str(out, f.first, strlen(f.first));
+        out_int(out, (int64_t)f.second);
     }
 }
 
 // -------------------------- main loop --------------------------
-int main() {
+int main(int argc, char **argv) {
+    size_t scan_threads = 4;
+    size_t io_threads = 0;
+    const char *unix_path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        uint64_t n = 0;
+        if (!strcmp(argv[i], "--key-index")) {
+            g_data.use_key_index = true;
+        } else if (!strcmp(argv[i], "--scan-threads") && i + 1 < argc
+                   && str2u64(argv[i + 1], n) && n <= 256) {
+            scan_threads = (size_t)n;
+            i++;
+        } else if (!strcmp(argv[i], "--io-threads") && i + 1 < argc
+                   && str2u64(argv[i + 1], n) && n <= 256) {
+            io_threads = (size_t)n;
+            i++;
+        } else if (!strcmp(argv[i], "--slice-us") && i + 1 < argc
+                   && str2u64(argv[i + 1], n) && n > 0) {
+            g_slice_budget_us = n;
+            i++;
+        } else if (!strcmp(argv[i], "--zerocopy")) {
+            g_zerocopy = true;
+        } else if (!strcmp(argv[i], "--unix") && i + 1 < argc) {
+            unix_path = argv[++i];
+        } else if (!strcmp(argv[i], "--output-limit") && i + 4 < argc) {
+            OutLimit lim;
+            size_t cls = 0;
+            if (!parse_out_limit(argv + i + 1, lim, cls)) {
+                fprintf(stderr, "--output-limit normal|local <hard> <soft> <soft_secs>\n");
+                return 1;
+            }
+            g_out_limits[cls] = lim;
+            i += 4;
+        } else if (!strcmp(argv[i], "--hz") && i + 1 < argc
+                   && str2u64(argv[i + 1], n) && n >= 1 && n <= 500) {
+            g_hz = (uint32_t)n;
+            i++;
+        } else if (!strcmp(argv[i], "--idle-timeout") && i + 1 < argc
+                   && str2u64(argv[i + 1], n) && n <= 100u * 86400) {
+            g_idle_timeout_ms = n * 1000;
+            i++;
+        } else {
+            fprintf(stderr, "usage: %s [--key-index] [--scan-threads <n>] [--io-threads <n>]"
+                            " [--slice-us <n>] [--zerocopy] [--unix <path>]"
+                            " [--output-limit <class> <hard> <soft> <secs>]"
+                            " [--hz <n>] [--idle-timeout <secs>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // a parked client may hang up before its reply is written
+    signal(SIGPIPE, SIG_IGN);
+    if (sysconf(_SC_NPROCESSORS_ONLN) < 2) g_shm_spin_us = 0;
+
     int lfd = socket(AF_INET, SOCK_STREAM, 0);  // FIXED: AF_INET
     if (lfd < 0) die("socket()");
     int val = 1;
@@ -380,51 +3726,166 @@ int main() {
     fd_set_nb(lfd);
     if (listen(lfd, SOMAXCONN)) die("listen()");
 
+    int ufd = -1;
+    if (unix_path) {
+        struct sockaddr_un uaddr = {};
+        uaddr.sun_family = AF_UNIX;
+        if (strlen(unix_path) >= sizeof(uaddr.sun_path)) die("--unix: path too long");
+        strcpy(uaddr.sun_path, unix_path);
+        ufd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (ufd < 0) die("socket()");
+        // a socket left over from a previous run goes; anything else there stays
+        struct stat st = {};
+        if (lstat(unix_path, &st) == 0) {
+            if (!S_ISSOCK(st.st_mode)) {
+                errno = EEXIST;
+                die("--unix: path exists and isn't a socket");
+            }
+            if (unlink(unix_path)) die("unlink()");
+        }
+        if (bind(ufd, (const sockaddr*)&uaddr, sizeof(uaddr))) die("bind()");
+        fd_set_nb(ufd);
+        if (listen(ufd, SOMAXCONN)) die("listen()");
+    }
+
     // init DB
     hm_init(&g_data.db);
 
+    int wake[2];
+    if (pipe(wake)) die("pipe()");
+    g_wake_rfd = wake[0];
+    g_wake_wfd = wake[1];
+    fd_set_nb(g_wake_rfd);
+    fd_set_nb(g_wake_wfd);
+    fprintf(stderr, "vector kernels: %s\n", vec_kernel_name());
+    sched_start(scan_threads);
+    lazyfree_start();
+    tw_init(&g_timers, get_monotonic_msec());
+    g_cron.timer.fn = server_cron;
+    tw_add(&g_timers, &g_cron.timer, g_timers.now + 1000 / g_hz);
+    io_start(io_threads);
+
     std::vector<Conn*> fd2conn;
     std::vector<struct pollfd> pfds;
+    std::vector<Conn*> parked;
+    std::vector<Conn*> accepted;
+    size_t next_io = 0;
 
     while (true) {
         pfds.clear();
         pfds.push_back({lfd, POLLIN, 0}); // index 0
+        pfds.push_back({g_wake_rfd, POLLIN, 0}); // index 1
+        pfds.push_back({ufd, POLLIN, 0}); // index 2, ignored without --unix
 
+        uint64_t now_ms = get_monotonic_msec();
+        uint64_t deadline_ms = UINT64_MAX;
         for (Conn *c : fd2conn) {
             if (!c) continue;
+            if (c->want_close || conn_over_limit(c, now_ms, &deadline_ms)) {
+                fd2conn[c->fd] = nullptr;
+                conn_destroy(c);
+                continue;
+            }
             short ev = POLLERR;
-            if (c->want_read)  ev |= POLLIN;
-            if (c->want_write) ev |= POLLOUT;
+            if (c->want_read || c->shm_on)  ev |= POLLIN;
+            if (c->want_write && !c->shm_on) ev |= POLLOUT;
             pfds.push_back({c->fd, ev, 0});
         }
+        // threaded I/O: parked conns belong to the main thread, which
+        // watches them for errors the way it does its own conns, and
+        // writes the replies that are still being produced
+        size_t nconns = pfds.size();
+        parked.clear();
+        if (!g_io.empty()) {
+            for (Conn *c : g_blocked) {
+                pfds.push_back({c->fd, POLLERR, 0});
+                parked.push_back(c);
+            }
+            for (Conn *c : g_producing) {
+                pfds.push_back({c->fd, (short)(c->want_write ? POLLERR | POLLOUT : POLLERR), 0});
+                parked.push_back(c);
+            }
+        }
 
-        int rv = poll(pfds.data(), (nfds_t)pfds.size(), -1);
+        int timeout_ms = next_timeout_ms(now_ms);
+        if (deadline_ms != UINT64_MAX && (timeout_ms < 0 || deadline_ms - now_ms < (uint64_t)timeout_ms)) {
+            timeout_ms = (int)(deadline_ms - now_ms);   // a soft output limit runs out
+        }
+        if (epoch_pending() && (timeout_ms < 0 || timeout_ms > 10)) {
+            timeout_ms = 10;    // come back to reclaim once readers move on
+        }
+        if (timeout_ms != 0 && !shm_can_sleep()) timeout_ms = 0;
+        int rv = poll(pfds.data(), (nfds_t)pfds.size(), timeout_ms);
         if (rv < 0 && errno == EINTR) continue;
         if (rv < 0) die("poll()");
+        shm_awake();
+        slice_begin();  // commands started in this pass share one slice
+        tw_run(&g_timers, get_monotonic_msec());
 
-        if (pfds[0].revents) {
-            if (Conn *c = handle_accept(lfd)) {
+        for (size_t i = 0; i < parked.size(); ++i) {
+            uint32_t ready = pfds[nconns + i].revents;
+            Conn *c = parked[i];
+            if ((ready & POLLOUT) && c->want_write) handle_write(c);
+            if (conn_failed(c, ready) || c->want_close) conn_destroy(c);
+        }
+
+        accepted.clear();
+        if (pfds[0].revents) handle_accept(lfd, false, accepted);
+        if (pfds[2].revents) handle_accept(ufd, true, accepted);
+        for (Conn *c : accepted) {
+            if (!g_io.empty()) {
+                c->io = g_io[next_io++ % g_io.size()];
+                io_give(c);
+            } else {
                 if (fd2conn.size() <= (size_t)c->fd) fd2conn.resize(c->fd + 1, nullptr);
                 assert(!fd2conn[c->fd]);
                 fd2conn[c->fd] = c;
+                c->wheel = &g_timers;
+                conn_idle_arm(c);
             }
         }
 
-        for (size_t i = 1; i < pfds.size(); ++i) {
+        if (pfds[1].revents) {
+            main_run_posted();
+            io_run_ready();
+        }
+
+        for (size_t i = 3; i < nconns; ++i) {
             uint32_t ready = pfds[i].revents;
             if (!ready) continue;
 
             Conn *c = fd2conn[pfds[i].fd];
             if (!c) continue;
 
-            if (ready & POLLIN)  { assert(c->want_read);  handle_read(c); }
-            if (ready & POLLOUT) { assert(c->want_write); handle_write(c); }
-            if ((ready & POLLERR) || c->want_close) {
-                (void)close(c->fd);
+            if (c->shm_on) {
+                if (ready & POLLIN) shm_bell(c);
+            } else {
+                if (ready & POLLIN)  { assert(c->want_read);  handle_read(c); }
+                if ((ready & POLLOUT) && c->want_write) handle_write(c);
+            }
+            if (conn_failed(c, ready) || c->want_close) {
+                fd2conn[c->fd] = nullptr;
+                conn_destroy(c);
+            }
+        }
+
+        // shm conns are served from their rings whatever poll() said
+        for (size_t i = 0; i < g_shm.size();) {
+            Conn *c = g_shm[i];
+            if (c->shm_on && c->want_write) handle_write(c);
+            if (c->shm_on && c->want_read && ring_used(&c->shm->hdr->c2s)) handle_read(c);
+            if (c->want_close) {
                 fd2conn[c->fd] = nullptr;
-                delete c;
+                conn_destroy(c);    // drops it from g_shm
+                continue;
             }
+            i++;
         }
+
+        serve_blocked(get_monotonic_msec());
+        serve_producing();
+        serve_backlog();
+        epoch_reclaim();
     }
     return 0;
 }
@@ -0,0 +1,291 @@
+// shmring.h
+#pragma once
+#include <atomic>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+// Shared-memory transport for clients on the same host. The client maps
+// a memfd with two single-producer single-consumer byte rings, one per
+// direction, and passes it to the server with the `shm` request over an
+// AF_UNIX socket (SCM_RIGHTS); the same length-prefixed frames then go
+// through the rings. The memfd is sealed against shrinking and growing,
+// so the client can't truncate it under the server's mapping, which
+// would make the server's next ring access fault.
+//
+// Neither side makes a syscall while the other is awake. A consumer that
+// finds its ring empty raises `reader_idle` and sleeps on the socket,
+// which from then on only carries one-byte doorbells; the producer sends
+// one if it sees the flag after publishing. A producer that finds the
+// ring full does the same with `writer_wait`. Flag and position updates
+// are seq_cst, so either the sleeper sees the new data or the other side
+// sees the flag.
+struct ShmRing {
+    alignas(64) std::atomic<uint64_t> tail{0};      // bytes ever written
+    std::atomic<uint32_t> writer_wait{0};           // producer sleeps: ring full
+    alignas(64) std::atomic<uint64_t> head{0};      // bytes ever read
+    std::atomic<uint32_t> reader_idle{0};           // consumer sleeps: ring empty
+};
+
+const uint32_t k_shm_magic = 0x31524853;    // "SHR1"
+
+struct ShmHeader {
+    uint32_t magic;
+    uint32_t ring_size;         // bytes per ring, a power of two
+    ShmRing  c2s;               // requests
+    ShmRing  s2c;               // replies
+};
+
+// One side's mapping; the ring bytes follow the header. The peer can
+// write anything into the shared header, so each side keeps its own copy
+// of the size and the ring ops clamp what they read from the other.
+struct ShmLink {
+    ShmHeader *hdr = nullptr;
+    size_t   map_size = 0;
+    uint32_t ring_size = 0;
+    uint8_t *c2s = nullptr;
+    uint8_t *s2c = nullptr;
+};
+
+inline size_t shm_map_size(uint32_t ring_size) {
+    return (sizeof(ShmHeader) + 63) / 64 * 64 + 2 * (size_t)ring_size;
+}
+
+inline void shm_link_set(ShmLink *link, void *mem, size_t size, uint32_t ring_size) {
+    link->hdr = (ShmHeader*)mem;
+    link->map_size = size;
+    link->ring_size = ring_size;
+    link->c2s = (uint8_t*)mem + (sizeof(ShmHeader) + 63) / 64 * 64;
+    link->s2c = link->c2s + link->ring_size;
+}
+
+// Client: create a sealed memfd holding a link and map it. Returns the
+// fd, to be passed with sock_send_fd() and then closed; -1 on error.
+inline int shm_create(uint32_t ring_size, ShmLink *link) {
+    if (ring_size < 4096 || (ring_size & (ring_size - 1))) return -1;
+    int fd = memfd_create("kv-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) return -1;
+    size_t size = shm_map_size(ring_size);
+    void *mem = MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) == 0
+        && fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == 0) {
+        mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (mem == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    ShmHeader *hdr = new (mem) ShmHeader();
+    hdr->ring_size = ring_size;
+    hdr->magic = k_shm_magic;
+    shm_link_set(link, mem, size, ring_size);
+    return fd;
+}
+
+// Server: map the link in `fd`, which the caller still owns. The size
+// must be sealed, or the client could shrink the file and fault us.
+inline int shm_attach(int fd, ShmLink *link) {
+    const int sealed = F_SEAL_SHRINK | F_SEAL_GROW;
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || (seals & sealed) != sealed) return -1;
+    struct stat st = {};
+    void *mem = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(ShmHeader)) {
+        mem = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (mem == MAP_FAILED) return -1;
+    const ShmHeader *hdr = (const ShmHeader*)mem;
+    uint32_t rs = hdr->ring_size;
+    if (hdr->magic != k_shm_magic || rs < 4096 || (rs & (rs - 1))
+        || shm_map_size(rs) != (size_t)st.st_size) {
+        munmap(mem, (size_t)st.st_size);
+        return -1;
+    }
+    shm_link_set(link, mem, (size_t)st.st_size, rs);
+    return 0;
+}
+
+// Client: send all of `p` on the AF_UNIX socket `sock`, with `fd`
+// attached to the first byte. Blocking; false on error.
+inline bool sock_send_fd(int sock, const void *p, size_t n, int fd) {
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } ctl = {};
+    struct iovec iov = {(void*)p, n};
+    struct msghdr mh = {};
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = ctl.buf;
+    mh.msg_controllen = sizeof(ctl.buf);
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cm), &fd, sizeof(int));
+    ssize_t rv = sendmsg(sock, &mh, MSG_NOSIGNAL);
+    if (rv <= 0) return false;
+    for (size_t done = (size_t)rv; done < n; done += (size_t)rv) {
+        rv = send(sock, (const char*)p + done, n - done, MSG_NOSIGNAL);
+        if (rv <= 0) return false;
+    }
+    return true;
+}
+
+// Server: read() from an AF_UNIX socket, also taking a fd passed with
+// the bytes. It replaces `*fd`, closing the one there before.
+inline ssize_t sock_recv_fd(int sock, void *p, size_t n, int *fd) {
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } ctl;
+    struct iovec iov = {p, n};
+    struct msghdr mh = {};
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = ctl.buf;
+    mh.msg_controllen = sizeof(ctl.buf);
+    ssize_t rv = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+    if (rv < 0) return rv;
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&mh); cm; cm = CMSG_NXTHDR(&mh, cm)) {
+        if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) continue;
+        if (cm->cmsg_len != CMSG_LEN(sizeof(int))) continue;
+        if (*fd >= 0) close(*fd);
+        memcpy(fd, CMSG_DATA(cm), sizeof(int));
+    }
+    return rv;
+}
+
+inline void shm_detach(ShmLink *link) {
+    if (link->hdr) munmap(link->hdr, link->map_size);
+    *link = ShmLink();
+}
+
+// ------------------------- ring ops -------------------------
+inline size_t ring_used(const ShmRing *r) {
+    return (size_t)(r->tail.load(std::memory_order_seq_cst)
+                    - r->head.load(std::memory_order_seq_cst));
+}
+
+// Producer: copy in as much of `p` as fits; returns the bytes taken.
+inline size_t ring_push(ShmRing *r, uint8_t *data, uint32_t size, const void *p, size_t n) {
+    uint64_t tail = r->tail.load(std::memory_order_relaxed);
+    uint64_t head = r->head.load(std::memory_order_acquire);
+    size_t used = (size_t)(tail - head);
+    size_t room = used < size ? size - used : 0;
+    if (n > room) n = room;
+    size_t at = (size_t)(tail & (size - 1));
+    size_t first = n < size - at ? n : size - at;
+    memcpy(data + at, p, first);
+    memcpy(data, (const uint8_t*)p + first, n - first);
+    r->tail.store(tail + n, std::memory_order_seq_cst);
+    return n;
+}
+
+// Consumer: copy out up to `n` bytes; returns the bytes taken.
+inline size_t ring_pop(ShmRing *r, const uint8_t *data, uint32_t size, void *p, size_t n) {
+    uint64_t head = r->head.load(std::memory_order_relaxed);
+    uint64_t tail = r->tail.load(std::memory_order_acquire);
+    size_t used = (size_t)(tail - head);
+    if (used > size) used = size;
+    if (n > used) n = used;
+    size_t at = (size_t)(head & (size - 1));
+    size_t first = n < size - at ? n : size - at;
+    memcpy(p, data + at, first);
+    memcpy((uint8_t*)p + first, data, n - first);
+    r->head.store(head + n, std::memory_order_seq_cst);
+    return n;
+}
+
+// Consumer about to sleep; false if data came in meanwhile.
+inline bool ring_reader_sleep(ShmRing *r) {
+    r->reader_idle.store(1, std::memory_order_seq_cst);
+    if (ring_used(r)) {
+        r->reader_idle.store(0, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+// Producer about to sleep; false if room was made meanwhile.
+inline bool ring_writer_sleep(ShmRing *r, uint32_t size) {
+    r->writer_wait.store(1, std::memory_order_seq_cst);
+    if (ring_used(r) < size) {
+        r->writer_wait.store(0, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+// After a push: true if the consumer sleeps and needs a doorbell.
+inline bool ring_wake_reader(ShmRing *r) {
+    return r->reader_idle.load(std::memory_order_seq_cst)
+        && r->reader_idle.exchange(0, std::memory_order_seq_cst);
+}
+
+// After a pop: true if the producer sleeps and needs a doorbell.
+inline bool ring_wake_writer(ShmRing *r) {
+    return r->writer_wait.load(std::memory_order_seq_cst)
+        && r->writer_wait.exchange(0, std::memory_order_seq_cst);
+}
+
+// ------------------- client side, blocking -------------------
+const int k_shm_spin = 20000;   // ring checks before sleeping on the socket
+
+inline bool shm_doorbell(int fd) {
+    uint8_t one = 1;
+    return write(fd, &one, 1) == 1 || errno == EAGAIN;
+}
+
+// Sleep until a doorbell (or anything) arrives on `fd`; false on EOF.
+inline bool shm_wait(int fd) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, -1) < 0) return errno == EINTR;
+    uint8_t buf[64];
+    ssize_t rv = read(fd, buf, sizeof(buf));
+    return rv > 0 || (rv < 0 && (errno == EAGAIN || errno == EINTR));
+}
+
+inline bool shm_send_all(ShmLink *link, int fd, const void *p, size_t n) {
+    ShmRing *r = &link->hdr->c2s;
+    uint32_t size = link->ring_size;
+    const uint8_t *cur = (const uint8_t*)p;
+    for (int spins = 0; n;) {
+        size_t k = ring_push(r, link->c2s, size, cur, n);
+        if (k && ring_wake_reader(r) && !shm_doorbell(fd)) return false;
+        cur += k;
+        n -= k;
+        if (k) {
+            spins = 0;
+        } else if (++spins > k_shm_spin && ring_writer_sleep(r, size)) {
+            if (!shm_wait(fd)) return false;
+        }
+    }
+    return true;
+}
+
+inline bool shm_recv_all(ShmLink *link, int fd, void *p, size_t n) {
+    ShmRing *r = &link->hdr->s2c;
+    uint32_t size = link->ring_size;
+    uint8_t *cur = (uint8_t*)p;
+    for (int spins = 0; n;) {
+        size_t k = ring_pop(r, link->s2c, size, cur, n);
+        if (k && ring_wake_writer(r) && !shm_doorbell(fd)) return false;
+        cur += k;
+        n -= k;
+        if (k) {
+            spins = 0;
+        } else if (++spins > k_shm_spin && ring_reader_sleep(r)) {
+            if (!shm_wait(fd)) return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,250 @@
+// stream.cpp
+#include "stream.h"
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+// block is sealed once either limit is reached
+const size_t   k_block_max_bytes   = 4096;
+const uint32_t k_block_max_entries = 128;
+
+// ------------------------- ID helpers --------------------------
+
+static bool parse_u64(const char *s, size_t n, uint64_t &out) {
+    if (n == 0 || n > 20) return false;
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (s[i] < '0' || s[i] > '9') return false;
+        uint64_t d = (uint64_t)(s[i] - '0');
+        if (v > (UINT64_MAX - d) / 10) return false;
+        v = v * 10 + d;
+    }
+    out = v;
+    return true;
+}
+
+bool streamid_parse(const char *s, size_t n, uint64_t dflt_seq, StreamID &out) {
+    const char *dash = (const char*)memchr(s, '-', n);
+    if (!dash) {
+        out.seq = dflt_seq;
+        return parse_u64(s, n, out.ms);
+    }
+    size_t nms = (size_t)(dash - s);
+    return parse_u64(s, nms, out.ms)
+        && parse_u64(dash + 1, n - nms - 1, out.seq);
+}
+
+std::string streamid_fmt(const StreamID &id) {
+    char buf[48];
+    int n = snprintf(buf, sizeof(buf), "%llu-%llu",
+                     (unsigned long long)id.ms, (unsigned long long)id.seq);
+    return std::string(buf, (size_t)n);
+}
+
+// --------------------------- varint ----------------------------
+
+static void put_varint(std::vector<uint8_t> &b, uint64_t v) {
+    while (v >= 0x80) {
+        b.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    b.push_back((uint8_t)v);
+}
+
+static uint64_t get_varint(const uint8_t *&p) {
+    uint64_t v = 0;
+    for (int shift = 0;; shift += 7) {
+        uint8_t c = *p++;
+        v |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) return v;
+    }
+}
+
+// -------------------------- blocks -----------------------------
+
+static StreamBlock *blk_of(AVLNode *n) {
+    return n ? container_of(n, StreamBlock, tree) : nullptr;
+}
+
+static bool blk_less(AVLNode *lhs, AVLNode *rhs) {
+    return streamid_cmp(blk_of(lhs)->first, blk_of(rhs)->first) < 0;
+}
+
+// Decode one entry header at `p`; leaves `p` at the first string.
+static void blk_decode_id(const StreamBlock *blk, const uint8_t *&p, StreamID &id) {
+    uint64_t dms  = get_varint(p);
+    uint64_t dseq = get_varint(p);
+    id.ms  = blk->master.ms + dms;
+    id.seq = dms == 0 ? blk->master.seq + dseq : dseq;
+}
+
+// Skip over the entry at `p`, returning its ID.
+static const uint8_t *blk_skip(const StreamBlock *blk, const uint8_t *p, StreamID &id) {
+    blk_decode_id(blk, p, id);
+    uint64_t nstr = get_varint(p);
+    for (uint64_t i = 0; i < nstr; ++i) {
+        p += get_varint(p);
+    }
+    return p;
+}
+
+static void blk_remove(Stream *s, StreamBlock *blk) {
+    s->root = avl_del(&blk->tree);
+    s->nblocks--;
+    s->bytes -= blk->data.size();
+    if (s->tail == blk) s->tail = nullptr;
+    delete blk;
+}
+
+// Drop the first live entry of a block that keeps at least one more.
+static void blk_pop_front(Stream *s, StreamBlock *blk) {
+    assert(blk->count > 1);
+    StreamID id;
+    const uint8_t *base = blk->data.data();
+    const uint8_t *p = blk_skip(blk, base + blk->start, id);
+    blk->start = (uint32_t)(p - base);
+    blk->count--;
+    blk_decode_id(blk, p, blk->first);
+    s->length--;
+}
+
+// ------------------------- stream API --------------------------
+
+void stream_init(Stream *s) {
+    s->root = nullptr;
+    s->tail = nullptr;
+    s->length = s->nblocks = s->bytes = 0;
+    s->last_id = StreamID();
+}
+
+void stream_clear(Stream *s) {
+    while (s->root) {
+        blk_remove(s, blk_of(s->root));
+    }
+    stream_init(s);
+}
+
+bool stream_append(Stream *s, const StreamID &id,
+                   const std::vector<std::string> &strs) {
+    if (streamid_cmp(id, s->last_id) <= 0) return false;  // 0-0 is never valid
+    StreamBlock *blk = s->tail;
+    if (!blk || blk->data.size() >= k_block_max_bytes
+             || blk->total >= k_block_max_entries) {
+        blk = new StreamBlock();
+        blk->master = blk->first = id;
+        avl_search_and_insert(&s->root, &blk->tree, &blk_less);
+        s->tail = blk;
+        s->nblocks++;
+    }
+
+    size_t before = blk->data.size();
+    uint64_t dms = id.ms - blk->master.ms;
+    put_varint(blk->data, dms);
+    put_varint(blk->data, dms == 0 ? id.seq - blk->master.seq : id.seq);
+    put_varint(blk->data, strs.size());
+    for (const std::string &str : strs) {
+        put_varint(blk->data, str.size());
+        blk->data.insert(blk->data.end(), str.begin(), str.end());
+    }
+    s->bytes += blk->data.size() - before;
+
+    blk->last = id;
+    blk->count++;
+    blk->total++;
+    s->length++;
+    s->last_id = id;
+    return true;
+}
+
+size_t stream_trim_maxlen(Stream *s, uint64_t maxlen) {
+    size_t removed = 0;
+    while (s->length > maxlen) {
+        StreamBlock *blk = blk_of(avl_first(s->root));
+        uint64_t excess = s->length - maxlen;
+        if (blk->count <= excess) {
+            s->length -= blk->count;
+            removed += blk->count;
+            blk_remove(s, blk);
+        } else {
+            blk_pop_front(s, blk);
+            removed++;
+        }
+    }
+    return removed;
+}
+
+size_t stream_trim_minid(Stream *s, const StreamID &minid) {
+    size_t removed = 0;
+    while (StreamBlock *blk = blk_of(avl_first(s->root))) {
+        if (streamid_cmp(blk->first, minid) >= 0) break;
+        if (streamid_cmp(blk->last, minid) < 0) {
+            s->length -= blk->count;
+            removed += blk->count;
+            blk_remove(s, blk);
+        } else {
+            // the block keeps its last entry at least
+            blk_pop_front(s, blk);
+            removed++;
+        }
+    }
+    return removed;
+}
+
+void stream_seek(Stream *s, const StreamID &start, StreamIter *it) {
+    // last block whose first ID <= start
+    AVLNode *found = nullptr;
+    for (AVLNode *cur = s->root; cur;) {
+        if (streamid_cmp(blk_of(cur)->first, start) <= 0) {
+            found = cur;
+            cur = cur->right;
+        } else {
+            cur = cur->left;
+        }
+    }
+    if (!found) found = avl_first(s->root);
+
+    it->blk = blk_of(found);
+    it->off = it->blk ? it->blk->start : 0;
+    it->idx = 0;
+    if (it->blk && streamid_cmp(it->blk->last, start) < 0) {
+        // everything here is older; the next block starts after `start`
+        it->blk = blk_of(avl_next(found));
+        it->off = it->blk ? it->blk->start : 0;
+        return;
+    }
+    // skip older entries inside the block (sequential scan)
+    while (it->blk && it->idx < it->blk->count) {
+        const uint8_t *base = it->blk->data.data();
+        const uint8_t *p = base + it->off;
+        StreamID id;
+        blk_decode_id(it->blk, p, id);
+        if (streamid_cmp(id, start) >= 0) break;
+        it->off = (uint32_t)(blk_skip(it->blk, base + it->off, id) - base);
+        it->idx++;
+    }
+}
+
+bool stream_next(StreamIter *it, StreamEntry *ent) {
+    while (it->blk && it->idx >= it->blk->count) {
+        it->blk = blk_of(avl_next(&it->blk->tree));
+        it->off = it->blk ? it->blk->start : 0;
+        it->idx = 0;
+    }
+    if (!it->blk) return false;
+
+    const uint8_t *base = it->blk->data.data();
+    const uint8_t *p = base + it->off;
+    blk_decode_id(it->blk, p, ent->id);
+    ent->nstr = (uint32_t)get_varint(p);
+    ent->strs = p;
+    StreamID skipped;
+    it->off = (uint32_t)(blk_skip(it->blk, base + it->off, skipped) - base);
+    it->idx++;
+    return true;
+}
+
+void streamentry_str(const uint8_t *&p, const char **str, size_t *len) {
+    *len = (size_t)get_varint(p);
+    *str = (const char*)p;
+    p += *len;
+}
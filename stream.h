@@ -0,0 +1,75 @@
+// stream.h
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "avl.h"
+
+// 128-bit entry ID: milliseconds + sequence number
+struct StreamID {
+    uint64_t ms  = 0;
+    uint64_t seq = 0;
+};
+
+inline int streamid_cmp(const StreamID &a, const StreamID &b) {
+    if (a.ms != b.ms)   return a.ms < b.ms ? -1 : 1;
+    if (a.seq != b.seq) return a.seq < b.seq ? -1 : 1;
+    return 0;
+}
+
+// "<ms>-<seq>" or "<ms>" (seq defaults to `dflt_seq`)
+bool streamid_parse(const char *s, size_t n, uint64_t dflt_seq, StreamID &out);
+std::string streamid_fmt(const StreamID &id);
+
+// Packed block of consecutive entries. Entries are encoded relative to
+// the block's master ID, so each one costs a few bytes of framing:
+//   varint(ms - master.ms) varint(seq') varint(nstr) { varint(len) bytes }*
+// where seq' = seq - master.seq if the ms matches the master, else seq.
+struct StreamBlock {
+    AVLNode  tree;          // index by `first`
+    StreamID master;        // delta base, fixed for the block's lifetime
+    StreamID first;         // first live entry
+    StreamID last;          // last entry
+    uint32_t start = 0;     // byte offset of the first live entry
+    uint32_t count = 0;     // number of live entries
+    uint32_t total = 0;     // number of encoded entries
+    std::vector<uint8_t> data;
+};
+
+struct Stream {
+    AVLNode     *root = nullptr;    // blocks keyed by first ID
+    StreamBlock *tail = nullptr;    // newest block, target of appends
+    uint64_t     length  = 0;       // live entries
+    uint64_t     nblocks = 0;
+    uint64_t     bytes   = 0;       // encoded payload bytes
+    StreamID     last_id;           // IDs must be strictly increasing
+};
+
+void   stream_init(Stream *s);
+void   stream_clear(Stream *s);
+
+// `strs` holds field/value pairs. Returns false if `id` <= last_id.
+bool   stream_append(Stream *s, const StreamID &id,
+                     const std::vector<std::string> &strs);
+// Drop entries from the front; returns the number removed.
+size_t stream_trim_maxlen(Stream *s, uint64_t maxlen);
+size_t stream_trim_minid(Stream *s, const StreamID &minid);
+
+// Forward iteration over entries
+struct StreamEntry {
+    StreamID       id;
+    uint32_t       nstr = 0;
+    const uint8_t *strs = nullptr;  // decode with streamentry_str()
+};
+struct StreamIter {
+    StreamBlock *blk = nullptr;
+    uint32_t     off = 0;
+    uint32_t     idx = 0;           // entries consumed in `blk`
+};
+
+// Position `it` at the first entry with ID >= `start`.
+void   stream_seek(Stream *s, const StreamID &start, StreamIter *it);
+bool   stream_next(StreamIter *it, StreamEntry *ent);
+// Decode the next string of an entry, advancing `p`.
+void   streamentry_str(const uint8_t *&p, const char **str, size_t *len);
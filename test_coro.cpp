@@ -0,0 +1,58 @@
+// test_coro.cpp
+#include <cassert>
+#include <cstdio>
+#include "coro.h"
+
+struct Guard {
+    int *dtors;
+    ~Guard() { (*dtors)++; }
+};
+
+static Sliced count_to(uint64_t n, uint64_t *out, int *dtors) {
+    Guard g = {dtors};
+    for (uint64_t i = 0; i < n; ++i) {
+        (*out)++;
+        co_await slice_yield();
+    }
+}
+
+int main() {
+    // finishes inside the first slice
+    g_slice_budget_us = 1000000;
+    uint64_t n = 0;
+    int dtors = 0;
+    slice_begin();
+    Sliced t = count_to(1000, &n, &dtors);
+    assert(t.done() && n == 1000 && dtors == 1);   // locals go at the end
+    t.reset();
+    assert(dtors == 1);
+
+    // a zero budget stops at every clock check
+    g_slice_budget_us = 0;
+    n = 0;
+    slice_begin();
+    t = count_to(10 * k_slice_check, &n, &dtors);
+    int slices = 1;
+    while (!t.done()) {
+        assert(n % k_slice_check == 0);
+        slice_begin();
+        t.resume();
+        slices++;
+    }
+    assert(n == 10 * k_slice_check);
+    assert(slices == 11);   // the last resume only leaves the loop
+
+    // destroying a suspended handler unwinds its locals
+    n = 0;
+    dtors = 0;
+    slice_begin();
+    t = count_to(1000, &n, &dtors);
+    assert(!t.done() && n == k_slice_check && dtors == 0);
+    Sliced moved = std::move(t);
+    assert(!t && moved);
+    moved.reset();
+    assert(dtors == 1);
+
+    std::puts("OK");
+    return 0;
+}
@@ -0,0 +1,153 @@
+// test_epoch.cpp
+#include <cassert>
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "epoch.h"
+#include "hashtable.h"
+
+struct Item {
+    HNode    node;
+    uint64_t key;
+    uint64_t check;     // always key * 3 while reachable
+};
+
+static bool item_eq(HNode *lhs, HNode *rhs) {
+    return container_of(lhs, Item, node)->key == container_of(rhs, Item, node)->key;
+}
+
+static uint64_t hash_u64(uint64_t k) {
+    return str_hash((const uint8_t*)&k, sizeof(k));
+}
+
+static void item_free(void *arg) {
+    Item *it = (Item*)arg;
+    it->check = 0;      // a reader that still held it would notice
+    delete it;
+}
+
+int main() {
+    const size_t   kReaders = 3;
+    const uint64_t kKeys    = 20000;
+    epoch_init(kReaders);
+
+    HMap map;
+    hm_init(&map);
+    map.free_slots = [](void *p) { epoch_retire(&free, p); };
+
+    // keys below kKeys/2 are never deleted; readers must always find them
+    for (uint64_t k = 0; k < kKeys / 2; ++k) {
+        Item *it = new Item();
+        it->key = k;
+        it->check = k * 3;
+        it->node.hcode = hash_u64(k);
+        hm_insert(&map, &it->node);
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> flushing{0};  // odd while the map is being refilled
+    std::atomic<uint64_t> lookups{0};
+    std::vector<std::thread> readers;
+    for (size_t id = 0; id < kReaders; ++id) {
+        readers.emplace_back([&, id]() {
+            uint64_t k = id;
+            uint64_t n = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                k = (k * 6364136223846793005ull + 1442695040888963407ull);
+                Item key;
+                key.key = (k >> 33) % kKeys;
+                key.node.hcode = hash_u64(key.key);
+                uint64_t f = flushing.load(std::memory_order_acquire);
+                epoch_enter(id);
+                HNode *node = hm_lookup_concurrent(&map, &key.node, &item_eq);
+                if (node) {
+                    Item *it = container_of(node, Item, node);
+                    assert(it->key == key.key && it->check == key.key * 3);
+                }
+                epoch_exit(id);
+                if (!node && key.key < kKeys / 2) {
+                    // only a refill in progress can hide a lower-half key
+                    assert((f & 1) || flushing.load(std::memory_order_acquire) != f);
+                }
+                n++;
+            }
+            lookups += n;
+        });
+    }
+
+    // writer: churn the upper half, replace items, and force regrowth
+    std::vector<Item*> live(kKeys, nullptr);
+    for (int round = 0; round < 40; ++round) {
+        for (uint64_t k = kKeys / 2; k < kKeys; ++k) {
+            Item *it = new Item();
+            it->key = k;
+            it->check = k * 3;
+            it->node.hcode = hash_u64(k);
+            if (live[k]) {
+                hm_replace(&map, &live[k]->node, &it->node);
+                epoch_retire(&item_free, live[k]);
+            } else {
+                hm_insert(&map, &it->node);
+            }
+            live[k] = it;
+        }
+        epoch_reclaim();
+        for (uint64_t k = kKeys / 2; k < kKeys; k += 2) {
+            Item key;
+            key.key = k;
+            key.node.hcode = hash_u64(k);
+            HNode *node = hm_delete(&map, &key.node, &item_eq);
+            assert(node == &live[k]->node);
+            epoch_retire(&item_free, live[k]);
+            live[k] = nullptr;
+        }
+        epoch_reclaim();
+        if (round % 10 == 9) {
+            // move everything out and back in, growing from the smallest
+            // table again while readers run
+            flushing++;
+            HMap old;
+            hm_take(&map, &old);
+            std::vector<HNode*> nodes;
+            for (HTab *t : {&old.newer, &old.older}) {
+                for (size_t i = 0; t->tab && i <= t->mask; ++i) {
+                    for (HNode *n = t->tab[i]; n; n = n->next) nodes.push_back(n);
+                }
+            }
+            // readers may still be on the old nodes: insert copies
+            for (HNode *n : nodes) {
+                Item *src = container_of(n, Item, node);
+                Item *it = new Item();
+                it->key = src->key;
+                it->check = src->check;
+                it->node.hcode = src->node.hcode;
+                hm_insert(&map, &it->node);
+                if (it->key >= kKeys / 2) live[it->key] = it;
+                epoch_retire(&item_free, src);
+            }
+            flushing++;
+            HMap *dead = new HMap(old);
+            epoch_retire([](void *p) { hm_destroy((HMap*)p); delete (HMap*)p; }, dead);
+        }
+    }
+    stop = true;
+    for (std::thread &t : readers) t.join();
+
+    for (HTab *t : {&map.newer, &map.older}) {
+        for (size_t i = 0; t->tab && i <= t->mask; ++i) {
+            for (HNode *n = t->tab[i]; n;) {
+                HNode *next = n->next;
+                delete container_of(n, Item, node);
+                n = next;
+            }
+        }
+    }
+    hm_destroy(&map);
+    epoch_reclaim();
+    assert(epoch_pending() == 0);
+
+    std::printf("%llu concurrent lookups\n", (unsigned long long)lookups.load());
+    std::puts("OK");
+    return 0;
+}
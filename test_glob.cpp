@@ -0,0 +1,87 @@
+// test_glob.cpp
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <fnmatch.h>
+#include <sys/mman.h>
+#include "glob.h"
+
+static bool gmatch(const std::string &pat, const std::string &s) {
+    GlobPattern g;
+    glob_compile(pat.data(), pat.size(), &g);
+    return glob_match(&g, s.data(), s.size());
+}
+
+int main() {
+    std::mt19937_64 rng{12345};
+
+    // substring search agrees with std::string::find; the key sits in an
+    // allocation of exactly its size, so ASan catches reads past it
+    for (int iter = 0; iter < 200000; ++iter) {
+        std::string hay(rng() % 80, 'a');
+        for (char &c : hay) c = "abc"[rng() % 3];
+        std::string needle(1 + rng() % 6, 'a');
+        for (char &c : needle) c = "abc"[rng() % 3];
+        size_t want = hay.find(needle);
+        char *key = new char[hay.size()];
+        memcpy(key, hay.data(), hay.size());
+        int64_t got = glob_find(key, hay.size(), needle.data(), needle.size());
+        delete[] key;
+        assert(got == (want == std::string::npos ? -1 : (int64_t)want));
+    }
+
+    // strings that end right at a page boundary must not fault
+    char *page = (char*)mmap(nullptr, 8192, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(page != MAP_FAILED);
+    assert(mprotect(page + 4096, 4096, PROT_NONE) == 0);
+    for (size_t n = 1; n <= 64; ++n) {
+        char *s = page + 4096 - n;
+        memset(s, 'x', n);
+        s[n - 1] = 'y';
+        assert(glob_find(s, n, "xy", 2) == (n >= 2 ? (int64_t)n - 2 : -1));
+        assert(glob_find(s, n, "yx", 2) == -1);
+    }
+
+    // hand-picked cases
+    assert(gmatch("*", ""));
+    assert(gmatch("user:*", "user:123"));
+    assert(!gmatch("user:*", "users:1"));
+    assert(gmatch("*:session", "u:1:session"));
+    assert(gmatch("h?llo", "hello") && !gmatch("h?llo", "hllo"));
+    assert(gmatch("h[ae]llo", "hallo") && !gmatch("h[ae]llo", "hillo"));
+    assert(gmatch("h[^e]llo", "hallo") && !gmatch("h[^e]llo", "hello"));
+    assert(gmatch("h[a-b]llo", "hbllo") && gmatch("h[b-a]llo", "hallo"));
+    assert(gmatch("a\\*b", "a*b") && !gmatch("a\\*b", "axb"));
+    assert(gmatch("*abc*abc*", "xxabcxxabc") && !gmatch("*abc*abc*", "xxabcxx"));
+    assert(!gmatch("a*a", "a"));
+
+    // random patterns against libc fnmatch
+    const char alpha[] = "ab:*?[]^-";
+    for (int iter = 0; iter < 200000; ++iter) {
+        std::string pat;
+        size_t plen = rng() % 8;
+        for (size_t i = 0; i < plen; ++i) {
+            char c = alpha[rng() % (sizeof(alpha) - 1)];
+            if (c == '[') {
+                pat += (rng() % 2) ? "[^a-b]" : "[a:]";
+            } else if (c == ']' || c == '^' || c == '-') {
+                pat += 'b';
+            } else {
+                pat += c;
+            }
+        }
+        std::string s;
+        size_t slen = rng() % 10;
+        for (size_t i = 0; i < slen; ++i) s += "ab:c"[rng() % 4];
+        bool want = fnmatch(pat.c_str(), s.c_str(), 0) == 0;
+        if (gmatch(pat, s) != want) {
+            std::printf("mismatch: pattern '%s' key '%s'\n", pat.c_str(), s.c_str());
+            return 1;
+        }
+    }
+    std::puts("OK");
+    return 0;
+}
@@ -0,0 +1,49 @@
+// test_hashtable.cpp
+#include <cassert>
+#include <cstdio>
+#include <vector>
+#include "hashtable.h"
+
+struct Item {
+    HNode node;
+    uint64_t key = 0;
+};
+
+static bool item_eq(HNode *a, HNode *b) {
+    return container_of(a, Item, node)->key == container_of(b, Item, node)->key;
+}
+
+static Item *find(HMap *m, uint64_t key) {
+    Item probe;
+    probe.key = key;
+    probe.node.hcode = key * 0x9e3779b97f4a7c15ull;
+    HNode *n = hm_lookup(m, &probe.node, &item_eq);
+    return n ? container_of(n, Item, node) : nullptr;
+}
+
+int main() {
+    // past several resizes, with lookups, inserts and deletes landing
+    // while a resize is still draining the old table
+    const uint64_t N = 100000;
+    std::vector<Item> items(N);
+    HMap m;
+    hm_init(&m);
+    for (uint64_t i = 0; i < N; ++i) {
+        items[i].key = i;
+        items[i].node.hcode = i * 0x9e3779b97f4a7c15ull;
+        hm_insert(&m, &items[i].node);
+        assert(find(&m, i) == &items[i]);
+        if (i % 7 == 0) assert(find(&m, i / 2) == &items[i / 2]);
+    }
+    for (uint64_t i = 0; i < N; i += 2) {
+        Item probe;
+        probe.key = i;
+        probe.node.hcode = items[i].node.hcode;
+        assert(hm_delete(&m, &probe.node, &item_eq) == &items[i].node);
+    }
+    for (uint64_t i = 0; i < N; ++i) assert(find(&m, i) == (i % 2 ? &items[i] : nullptr));
+    assert(m.newer.size + m.older.size == N / 2);
+    hm_destroy(&m);
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,146 @@
+// test_pool.cpp
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include "pool.h"
+
+static uint64_t g_rng = 88172645463325252ull;
+static uint64_t rnd() {
+    g_rng ^= g_rng << 13; g_rng ^= g_rng >> 7; g_rng ^= g_rng << 17;
+    return g_rng;
+}
+
+int main() {
+    // buffers come back with their capacity and go out again
+    Bytes a;
+    pool_take(a, 100);
+    assert(a.capacity() >= k_pool_min && a.empty());
+    a.resize(3000, 7);
+    const uint8_t *mem = a.data();
+    pool_give(a);
+    assert(a.capacity() == 0 && pool_bytes() >= k_pool_min);
+    Bytes b;
+    pool_take(b, 4000);
+    assert(b.data() == mem && b.empty());   // the same buffer, emptied
+
+    // a buffer grown past its class is filed under the class it covers
+    b.resize(70000);
+    size_t cap = b.capacity();
+    pool_give(b);
+    Bytes c;
+    pool_take(c, 65536);
+    assert(c.capacity() == cap);
+    pool_give(c);
+
+    // too small or too big to keep
+    size_t before = pool_bytes();
+    Bytes tiny(10);
+    pool_give(tiny);
+    Bytes huge(8u << 20);
+    pool_give(huge);
+    assert(tiny.capacity() == 0 && huge.capacity() == 0 && pool_bytes() == before);
+
+    // each class keeps at most k_pool_keep bytes
+    std::vector<Bytes> many(2 * k_pool_keep / k_pool_min);
+    for (auto &v : many) pool_take(v, 1);
+    for (auto &v : many) pool_give(v);
+    assert(pool_bytes() <= k_pool_classes * k_pool_keep);
+
+    // every thread has its own pool, and all of them are counted
+    std::thread([before = pool_bytes()] {
+        Bytes v;
+        pool_take(v, 1);
+        pool_give(v);
+        assert(pool_bytes() == before + k_pool_min);
+    }).join();
+
+    // growing moves the contents to a bigger pooled buffer
+    Bytes g;
+    pool_reserve(g, 10);
+    g.assign(4000, 5);
+    pool_reserve(g, 100000);
+    assert(g.capacity() >= 104000 && g.size() == 4000 && g[3999] == 5);
+    pool_reserve(g, 10);    // room enough: no move
+    assert(g.capacity() >= 104000);
+    pool_give(g);
+
+    // RawAlloc constructs with a value when given one; growing without
+    // one leaves the bytes indeterminate, so there is nothing to check
+    RawAlloc<uint8_t> ra;
+    uint8_t byte = 0;
+    ra.construct(&byte, (uint8_t)0xab);
+    assert(byte == 0xab);
+    Bytes raw;
+    pool_take(raw, 1);
+    raw.resize(100, 0xab);
+    raw.resize(200);
+    assert(raw.size() == 200 && raw[99] == 0xab);
+    pool_give(raw);
+
+    // an upload read in 64 KB pieces, some short: capacity stays within
+    // about twice what is in, and the time is linear in the size (zeroing
+    // the spare capacity on every read made it quadratic)
+    auto upload = [](size_t total) {
+        const size_t piece = 64 * 1024;
+        std::string val;
+        auto t0 = std::chrono::steady_clock::now();
+        while (val.size() < total) {
+            size_t left = total - val.size();
+            size_t n = std::min(left, piece);
+            char *p = str_read_room(val, n, left);
+            size_t got = rnd() % 4 ? n : 1 + rnd() % n;
+            memset(p, 'u', got);
+            val.resize(val.size() - n + got);
+            assert(val.capacity() <= 2 * (val.size() + piece));
+        }
+        assert(val.size() == total && val[total / 2] == 'u');
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    };
+    double small = upload(32u << 20);
+    double big = upload(128u << 20);
+    assert(big < 8 * small + 0.05);
+
+    // Queue against std::deque
+    Queue<std::string> q;
+    std::deque<std::string> model;
+    for (int i = 0; i < 200000; ++i) {
+        uint64_t r = rnd() % 10;
+        if (r < 5) {
+            std::string s = std::to_string(rnd());
+            q.push_back(s);
+            model.push_back(s);
+        } else if (r < 9 && !model.empty()) {
+            assert(q.front() == model.front());
+            q.pop_front();
+            model.pop_front();
+        } else if (!model.empty()) {
+            assert(q.back() == model.back());
+            q.pop_back();
+            model.pop_back();
+        }
+        assert(q.size() == model.size() && q.empty() == model.empty());
+        if (!model.empty()) {
+            size_t k = rnd() % model.size();
+            assert(q[k] == model[k]);
+        }
+        if (model.empty()) assert(q.items.capacity() == 0);    // nothing held
+    }
+    size_t n = 0;
+    for (const std::string &s : q) assert(s == model[n++]);
+    assert(n == model.size());
+
+    // popping lets go of what the element held right away
+    Queue<std::shared_ptr<int>> refs;
+    auto p = std::make_shared<int>(1);
+    refs.push_back(p);
+    refs.push_back(std::make_shared<int>(2));
+    refs.pop_front();
+    assert(p.use_count() == 1 && *refs.front() == 2);
+
+    std::puts("OK");
+    return 0;
+}
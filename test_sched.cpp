@@ -0,0 +1,72 @@
+// test_sched.cpp
+#include <cassert>
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "sched.h"
+
+static void wait_for(std::atomic<size_t> &n, size_t want) {
+    while (n.load() != want) std::this_thread::yield();
+}
+
+int main() {
+    sched_start(4);
+    assert(sched_workers() == 4);
+
+    // every index is visited exactly once, in ranges no larger than grain
+    const size_t n = 1000003;
+    std::vector<std::atomic<uint8_t>> seen(n);
+    std::atomic<size_t> visited{0};
+    std::atomic<size_t> too_big{0};
+    sched_parallel_for(0, n, 1000, [&](size_t lo, size_t hi) {
+        if (hi - lo > 1000) too_big++;
+        for (size_t i = lo; i < hi; ++i) seen[i]++;
+        visited += hi - lo;
+    });
+    wait_for(visited, n);
+    assert(too_big == 0);
+    for (size_t i = 0; i < n; ++i) assert(seen[i] == 1);
+
+    // tasks that submit tasks, from inside the pool and from outside
+    std::atomic<size_t> leaves{0};
+    for (int r = 0; r < 100; ++r) {
+        sched_submit([&]() {
+            for (int k = 0; k < 10; ++k) {
+                sched_submit([&]() { leaves++; });
+            }
+        });
+    }
+    wait_for(leaves, 1000);
+
+    // empty and single-element ranges
+    std::atomic<size_t> one{0};
+    sched_parallel_for(5, 5, 10, [&](size_t, size_t) { one += 100; });
+    sched_parallel_for(7, 8, 0, [&](size_t lo, size_t hi) { one += hi - lo; });
+    wait_for(one, 1);
+
+    // uneven work gets spread: a worker stuck on a slow range doesn't
+    // hold up the rest
+    std::atomic<size_t> done{0};
+    sched_parallel_for(0, 64, 1, [&](size_t lo, size_t hi) {
+        if (lo == 0) std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        done += hi - lo;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    assert(done.load() == 63);
+    wait_for(done, 64);
+
+    // outside threads submitting while the workers steal from each other
+    std::atomic<size_t> storm{0};
+    std::vector<std::thread> subs;
+    for (int t = 0; t < 8; ++t) {
+        subs.emplace_back([&]() {
+            for (int k = 0; k < 20000; ++k) sched_submit([&]() { storm++; });
+        });
+    }
+    for (std::thread &t : subs) t.join();
+    wait_for(storm, 8 * 20000);
+
+    std::puts("OK");
+    return 0;
+}
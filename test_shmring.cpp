@@ -0,0 +1,113 @@
+// test_shmring.cpp
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "shmring.h"
+
+// Server side of the test: echo c2s back on s2c, buffering like the
+// server does, and sleeping on the socket whenever it can't make
+// progress.
+static void echo(ShmLink *l, int fd, size_t total) {
+    ShmHeader *h = l->hdr;
+    std::string pending;
+    size_t done = 0;
+    while (done < total) {
+        uint8_t buf[1000];
+        size_t k = ring_pop(&h->c2s, l->c2s, l->ring_size, buf, sizeof(buf));
+        if (k && ring_wake_writer(&h->c2s)) shm_doorbell(fd);
+        pending.append((const char*)buf, k);
+        bool moved = k > 0;
+        if (!pending.empty()) {
+            k = ring_push(&h->s2c, l->s2c, l->ring_size, pending.data(), pending.size());
+            if (k && ring_wake_reader(&h->s2c)) shm_doorbell(fd);
+            pending.erase(0, k);
+            done += k;
+            moved |= k > 0;
+        }
+        if (moved) continue;
+        if (!ring_reader_sleep(&h->c2s)) continue;
+        if (!pending.empty() && !ring_writer_sleep(&h->s2c, l->ring_size)) continue;
+        if (!shm_wait(fd)) break;
+        h->c2s.reader_idle.store(0);
+        h->s2c.writer_wait.store(0);
+    }
+}
+
+int main() {
+    alarm(60);  // a lost wakeup hangs instead of failing
+    ShmLink client;
+    int mfd = shm_create(4096, &client);
+    assert(mfd >= 0);
+    // the size is sealed: the client can't truncate the server's mapping
+    assert(ftruncate(mfd, 0) != 0 && errno == EPERM);
+
+    // unsealed files, and sealed ones that aren't links, are refused
+    ShmLink bad;
+    int raw = memfd_create("raw", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    assert(raw >= 0 && ftruncate(raw, (off_t)shm_map_size(4096)) == 0);
+    assert(pwrite(raw, client.hdr, sizeof(ShmHeader), 0) == (ssize_t)sizeof(ShmHeader));
+    assert(shm_attach(raw, &bad) != 0);
+    assert(fcntl(raw, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) == 0);
+    assert(shm_attach(raw, &bad) == 0);     // the same bytes, sealed
+    shm_detach(&bad);
+    assert(pwrite(raw, "junk", 4, 0) == 4);
+    assert(shm_attach(raw, &bad) != 0);
+    close(raw);
+
+    // frames of every size up to several times the ring
+    std::vector<std::string> frames;
+    size_t total = 0;
+    uint64_t rng = 1;
+    for (int i = 0; i < 3000; ++i) {
+        rng = rng * 6364136223846793005ull + 1442695040888963407ull;
+        size_t n = i % 100 == 0 ? 4096 * 5 + (rng >> 50) : (rng >> 33) % 700;
+        std::string f(n, 0);
+        for (size_t j = 0; j < n; ++j) f[j] = (char)(i * 31 + j);
+        total += n;
+        frames.push_back(f);
+    }
+
+    int sv[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        close(sv[0]);
+        int fd = -1;
+        char req = 0;
+        if (sock_recv_fd(sv[1], &req, 1, &fd) != 1 || fd < 0) _exit(2);
+        ShmLink server;
+        if (shm_attach(fd, &server) != 0) _exit(3);
+        close(fd);
+        echo(&server, sv[1], total);
+        _exit(0);
+    }
+    close(sv[1]);
+    // the memfd goes over the socket, as with `shm`
+    assert(sock_send_fd(sv[0], "s", 1, mfd));
+    close(mfd);
+
+    // pipelined, so both rings fill up and both sides sleep
+    size_t sent = 0, recvd = 0;
+    const size_t window = 3;
+    while (recvd < frames.size()) {
+        while (sent < frames.size() && sent < recvd + window) {
+            assert(shm_send_all(&client, sv[0], frames[sent].data(), frames[sent].size()));
+            sent++;
+        }
+        std::string got(frames[recvd].size(), 0);
+        assert(shm_recv_all(&client, sv[0], &got[0], got.size()));
+        assert(got == frames[recvd]);
+        recvd++;
+    }
+    int status = 0;
+    assert(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    shm_detach(&client);
+
+    std::printf("%zu frames, %zu bytes through a 4 KB ring\n", frames.size(), total);
+    std::puts("OK");
+    return 0;
+}
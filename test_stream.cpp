@@ -0,0 +1,72 @@
+// test_stream.cpp
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "stream.h"
+
+static StreamID mkid(uint64_t ms, uint64_t seq) {
+    StreamID id;
+    id.ms = ms;
+    id.seq = seq;
+    return id;
+}
+
+// Collect IDs of all entries >= start
+static std::vector<StreamID> scan(Stream *s, StreamID start) {
+    std::vector<StreamID> ids;
+    StreamIter it;
+    StreamEntry ent;
+    stream_seek(s, start, &it);
+    while (stream_next(&it, &ent)) ids.push_back(ent.id);
+    return ids;
+}
+
+int main() {
+    Stream s;
+    stream_init(&s);
+
+    // IDs must strictly increase; 0-0 is rejected
+    assert(!stream_append(&s, mkid(0, 0), {"f", "v"}));
+    const int N = 1000;
+    for (int i = 0; i < N; ++i) {
+        StreamID id = mkid(100 + (uint64_t)i / 3, (uint64_t)i % 3);
+        assert(stream_append(&s, id, {"field", std::to_string(i)}));
+    }
+    assert(!stream_append(&s, mkid(100, 0), {"f", "v"}));
+    assert(s.length == (uint64_t)N);
+    assert(s.nblocks > 1);
+
+    // fields round-trip
+    StreamIter it;
+    StreamEntry ent;
+    stream_seek(&s, mkid(150, 1), &it);
+    assert(stream_next(&it, &ent));
+    assert(ent.id.ms == 150 && ent.id.seq == 1 && ent.nstr == 2);
+    const uint8_t *p = ent.strs;
+    const char *str = nullptr;
+    size_t len = 0;
+    streamentry_str(p, &str, &len);
+    assert(std::string(str, len) == "field");
+    streamentry_str(p, &str, &len);
+    assert(std::string(str, len) == std::to_string(50 * 3 + 1));
+
+    // seek lands on the first ID >= start, across block boundaries
+    for (int i = 0; i < N; i += 7) {
+        std::vector<StreamID> ids = scan(&s, mkid(100 + (uint64_t)i / 3, (uint64_t)i % 3));
+        assert(ids.size() == (size_t)(N - i));
+    }
+    assert(scan(&s, mkid(10000, 0)).empty());
+
+    // trimming from the front, partial and whole blocks
+    assert(stream_trim_maxlen(&s, 600) == 400);
+    assert(s.length == 600 && scan(&s, StreamID()).size() == 600);
+    assert(stream_trim_minid(&s, mkid(300, 0)) == 200);
+    std::vector<StreamID> rest = scan(&s, StreamID());
+    assert(rest.size() == 400 && rest[0].ms == 300 && rest[0].seq == 0);
+
+    stream_clear(&s);
+    assert(s.length == 0 && !s.root);
+    std::puts("OK");
+    return 0;
+}
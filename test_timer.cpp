@@ -0,0 +1,115 @@
+// test_timer.cpp
+#include <cassert>
+#include <cstdio>
+#include <vector>
+#include "timer.h"
+
+// Each test timer records when it fired.
+struct T {
+    Timer timer;
+    uint64_t fired_at = 0;
+    int fires = 0;
+};
+
+static uint64_t g_now = 0;
+
+static void on_fire(Timer *t) {
+    T *x = (T*)((char*)t - offsetof(T, timer));
+    x->fired_at = g_now;
+    x->fires++;
+}
+
+static uint64_t g_rng = 88172645463325252ull;
+static uint64_t rnd() {
+    g_rng ^= g_rng << 13; g_rng ^= g_rng >> 7; g_rng ^= g_rng << 17;
+    return g_rng;
+}
+
+// A re-arming timer, as the server's cron is.
+static TimerWheel *g_tw = nullptr;
+static int g_ticks = 0;
+static void on_tick(Timer *t) {
+    g_ticks++;
+    tw_add(g_tw, t, g_now + 100);
+}
+
+int main() {
+    static TimerWheel tw;
+    g_now = 1000000;
+    tw_init(&tw, g_now);
+    assert(tw_timeout_ms(&tw, g_now) == -1);
+
+    // random adds, re-arms and cancels against a brute-force model, with
+    // deadlines from now to past the wheel's reach
+    const size_t N = 4000;
+    std::vector<T> ts(N);
+    std::vector<uint64_t> want(N, 0);   // 0: not armed
+    for (T &x : ts) x.timer.fn = on_fire;
+    for (int round = 0; round < 200000; ++round) {
+        size_t i = rnd() % N;
+        uint64_t r = rnd() % 100;
+        if (r < 45) {
+            uint64_t far = rnd() % 8;
+            uint64_t d = far == 0 ? rnd() % 300000000 : far < 3 ? rnd() % 100000 : rnd() % 600;
+            ts[i].fires = 0;
+            tw_add(&tw, &ts[i].timer, g_now + d);
+            want[i] = g_now + d;
+        } else if (r < 55) {
+            tw_cancel(&tw, &ts[i].timer);
+            want[i] = 0;
+        } else {
+            // the wheel never sleeps past the next deadline
+            uint64_t next = UINT64_MAX;
+            for (uint64_t w : want) {
+                if (w && w < next) next = w;
+            }
+            int64_t timeout = tw_timeout_ms(&tw, g_now);
+            assert((timeout < 0) == (next == UINT64_MAX));
+            if (timeout >= 0) assert(g_now + (uint64_t)timeout <= next || next <= g_now);
+
+            // ticks run once: a deadline at a tick already run fires on the next
+            uint64_t step = 1 + (rnd() % 16 == 0 ? rnd() % 5000000 : rnd() % 50);
+            if (timeout > 0 && rnd() % 2) step = (uint64_t)timeout;
+            g_now += step;
+            tw_run(&tw, g_now);
+            for (size_t j = 0; j < N; ++j) {
+                if (!want[j]) continue;
+                if (want[j] <= g_now) {
+                    assert(ts[j].fires == 1 && !tw_armed(&ts[j].timer));
+                    want[j] = 0;
+                } else {
+                    assert(ts[j].fires == 0 && tw_armed(&ts[j].timer));
+                }
+            }
+        }
+        size_t armed = 0;
+        for (uint64_t w : want) armed += w != 0;
+        assert(armed == tw.count);
+    }
+
+    // a timer that re-arms from its own callback fires once per period
+    for (size_t j = 0; j < N; ++j) tw_cancel(&tw, &ts[j].timer);
+    assert(tw.count == 0);
+    g_tw = &tw;
+    Timer tick;
+    tick.fn = on_tick;
+    tw_add(&tw, &tick, g_now + 100);
+    for (int k = 0; k < 100000; ++k) {
+        g_now += 1;
+        tw_run(&tw, g_now);
+    }
+    assert(g_ticks == 1000);
+
+    // overdue timers fire on the next tick, not a turn later
+    tw_cancel(&tw, &tick);
+    T late;
+    late.timer.fn = on_fire;
+    tw_add(&tw, &late.timer, g_now - 50);
+    assert(tw_timeout_ms(&tw, g_now) == 1);
+    g_now++;
+    tw_run(&tw, g_now);
+    assert(late.fires == 1 && tw.count == 0);
+
+    std::puts("OK");
+    return 0;
+}
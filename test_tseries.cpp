@@ -0,0 +1,112 @@
+// test_tseries.cpp
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "tseries.h"
+
+int main() {
+    std::mt19937_64 rng{12345};
+    TSeries ts;
+    ts_init(&ts);
+
+    // regular 10s scrape with jitter and a slowly drifting gauge
+    const int N = 10000;
+    std::vector<TSSample> ref;
+    int64_t t = 1700000000000;
+    double v = 50.0;
+    for (int i = 0; i < N; ++i) {
+        t += 10000 + (int64_t)(rng() % 5) - 2;
+        if (rng() % 4 == 0) v += (double)(rng() % 100) / 100.0 - 0.5;
+        assert(ts_add(&ts, t, v));
+        ref.push_back({t, v});
+    }
+    assert(!ts_add(&ts, t, 1.0));    // not strictly increasing
+    assert(ts.count == (uint64_t)N);
+
+    // odd values round-trip bit-exactly
+    TSeries odd;
+    ts_init(&odd);
+    const double specials[] = {0.0, -0.0, 1e308, -1e-308, INFINITY, 3.14159, 3.14159, 42};
+    for (int i = 0; i < 8; ++i) assert(ts_add(&odd, (int64_t)i * 1000003, specials[i]));
+    std::vector<TSSample> got;
+    ts_range(&odd, INT64_MIN, INT64_MAX, TS_AGG_NONE, 0, got);
+    assert(got.size() == 8);
+    for (int i = 0; i < 8; ++i) {
+        assert(memcmp(&got[i].val, &specials[i], 8) == 0);
+    }
+    ts_clear(&odd);
+
+    // deltas that overflow int64 still round-trip
+    const int64_t extremes[] = {INT64_MIN, -1, 0, INT64_MAX - 1, INT64_MAX};
+    for (int i = 0; i < 5; ++i) assert(ts_add(&odd, extremes[i], i));
+    got.clear();
+    ts_range(&odd, INT64_MIN, INT64_MAX, TS_AGG_NONE, 0, got);
+    assert(got.size() == 5);
+    for (int i = 0; i < 5; ++i) assert(got[i].ts == extremes[i] && got[i].val == i);
+    got.clear();
+    ts_range(&odd, INT64_MIN, INT64_MAX, TS_AGG_COUNT, INT64_MAX, got);
+    double total = 0;
+    for (const TSSample &smp : got) total += smp.val;
+    assert(total == 5);
+    ts_clear(&odd);
+
+    // raw range
+    got.clear();
+    ts_range(&ts, ref[100].ts, ref[5000].ts, TS_AGG_NONE, 0, got);
+    assert(got.size() == 4901);
+    for (size_t i = 0; i < got.size(); ++i) {
+        assert(got[i].ts == ref[100 + i].ts && got[i].val == ref[100 + i].val);
+    }
+
+    // aggregation matches a naive reduction, with buckets of a few samples
+    // and of more than one reduced block
+    for (int64_t bucket : {(int64_t)60000, (int64_t)3600000}) {
+        for (int agg = TS_AGG_AVG; agg <= TS_AGG_COUNT; ++agg) {
+            got.clear();
+            ts_range(&ts, INT64_MIN, INT64_MAX, (TSAgg)agg, bucket, got);
+            size_t i = 0;
+            for (const TSSample &smp : got) {
+                double sum = 0, mn = INFINITY, mx = -INFINITY;
+                size_t cnt = 0;
+                for (; i < ref.size() && ref[i].ts < smp.ts + bucket; ++i, ++cnt) {
+                    assert(ref[i].ts >= smp.ts);
+                    sum += ref[i].val;
+                    mn = std::fmin(mn, ref[i].val);
+                    mx = std::fmax(mx, ref[i].val);
+                }
+                double want = agg == TS_AGG_AVG ? sum / (double)cnt
+                            : agg == TS_AGG_MIN ? mn
+                            : agg == TS_AGG_MAX ? mx
+                            : agg == TS_AGG_SUM ? sum : (double)cnt;
+                assert(std::fabs(smp.val - want) <= 1e-9 * std::fabs(want));
+            }
+            assert(i == ref.size());
+        }
+    }
+
+    // taking a range a page at a time gives the same samples
+    const int64_t bucket = 60000;
+    for (int agg : {(int)TS_AGG_NONE, (int)TS_AGG_SUM}) {
+        std::vector<TSSample> whole, paged;
+        ts_range(&ts, ref[10].ts, ref[9000].ts, (TSAgg)agg, bucket, whole);
+        int64_t from = ref[10].ts;
+        while (ts_range(&ts, from, ref[9000].ts, (TSAgg)agg, bucket, paged, 97, &from)) {
+            assert(paged.size() % 97 == 0);
+        }
+        assert(paged.size() == whole.size());
+        for (size_t i = 0; i < whole.size(); ++i) {
+            assert(paged[i].ts == whole[i].ts && paged[i].val == whole[i].val);
+        }
+    }
+
+    double per_sample = (double)ts_bytes(&ts) / (double)N;
+    std::printf("%.2f bytes/sample\n", per_sample);
+    assert(per_sample < 3.0);
+
+    ts_clear(&ts);
+    std::puts("OK");
+    return 0;
+}
@@ -0,0 +1,87 @@
+// test_varint.cpp
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "varint.h"
+
+static uint64_t g_rng = 0x9e3779b97f4a7c15ull;
+static uint64_t rnd() {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return g_rng;
+}
+
+// Decode with both paths: the 8-byte load (buffer padded) and the byte
+// loop (buffer ending right after the varint).
+static void check32(uint32_t v, const uint8_t *enc, size_t n) {
+    uint8_t padded[16] = {};
+    memcpy(padded, enc, n);
+    for (const uint8_t *end : {padded + n, padded + sizeof(padded)}) {
+        const uint8_t *p = padded;
+        uint32_t got = 0;
+        assert(varint_get32(p, end, got) == 1);
+        assert(got == v && p == padded + n);
+    }
+    // cut short anywhere: more to come
+    for (size_t k = 0; k < n; ++k) {
+        const uint8_t *p = enc;
+        uint32_t got = 0;
+        assert(varint_get32(p, enc + k, got) == 0 && p == enc);
+    }
+}
+
+int main() {
+    // sizes at the group boundaries
+    assert(varint_size(0) == 1 && varint_size(127) == 1);
+    assert(varint_size(128) == 2 && varint_size(16383) == 2);
+    assert(varint_size(UINT32_MAX) == 5 && varint_size(UINT64_MAX) == 10);
+
+    // round trips, plain and padded
+    std::vector<uint32_t> vals = {0, 1, 63, 64, 127, 128, 300, 16383, 16384,
+                                  (1u << 21) - 1, 1u << 21, (1u << 28) - 1, 1u << 28,
+                                  UINT32_MAX};
+    for (int i = 0; i < 100000; ++i) vals.push_back((uint32_t)(rnd() >> (rnd() % 64)));
+    for (uint32_t v : vals) {
+        uint8_t buf[k_varint_max64];
+        uint8_t *e = varint_put(buf, v);
+        assert((size_t)(e - buf) == varint_size(v));
+        check32(v, buf, (size_t)(e - buf));
+        e = varint_put_padded(buf, v);
+        assert((size_t)(e - buf) == k_varint_max32);
+        check32(v, buf, k_varint_max32);
+    }
+
+    // malformed: over 32 bits, or too long
+    const uint8_t big[] = {0xff, 0xff, 0xff, 0xff, 0x1f, 0, 0, 0};
+    const uint8_t longer[] = {0x80, 0x80, 0x80, 0x80, 0x80, 0x01, 0, 0};
+    for (const uint8_t *bad : {big, longer}) {
+        for (size_t n : {(size_t)6, (size_t)8}) {
+            const uint8_t *p = bad;
+            uint32_t v = 0;
+            assert(varint_get32(p, bad + n, v) == -1);
+        }
+    }
+
+    // 64-bit ints through zigzag
+    std::vector<int64_t> ints = {0, 1, -1, 63, -64, INT64_MAX, INT64_MIN};
+    for (int i = 0; i < 100000; ++i) ints.push_back((int64_t)rnd() >> (rnd() % 64));
+    for (int64_t x : ints) {
+        uint8_t buf[k_varint_max64];
+        uint8_t *e = varint_put(buf, zigzag(x));
+        const uint8_t *p = buf;
+        uint64_t z = 0;
+        assert(varint_get64(p, e, z) == 1 && p == e && unzigzag(z) == x);
+        p = buf;
+        assert(varint_get64(p, e - 1, z) == 0);
+    }
+    assert(varint_size(zigzag(-1)) == 1 && varint_size(zigzag(-64)) == 1);
+    const uint8_t over64[] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x02};
+    const uint8_t *p = over64;
+    uint64_t z = 0;
+    assert(varint_get64(p, over64 + sizeof(over64), z) == -1);
+
+    printf("OK\n");
+    return 0;
+}
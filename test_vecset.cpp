@@ -0,0 +1,86 @@
+// test_vecset.cpp
+#include <cassert>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include "vecset.h"
+
+static float naive_l2(const float *a, const float *b, uint32_t dim) {
+    float s = 0;
+    for (uint32_t i = 0; i < dim; ++i) s += (a[i] - b[i]) * (a[i] - b[i]);
+    return s;
+}
+
+int main() {
+    std::mt19937_64 rng{12345};
+    std::normal_distribution<float> gauss(0.0f, 1.0f);
+    const uint32_t dim = 37;    // not a multiple of the SIMD width
+    const int N = 4000;
+
+    VecSet vs;
+    vecset_init(&vs, dim);
+    std::vector<std::vector<float>> ref(N, std::vector<float>(dim));
+    for (int i = 0; i < N; ++i) {
+        for (float &f : ref[i]) f = gauss(rng);
+        std::string id = "v" + std::to_string(i);
+        assert(vecset_add(&vs, id.data(), id.size(), ref[i].data()));
+    }
+    assert(vs.n == (size_t)N);
+
+    // brute force agrees with a naive scan
+    std::vector<float> q(dim);
+    for (float &f : q) f = gauss(rng);
+    std::vector<VecHit> hits;
+    vecset_search(&vs, q.data(), 10, VEC_L2, 0, hits);
+    assert(hits.size() == 10);
+    int best = 0;
+    for (int i = 1; i < N; ++i) {
+        if (naive_l2(q.data(), ref[i].data(), dim) < naive_l2(q.data(), ref[best].data(), dim)) best = i;
+    }
+    assert(std::string(vs.items[hits[0].row]->id, vs.items[hits[0].row]->len) == "v" + std::to_string(best));
+    for (size_t i = 1; i < hits.size(); ++i) assert(hits[i - 1].score <= hits[i].score);
+    float d0 = naive_l2(q.data(), ref[best].data(), dim);
+    assert(hits[0].score - d0 < 1e-3f && d0 - hits[0].score < 1e-3f);
+
+    // the id being replaced or removed keeps rows dense
+    assert(!vecset_add(&vs, "v0", 2, ref[1].data()));
+    assert(vecset_remove(&vs, "v5", 2));
+    assert(!vecset_remove(&vs, "v5", 2));
+    assert(vs.n == (size_t)N - 1);
+
+    // IVF: probing every list is exact, probing a few stays close
+    VecBuild *b = vecset_build_begin(&vs, 32, 5);
+    assert(b && !vecset_build_begin(&vs, 32, 5));
+    vecbuild_run(b);
+    // appended into a snapshot row that a remove freed
+    const VecItem *last = vs.items[vs.n - 1];
+    assert(vecset_remove(&vs, std::string(last->id, last->len).c_str(), last->len));
+    std::vector<float> q2(dim);
+    for (float &f : q2) f = gauss(rng) + 3.0f;
+    assert(vecset_add(&vs, "reused", 6, q2.data()));
+    // written after the snapshot; must be reassigned on install
+    assert(vecset_add(&vs, "late", 4, q.data()));
+    vecset_build_finish(&vs, b);
+    vecbuild_free(b);
+    assert(vs.ivf && vs.ivf->nlist == 32);
+    size_t listed = 0;
+    for (auto &list : vs.ivf->lists) listed += list.size();
+    assert(listed == vs.n);
+
+    std::vector<VecHit> exact, approx;
+    vecset_search(&vs, q.data(), 5, VEC_L2, 32, exact);
+    vecset_search(&vs, q.data(), 5, VEC_L2, 4, approx);
+    assert(exact.size() == 5 && approx.size() == 5);
+    const VecItem *top = vs.items[approx[0].row];
+    assert(std::string(top->id, top->len) == "late" && approx[0].score == 0.0f);
+    approx.clear();
+    vecset_search(&vs, q2.data(), 1, VEC_L2, 1, approx);
+    top = vs.items[approx.at(0).row];
+    assert(std::string(top->id, top->len) == "reused" && approx[0].score == 0.0f);
+
+    vecset_clear(&vs);
+    std::printf("kernels: %s\n", vec_kernel_name());
+    std::puts("OK");
+    return 0;
+}
@@ -0,0 +1,159 @@
+// timer.cpp
+#include "timer.h"
+#include <assert.h>
+
+const uint64_t k_tw_size0 = 1u << k_tw_bits0;
+const uint64_t k_tw_size  = 1u << k_tw_bits;
+const uint64_t k_tw_span  = 1ull << (k_tw_bits0 + (k_tw_levels - 1) * k_tw_bits);
+
+static void list_init(Timer *head) {
+    head->prev = head->next = head;
+}
+static bool list_empty(const Timer *head) {
+    return head->next == head;
+}
+static void list_push(Timer *head, Timer *t) {
+    t->prev = head->prev;
+    t->next = head;
+    head->prev->next = t;
+    head->prev = t;
+}
+static void list_unlink(Timer *t) {
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->prev = t->next = nullptr;
+}
+// Move every timer in `from` to the empty list `to`.
+static void list_take(Timer *from, Timer *to) {
+    if (list_empty(from)) return;
+    to->next = from->next;
+    to->prev = from->prev;
+    to->next->prev = to;
+    to->prev->next = to;
+    list_init(from);
+}
+
+void tw_init(TimerWheel *tw, uint64_t now_ms) {
+    tw->now = now_ms;
+    tw->count = 0;
+    for (Timer &h : tw->slots0) list_init(&h);
+    for (auto &level : tw->slots) {
+        for (Timer &h : level) list_init(&h);
+    }
+    for (uint64_t &w : tw->busy0) w = 0;
+}
+
+// File an unlinked timer by how far its deadline is from `tw->now`.
+static void tw_file(TimerWheel *tw, Timer *t) {
+    uint64_t at = t->expire < tw->now ? tw->now : t->expire;
+    uint64_t delta = at - tw->now;
+    if (delta < k_tw_size0) {
+        uint64_t i = at & (k_tw_size0 - 1);
+        tw->busy0[i / 64] |= 1ull << (i % 64);
+        list_push(&tw->slots0[i], t);
+        return;
+    }
+    if (delta >= k_tw_span) at = tw->now + k_tw_span - 1;    // filed again later
+    uint32_t shift = k_tw_bits0;
+    uint32_t level = 0;
+    while (level + 1 < k_tw_levels - 1 && (at - tw->now) >> (shift + k_tw_bits)) {
+        shift += k_tw_bits;
+        level++;
+    }
+    list_push(&tw->slots[level][(at >> shift) & (k_tw_size - 1)], t);
+}
+
+void tw_add(TimerWheel *tw, Timer *t, uint64_t expire_ms) {
+    assert(t->fn);
+    if (tw_armed(t)) {
+        list_unlink(t);
+    } else {
+        tw->count++;
+    }
+    t->expire = expire_ms;
+    tw_file(tw, t);
+}
+
+void tw_cancel(TimerWheel *tw, Timer *t) {
+    if (!tw_armed(t)) return;
+    list_unlink(t);
+    tw->count--;
+}
+
+// Level 0 is about to wrap: spread the next slot of level 1 over it,
+// first refilling that from level 2 if level 1 wraps too, and so on.
+static void tw_cascade(TimerWheel *tw) {
+    uint32_t shift = k_tw_bits0;
+    for (uint32_t level = 0; level < k_tw_levels - 1; ++level) {
+        uint64_t i = (tw->now >> shift) & (k_tw_size - 1);
+        Timer list;
+        list_init(&list);
+        list_take(&tw->slots[level][i], &list);
+        while (!list_empty(&list)) {
+            Timer *t = list.next;
+            list_unlink(t);
+            tw_file(tw, t);
+        }
+        if (i != 0) break;
+        shift += k_tw_bits;
+    }
+}
+
+// Next level 0 slot at or after tick `from` (until the wrap) that may
+// hold timers; k_tw_size0 if none.
+static uint64_t tw_next_busy0(TimerWheel *tw, uint64_t from) {
+    for (uint64_t i = from; i < k_tw_size0;) {
+        uint64_t w = tw->busy0[i / 64] >> (i % 64);
+        if (!w) {
+            i = (i / 64 + 1) * 64;
+            continue;
+        }
+        i += (uint64_t)__builtin_ctzll(w);
+        if (!list_empty(&tw->slots0[i])) return i;
+        tw->busy0[i / 64] &= ~(1ull << (i % 64));   // emptied by cancels
+        i++;
+    }
+    return k_tw_size0;
+}
+
+size_t tw_run(TimerWheel *tw, uint64_t now_ms) {
+    size_t fired = 0;
+    while (tw->now <= now_ms) {
+        if (!tw->count) {
+            tw->now = now_ms + 1;
+            break;
+        }
+        uint64_t i = tw->now & (k_tw_size0 - 1);
+        if (i == 0) tw_cascade(tw);
+        // skip ahead over empty ticks, stopping at the wrap
+        uint64_t next = tw_next_busy0(tw, i);
+        if (next != i) {
+            uint64_t skip = next - i;
+            if (tw->now + skip > now_ms + 1) skip = now_ms + 1 - tw->now;
+            tw->now += skip;
+            continue;
+        }
+        Timer list;
+        list_init(&list);
+        list_take(&tw->slots0[i], &list);
+        tw->busy0[i / 64] &= ~(1ull << (i % 64));
+        tw->now++;      // anything fn adds for now lands on the next tick
+        while (!list_empty(&list)) {
+            Timer *t = list.next;
+            list_unlink(t);
+            tw->count--;
+            fired++;
+            t->fn(t);
+        }
+    }
+    return fired;
+}
+
+int64_t tw_timeout_ms(TimerWheel *tw, uint64_t now_ms) {
+    if (!tw->count) return -1;
+    uint64_t i = tw->now & (k_tw_size0 - 1);
+    // at the wrap, the cascade still has to bring in what is due next
+    uint64_t next = i == 0 ? 0 : tw_next_busy0(tw, i);
+    uint64_t at = tw->now - i + next;   // the tick, or the wrap if none
+    return at <= now_ms ? 0 : (int64_t)(at - now_ms);
+}
@@ -0,0 +1,51 @@
+// timer.h
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Hierarchical timing wheel with 1 ms ticks. Level 0 has 256 slots of
+// one tick each; every level above has 64 slots, each as long as a full
+// turn of the level below, so four levels reach 2^26 ms (about 18.6
+// hours). Deadlines further out wait in the last slot they can reach
+// and are filed again as they come closer. Whenever level 0 wraps, the
+// next slot of level 1 is spread over it (and so on up), so a timer is
+// touched at most once per level. Add and cancel are O(1).
+//
+// Timers are intrusive: embed one and find the owner with container_of.
+// Not thread-safe; each wheel belongs to one thread.
+struct Timer {
+    Timer   *prev = nullptr;    // nullptr: not armed
+    Timer   *next = nullptr;
+    uint64_t expire = 0;        // ms, same clock as the wheel
+    void   (*fn)(Timer *t) = nullptr;   // runs once the timer fires
+};
+
+const uint32_t k_tw_bits0 = 8;      // level 0: 256 slots
+const uint32_t k_tw_bits  = 6;      // levels 1..3: 64 slots
+const uint32_t k_tw_levels = 4;
+
+struct TimerWheel {
+    uint64_t now = 0;               // next tick to run
+    size_t   count = 0;             // armed timers
+    Timer    slots0[1u << k_tw_bits0];
+    Timer    slots[k_tw_levels - 1][1u << k_tw_bits];
+    uint64_t busy0[(1u << k_tw_bits0) / 64];    // level 0 slots maybe in use
+};
+
+void tw_init(TimerWheel *tw, uint64_t now_ms);
+
+// Arm `t` (re-arming it if it is) to fire at `expire_ms`; a time that
+// has passed fires on the next tick tw_run() gets to. `t->fn` must be set.
+void tw_add(TimerWheel *tw, Timer *t, uint64_t expire_ms);
+void tw_cancel(TimerWheel *tw, Timer *t);   // no-op if not armed
+
+inline bool tw_armed(const Timer *t) { return t->prev != nullptr; }
+
+// Fire every timer due by `now_ms`. Each is disarmed before its fn runs,
+// so fn may re-arm it, or add and cancel others. Returns how many fired.
+size_t tw_run(TimerWheel *tw, uint64_t now_ms);
+
+// ms from `now_ms` until tw_run() has something to do: a timer due, or a
+// slot of a higher level to spread out (at most every 256 ms while any
+// timer is that far away). -1 if no timer is armed.
+int64_t tw_timeout_ms(TimerWheel *tw, uint64_t now_ms);
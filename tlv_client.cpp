@@ -2,17 +2,33 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdio.h>
 #include <vector>
 #include <string>
 #include <stdint.h>
+#include "shmring.h"
 
 static void die(const char* m){ perror(m); _exit(1); }
 
-static void send_cmd(int fd, const std::vector<std::string>& args){
-    std::vector<uint8_t> out;
+// --shm <unix path>: after the handshake, frames go through shared-memory
+// rings and the socket only carries doorbells
+static ShmLink g_link;
+static bool g_use_shm = false;
+
+static void writen(int fd, const void* p, size_t n){
+    if (g_use_shm){
+        if (!shm_send_all(&g_link, fd, p, n)) die("shm send");
+        return;
+    }
+    if (write(fd, p, n) != (ssize_t)n) die("write");
+}
+
+// One request: u32 length, then the strings
+static std::vector<uint8_t> enc_cmd(const std::vector<std::string>& args){
+    std::vector<uint8_t> out(4);
     uint32_t n = args.size();
     out.insert(out.end(), (uint8_t*)&n, (uint8_t*)&n + 4);
     for (auto &s: args){
@@ -20,12 +36,21 @@ static void send_cmd(int fd, const std::vector<std::string>& args){
         out.insert(out.end(), (uint8_t*)&len, (uint8_t*)&len + 4);
         out.insert(out.end(), s.begin(), s.end());
     }
-    uint32_t L = (uint32_t)out.size();
-    if (write(fd, &L, 4) != 4) die("write len");
-    if (write(fd, out.data(), out.size()) != (ssize_t)out.size()) die("write body");
+    uint32_t L = (uint32_t)out.size() - 4;
+    memcpy(out.data(), &L, 4);
+    return out;
+}
+
+static void send_cmd(int fd, const std::vector<std::string>& args){
+    std::vector<uint8_t> out = enc_cmd(args);
+    writen(fd, out.data(), out.size());
 }
 
 static void readn(int fd, void* p, size_t n){
+    if (g_use_shm){
+        if (!shm_recv_all(&g_link, fd, p, n)) die("shm read");
+        return;
+    }
     uint8_t* b=(uint8_t*)p; size_t got=0;
     while (got<n){
         ssize_t r=read(fd,b+got,n-got);
@@ -58,11 +83,19 @@ static void dump_tlv(const uint8_t* p, const uint8_t* end, int indent=0){
                 int64_t v; memcpy(&v,p,8); p+=8;
                 pad(); printf("INT %lld\n",(long long)v);
             }break;
+            case 4:{ // DBL
+                if(p+8>end){ pad(); puts("DBL <truncated>"); return; }
+                double v; memcpy(&v,p,8); p+=8;
+                pad(); printf("DBL %g\n",v);
+            }break;
             case 5:{ // ARR
                 if(p+4>end){ pad(); puts("ARR <truncated len>"); return; }
                 uint32_t n; memcpy(&n,p,4); p+=4;
-                pad(); printf("ARR[%u]\n", n);
-                for(uint32_t i=0;i<n;i++){
+                // streamed array: count unknown, items run up to TAG_END (6)
+                bool streamed = n==0xffffffffu;
+                if(streamed){ pad(); printf("ARR[streamed]\n"); }
+                else { pad(); printf("ARR[%u]\n", n); }
+                for(uint32_t i=0; streamed ? (p<end && *p!=6) : i<n; i++){
                     // Each element is a TLV; dump one element
                     // Call recursively to print exactly one item at a time:
                     // We don't know sizes of items ahead of time, so parse by single element:
@@ -91,6 +124,12 @@ static void dump_tlv(const uint8_t* p, const uint8_t* end, int indent=0){
                             for(int k=0;k<indent+1;k++) printf("  ");
                             printf("INT %lld\n",(long long)v);
                         } break;
+                        case 4:{
+                            if(p+8>end){ back("dbl"); return; }
+                            double v; memcpy(&v,p,8); p+=8;
+                            for(int k=0;k<indent+1;k++) printf("  ");
+                            printf("DBL %g\n",v);
+                        } break;
                         case 5:{
                             // nested array: recurse
                             if(p+4>end){ back("arrlen"); return; }
@@ -111,6 +150,7 @@ static void dump_tlv(const uint8_t* p, const uint8_t* end, int indent=0){
                     }
                     (void)before;
                 }
+                if(streamed && p<end) p++;  // TAG_END
             }break;
             default:
                 pad(); printf("UNKNOWN_TAG %u\n", tag);
@@ -119,18 +159,56 @@ static void dump_tlv(const uint8_t* p, const uint8_t* end, int indent=0){
     }
 }
 
+// One reply body. Big replies come as chunks:
+// u32 0xffffffff, then { u32 len, bytes }* up to a zero len.
+static std::vector<uint8_t> read_reply(int fd){
+    uint32_t L; readn(fd,&L,4);
+    std::vector<uint8_t> buf;
+    if(L!=0xffffffffu){ buf.resize(L); readn(fd,buf.data(),L); return buf; }
+    while(true){
+        uint32_t n; readn(fd,&n,4);
+        if(n==0) return buf;
+        size_t at=buf.size(); buf.resize(at+n);
+        readn(fd,buf.data()+at,n);
+    }
+}
+
+// Create a link and move the connection onto it (`shm`, with the memfd)
+static void shm_handshake(int fd){
+    int mfd = shm_create(1u << 20, &g_link);
+    if (mfd < 0) die("shm_create");
+    std::vector<uint8_t> out = enc_cmd({"shm"});
+    if (!sock_send_fd(fd, out.data(), out.size(), mfd)) die("sendmsg");
+    close(mfd);     // the server has it mapped, or refused
+    std::vector<uint8_t> r = read_reply(fd);
+    if (r.empty() || r[0] != 0){
+        fprintf(stderr, "server refused shm:\n");
+        dump_tlv(r.data(), r.data()+r.size());
+        fflush(stdout);
+        _exit(1);
+    }
+    g_use_shm = true;
+}
+
 int main(int argc, char** argv){
-    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    bool use_shm = argc > 2 && !strcmp(argv[1], "--shm");
+    int fd = socket(use_shm ? AF_UNIX : AF_INET, SOCK_STREAM, 0);
     if(fd<0) die("socket");
-    sockaddr_in a{}; a.sin_family=AF_INET; a.sin_port=htons(1234); a.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
-    if(connect(fd,(sockaddr*)&a,sizeof(a))<0) die("connect");
+    if (use_shm){
+        sockaddr_un u{}; u.sun_family=AF_UNIX;
+        snprintf(u.sun_path, sizeof(u.sun_path), "%s", argv[2]);
+        if(connect(fd,(sockaddr*)&u,sizeof(u))<0) die("connect");
+        shm_handshake(fd);
+    } else {
+        sockaddr_in a{}; a.sin_family=AF_INET; a.sin_port=htons(1234); a.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+        if(connect(fd,(sockaddr*)&a,sizeof(a))<0) die("connect");
+    }
 
     auto roundtrip=[&](std::initializer_list<const char*> args){
         std::vector<std::string> v; for(auto s:args) v.emplace_back(s);
         send_cmd(fd, v);
-        uint32_t L; readn(fd,&L,4);
-        std::vector<uint8_t> buf(L); readn(fd,buf.data(),L);
-        printf("Reply (%u bytes):\n", L);
+        std::vector<uint8_t> buf = read_reply(fd);
+        printf("Reply (%zu bytes):\n", buf.size());
         dump_tlv(buf.data(), buf.data()+buf.size());
         printf("----\n");
     };
@@ -0,0 +1,316 @@
+// tseries.cpp
+#include "tseries.h"
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+
+// -------------------------- bit stream -------------------------
+
+static void bits_put(TSChunk *c, uint64_t v, uint32_t n) {
+    while (n > 0) {
+        size_t   word = (size_t)(c->nbits / 64);
+        uint32_t used = (uint32_t)(c->nbits % 64);
+        if (word == c->words.size()) c->words.push_back(0);
+        uint32_t room = 64 - used;
+        uint32_t take = n < room ? n : room;
+        uint64_t part = (v >> (n - take));
+        if (take < 64) part &= (1ull << take) - 1;
+        c->words[word] |= part << (room - take);
+        c->nbits += take;
+        n -= take;
+    }
+}
+
+struct BitReader {
+    const uint64_t *words;
+    uint64_t pos = 0;
+};
+
+static uint64_t bits_get(BitReader &r, uint32_t n) {
+    uint64_t v = 0;
+    while (n > 0) {
+        uint64_t w    = r.words[r.pos / 64];
+        uint32_t used = (uint32_t)(r.pos % 64);
+        uint32_t room = 64 - used;
+        uint32_t take = n < room ? n : room;
+        uint64_t part = (w << used) >> (64 - take);
+        v = take < 64 ? (v << take) | part : part;
+        r.pos += take;
+        n -= take;
+    }
+    return v;
+}
+
+static int64_t sign_extend(uint64_t v, uint32_t n) {
+    uint64_t m = 1ull << (n - 1);
+    return (int64_t)((v ^ m) - m);
+}
+
+static bool fits_signed(int64_t v, uint32_t n) {
+    int64_t lim = (int64_t)1 << (n - 1);
+    return v >= -lim && v < lim;
+}
+
+static uint64_t dbl_bits(double d) {
+    uint64_t u;
+    memcpy(&u, &d, 8);
+    return u;
+}
+static double bits_dbl(uint64_t u) {
+    double d;
+    memcpy(&d, &u, 8);
+    return d;
+}
+
+// ---------------------------- chunk ----------------------------
+
+// Deltas wrap around in uint64, so any two int64 timestamps encode; the
+// decoder wraps back the same way.
+static void chunk_put_ts(TSChunk *c, int64_t t) {
+    int64_t delta = (int64_t)((uint64_t)t - (uint64_t)c->last_ts);
+    int64_t dod   = (int64_t)((uint64_t)delta - (uint64_t)c->prev_delta);
+    c->prev_delta = delta;
+    if (dod == 0) {
+        bits_put(c, 0, 1);
+    } else if (fits_signed(dod, 7)) {
+        bits_put(c, 0b10, 2);
+        bits_put(c, (uint64_t)dod, 7);
+    } else if (fits_signed(dod, 9)) {
+        bits_put(c, 0b110, 3);
+        bits_put(c, (uint64_t)dod, 9);
+    } else if (fits_signed(dod, 12)) {
+        bits_put(c, 0b1110, 4);
+        bits_put(c, (uint64_t)dod, 12);
+    } else {
+        bits_put(c, 0b1111, 4);
+        bits_put(c, (uint64_t)dod, 64);
+    }
+}
+
+static void chunk_put_val(TSChunk *c, uint64_t bits) {
+    uint64_t x = bits ^ c->prev_bits;
+    c->prev_bits = bits;
+    if (x == 0) {
+        bits_put(c, 0, 1);
+        return;
+    }
+    uint32_t lead  = (uint32_t)__builtin_clzll(x);
+    uint32_t trail = (uint32_t)__builtin_ctzll(x);
+    if (lead > 31) lead = 31;   // 5-bit field
+    if (c->prev_lead != 0xff && lead >= c->prev_lead && trail >= c->prev_trail) {
+        // fits the previous window
+        bits_put(c, 0b10, 2);
+        bits_put(c, x >> c->prev_trail, 64 - c->prev_lead - c->prev_trail);
+        return;
+    }
+    uint32_t len = 64 - lead - trail;
+    bits_put(c, 0b11, 2);
+    bits_put(c, lead, 5);
+    bits_put(c, len - 1, 6);
+    bits_put(c, x >> trail, len);
+    c->prev_lead  = (uint8_t)lead;
+    c->prev_trail = (uint8_t)trail;
+}
+
+static void chunk_append(TSChunk *c, int64_t t, double val) {
+    if (c->count == 0) {
+        bits_put(c, (uint64_t)t, 64);
+        bits_put(c, dbl_bits(val), 64);
+        c->first_ts = t;
+        c->prev_bits = dbl_bits(val);
+    } else {
+        chunk_put_ts(c, t);
+        chunk_put_val(c, dbl_bits(val));
+    }
+    c->last_ts = t;
+    c->count++;
+}
+
+// Call f(t, val) for each sample in order, until it returns false.
+template <typename F>
+static void chunk_scan(const TSChunk *c, F &&f) {
+    if (c->count == 0) return;
+    BitReader r;
+    r.words = c->words.data();
+
+    uint64_t t     = bits_get(r, 64);
+    uint64_t bits  = bits_get(r, 64);
+    uint64_t delta = 0;
+    uint32_t lead = 0, trail = 0;
+    if (!f((int64_t)t, bits_dbl(bits))) return;
+
+    for (uint32_t i = 1; i < c->count; ++i) {
+        // timestamp
+        int64_t dod = 0;
+        if (bits_get(r, 1)) {
+            if (!bits_get(r, 1))      dod = sign_extend(bits_get(r, 7), 7);
+            else if (!bits_get(r, 1)) dod = sign_extend(bits_get(r, 9), 9);
+            else if (!bits_get(r, 1)) dod = sign_extend(bits_get(r, 12), 12);
+            else                      dod = (int64_t)bits_get(r, 64);
+        }
+        delta += (uint64_t)dod;
+        t += delta;
+        // value
+        if (bits_get(r, 1)) {
+            if (bits_get(r, 1)) {
+                lead  = (uint32_t)bits_get(r, 5);
+                uint32_t len = (uint32_t)bits_get(r, 6) + 1;
+                trail = 64 - lead - len;
+            }
+            bits ^= bits_get(r, 64 - lead - trail) << trail;
+        }
+        if (!f((int64_t)t, bits_dbl(bits))) return;
+    }
+}
+
+// --------------------------- series ----------------------------
+
+void ts_init(TSeries *ts) {
+    ts->chunks.clear();
+    ts->count = 0;
+    ts->last_ts = 0;
+}
+
+void ts_clear(TSeries *ts) {
+    for (TSChunk *c : ts->chunks) delete c;
+    ts_init(ts);
+}
+
+bool ts_add(TSeries *ts, int64_t t, double val) {
+    if (ts->count && t <= ts->last_ts) return false;
+    TSChunk *c = ts->chunks.empty() ? nullptr : ts->chunks.back();
+    if (!c || c->count >= k_ts_chunk_samples) {
+        if (c) c->words.shrink_to_fit();    // sealed
+        c = new TSChunk();
+        c->words.reserve(16);
+        ts->chunks.push_back(c);
+    }
+    chunk_append(c, t, val);
+    ts->count++;
+    ts->last_ts = t;
+    return true;
+}
+
+size_t ts_bytes(const TSeries *ts) {
+    size_t n = 0;
+    for (const TSChunk *c : ts->chunks) n += (size_t)((c->nbits + 7) / 8);
+    return n;
+}
+
+// running aggregate of the current bucket
+struct TSAcc {
+    int64_t  start = 0;
+    uint64_t cnt   = 0;
+    double   sum   = 0;
+    double   min   = 0;
+    double   max   = 0;
+};
+
+static void acc_emit(const TSAcc &acc, TSAgg agg, std::vector<TSSample> &out) {
+    double v = 0;
+    switch (agg) {
+    case TS_AGG_AVG:   v = acc.sum / (double)acc.cnt; break;
+    case TS_AGG_MIN:   v = acc.min; break;
+    case TS_AGG_MAX:   v = acc.max; break;
+    case TS_AGG_SUM:   v = acc.sum; break;
+    case TS_AGG_COUNT: v = (double)acc.cnt; break;
+    default: assert(!"bad agg");
+    }
+    out.push_back({acc.start, v});
+}
+
+// Reduce a contiguous run of decoded values. Four independent lanes and
+// branch-free min/max keep the loop vectorizable without -ffast-math.
+static void reduce_run(const double *v, size_t n, TSAcc &acc) {
+    if (n == 0) return;
+    if (acc.cnt == 0) acc.min = acc.max = v[0];
+    double s[4] = {0, 0, 0, 0};
+    double lo[4] = {acc.min, acc.min, acc.min, acc.min};
+    double hi[4] = {acc.max, acc.max, acc.max, acc.max};
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        for (size_t k = 0; k < 4; ++k) {
+            double x = v[i + k];
+            s[k] += x;
+            lo[k] = x < lo[k] ? x : lo[k];
+            hi[k] = x > hi[k] ? x : hi[k];
+        }
+    }
+    for (; i < n; ++i) {
+        s[0] += v[i];
+        lo[0] = v[i] < lo[0] ? v[i] : lo[0];
+        hi[0] = v[i] > hi[0] ? v[i] : hi[0];
+    }
+    acc.sum += (s[0] + s[1]) + (s[2] + s[3]);
+    acc.min = std::min(std::min(lo[0], lo[1]), std::min(lo[2], lo[3]));
+    acc.max = std::max(std::max(hi[0], hi[1]), std::max(hi[2], hi[3]));
+    acc.cnt += n;
+}
+
+// values of the open bucket wait in a block of this many for reduce_run()
+const uint32_t k_ts_run = 64;
+
+static int64_t bucket_start(int64_t t, int64_t bucket) {
+    int64_t r = t % bucket;
+    uint64_t start = (uint64_t)t - (uint64_t)r;     // near INT64_MIN it wraps
+    return (int64_t)(r < 0 ? start - (uint64_t)bucket : start);
+}
+
+// One pass per chunk: samples are filtered as they are decoded, and the
+// values of the open bucket are collected into a small block that is
+// reduced whenever it fills or the bucket closes.
+bool ts_range(const TSeries *ts, int64_t from, int64_t to,
+              TSAgg agg, int64_t bucket, std::vector<TSSample> &out,
+              size_t max, int64_t *next) {
+    if (from > to) return false;
+    // first chunk that may hold samples >= from
+    auto it = std::lower_bound(ts->chunks.begin(), ts->chunks.end(), from,
+        [](const TSChunk *c, int64_t t) { return c->last_ts < t; });
+
+    size_t base = out.size();
+    bool more = false;      // stopped at `max`, before the sample at *next
+    TSAcc acc;
+    bool open = false;      // a bucket has values, in `acc` or `run`
+    double run[k_ts_run];
+    uint32_t nrun = 0;
+    auto add = [&](int64_t t, double v) {
+        if (t < from) return true;
+        if (t > to) return false;
+        if (agg == TS_AGG_NONE) {
+            if (out.size() - base == max) {
+                more = true;
+                *next = t;
+                return false;
+            }
+            out.push_back({t, v});
+            return true;
+        }
+        if (!open || (uint64_t)t - (uint64_t)acc.start >= (uint64_t)bucket) {
+            if (open) {
+                reduce_run(run, nrun, acc);
+                nrun = 0;
+                acc_emit(acc, agg, out);
+            }
+            if (out.size() - base == max) {
+                more = true;
+                *next = t;
+                return false;
+            }
+            acc = TSAcc();
+            acc.start = bucket_start(t, bucket);
+            open = true;
+        }
+        run[nrun++] = v;
+        if (nrun == k_ts_run) {
+            reduce_run(run, nrun, acc);
+            nrun = 0;
+        }
+        return true;
+    };
+    for (; !more && it != ts->chunks.end() && (*it)->first_ts <= to; ++it) chunk_scan(*it, add);
+    if (!more && open) {
+        reduce_run(run, nrun, acc);
+        acc_emit(acc, agg, out);
+    }
+    return more;
+}
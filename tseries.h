@@ -0,0 +1,62 @@
+// tseries.h
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Gorilla-compressed chunk of (timestamp, value) samples.
+// The first sample is stored raw; each later one as
+//   timestamp: delta-of-delta in a '0' / '10' / '110' / '1110' / '1111'
+//              prefixed 0 / 7 / 9 / 12 / 64 bit field
+//   value:     XOR with the previous value; '0' if equal, '10' + bits
+//              inside the previous leading/trailing-zero window, or
+//              '11' + 5-bit leading + 6-bit length + meaningful bits
+struct TSChunk {
+    int64_t  first_ts = 0;
+    int64_t  last_ts  = 0;
+    uint32_t count    = 0;
+    // encoder state for the next append
+    int64_t  prev_delta = 0;
+    uint64_t prev_bits  = 0;
+    uint8_t  prev_lead  = 0xff;     // 0xff: no window yet
+    uint8_t  prev_trail = 0;
+    uint64_t nbits = 0;
+    std::vector<uint64_t> words;    // bit stream, MSB first
+};
+
+// samples per chunk
+const uint32_t k_ts_chunk_samples = 512;
+
+struct TSeries {
+    std::vector<TSChunk*> chunks;   // ordered by time, last one is open
+    uint64_t count   = 0;
+    int64_t  last_ts = 0;
+};
+
+enum TSAgg : uint8_t {
+    TS_AGG_NONE = 0,
+    TS_AGG_AVG,
+    TS_AGG_MIN,
+    TS_AGG_MAX,
+    TS_AGG_SUM,
+    TS_AGG_COUNT,
+};
+
+struct TSSample {
+    int64_t ts;
+    double  val;
+};
+
+void   ts_init(TSeries *ts);
+void   ts_clear(TSeries *ts);
+// Timestamps must be strictly increasing; returns false otherwise.
+bool   ts_add(TSeries *ts, int64_t t, double val);
+// Samples in [from, to]; with an aggregation, one sample per non-empty
+// `bucket`-wide window, stamped with the window start. At most `max`
+// samples are added; if the range goes on past them, returns true with
+// `*next` set to the `from` that picks it up again.
+bool   ts_range(const TSeries *ts, int64_t from, int64_t to,
+                TSAgg agg, int64_t bucket, std::vector<TSSample> &out,
+                size_t max = SIZE_MAX, int64_t *next = nullptr);
+// Compressed payload size, excluding per-chunk bookkeeping
+size_t ts_bytes(const TSeries *ts);
@@ -0,0 +1,106 @@
+// varint.h
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// LEB128 varints for the v2 wire format: 7 bits per byte, low groups
+// first, the top bit set on every byte but the last. Lengths and counts
+// are at most 32 bits, so at most 5 bytes; ints are zigzagged first so
+// small negatives stay short, and take up to 10.
+//
+// A field that is patched after its contents are written (an array
+// count, say) is written padded: always k_varint_max32 bytes, with
+// continuation bits on the leading zero groups. Decoders take it like
+// any other varint.
+const size_t k_varint_max32 = 5;
+const size_t k_varint_max64 = 10;
+
+inline size_t varint_size(uint64_t v) {
+    size_t n = 1;
+    while (v >= 0x80) { v >>= 7; n++; }
+    return n;
+}
+
+inline uint8_t *varint_put(uint8_t *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+inline uint8_t *varint_put_padded(uint8_t *p, uint32_t v) {
+    for (size_t i = 0; i + 1 < k_varint_max32; ++i) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+inline uint64_t zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+inline int64_t unzigzag(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+// Decode a 32-bit varint at `p`, moving `p` past it. Returns 1, 0 if
+// it runs past `end` (more bytes to come) or -1 if it is malformed:
+// longer than 5 bytes or over 32 bits.
+//
+// With 8 bytes readable, the whole varint comes from one load: the
+// first clear top bit marks its end, and the 7-bit groups are packed
+// together with three shift-and-mask steps rather than a byte loop.
+inline int varint_get32(const uint8_t *&p, const uint8_t *end, uint32_t &v) {
+    if (p < end && p[0] < 0x80) {
+        v = *p++;
+        return 1;
+    }
+    if (end - p >= 8) {
+        uint64_t w = 0;
+        memcpy(&w, p, 8);   // little-endian
+        uint64_t stops = ~w & 0x8080808080808080ull;
+        if (!stops) return -1;
+        size_t n = (size_t)__builtin_ctzll(stops) / 8 + 1;
+        if (n > k_varint_max32) return -1;
+        uint64_t x = w & ((1ull << (8 * n)) - 1) & 0x7f7f7f7f7f7f7f7full;
+        x = (x & 0x007f007f007f007full) | ((x & 0x7f007f007f007f00ull) >> 1);
+        x = (x & 0x00003fff00003fffull) | ((x & 0x3fff00003fff0000ull) >> 2);
+        x = (x & 0x000000000fffffffull) | ((x & 0x0fffffff00000000ull) >> 4);
+        if (x >> 32) return -1;
+        v = (uint32_t)x;
+        p += n;
+        return 1;
+    }
+    uint64_t x = 0;
+    for (size_t i = 0; i < k_varint_max32; ++i) {
+        if (p + i >= end) return 0;
+        x |= (uint64_t)(p[i] & 0x7f) << (7 * i);
+        if (p[i] < 0x80) {
+            if (x >> 32) return -1;
+            v = (uint32_t)x;
+            p += i + 1;
+            return 1;
+        }
+    }
+    return -1;
+}
+
+inline int varint_get64(const uint8_t *&p, const uint8_t *end, uint64_t &v) {
+    uint64_t x = 0;
+    for (size_t i = 0; i < k_varint_max64; ++i) {
+        if (p + i >= end) return 0;
+        uint64_t group = p[i] & 0x7f;
+        if (i == k_varint_max64 - 1 && group > 1) return -1;
+        x |= group << (7 * i);
+        if (p[i] < 0x80) {
+            v = x;
+            p += i + 1;
+            return 1;
+        }
+    }
+    return -1;
+}
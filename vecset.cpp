@@ -0,0 +1,471 @@
+// vecset.cpp
+#include "vecset.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// --------------------------- kernels ---------------------------
+// All kernels take `n` as a multiple of 16 and 64-byte aligned inputs.
+
+typedef float (*vec_kernel_fn)(const float *a, const float *b, uint32_t n);
+
+static float l2_scalar(const float *a, const float *b, uint32_t n) {
+    float s = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        float d = a[i] - b[i];
+        s += d * d;
+    }
+    return s;
+}
+
+static float ip_scalar(const float *a, const float *b, uint32_t n) {
+    float s = 0;
+    for (uint32_t i = 0; i < n; ++i) s += a[i] * b[i];
+    return s;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2,fma")))
+static float hsum256(__m256 v) {
+    __m128 lo = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    lo = _mm_hadd_ps(lo, lo);
+    lo = _mm_hadd_ps(lo, lo);
+    return _mm_cvtss_f32(lo);
+}
+
+__attribute__((target("avx2,fma")))
+static float l2_avx2(const float *a, const float *b, uint32_t n) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (uint32_t i = 0; i < n; i += 16) {
+        __m256 d0 = _mm256_sub_ps(_mm256_load_ps(a + i),     _mm256_load_ps(b + i));
+        __m256 d1 = _mm256_sub_ps(_mm256_load_ps(a + i + 8), _mm256_load_ps(b + i + 8));
+        acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+    }
+    return hsum256(_mm256_add_ps(acc0, acc1));
+}
+
+__attribute__((target("avx2,fma")))
+static float ip_avx2(const float *a, const float *b, uint32_t n) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (uint32_t i = 0; i < n; i += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_load_ps(a + i),     _mm256_load_ps(b + i),     acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_load_ps(a + i + 8), _mm256_load_ps(b + i + 8), acc1);
+    }
+    return hsum256(_mm256_add_ps(acc0, acc1));
+}
+
+__attribute__((target("avx512f")))
+static float hsum512(__m512 v) {
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, v);
+    float s = 0;
+    for (float f : lanes) s += f;
+    return s;
+}
+
+__attribute__((target("avx512f")))
+static float l2_avx512(const float *a, const float *b, uint32_t n) {
+    __m512 acc = _mm512_setzero_ps();
+    for (uint32_t i = 0; i < n; i += 16) {
+        __m512 d = _mm512_sub_ps(_mm512_load_ps(a + i), _mm512_load_ps(b + i));
+        acc = _mm512_fmadd_ps(d, d, acc);
+    }
+    return hsum512(acc);
+}
+
+__attribute__((target("avx512f")))
+static float ip_avx512(const float *a, const float *b, uint32_t n) {
+    __m512 acc = _mm512_setzero_ps();
+    for (uint32_t i = 0; i < n; i += 16) {
+        acc = _mm512_fmadd_ps(_mm512_load_ps(a + i), _mm512_load_ps(b + i), acc);
+    }
+    return hsum512(acc);
+}
+
+#endif
+
+struct VecKernels {
+    vec_kernel_fn l2;
+    vec_kernel_fn ip;
+    const char   *name;
+};
+
+// runtime dispatch, resolved once at startup
+static VecKernels pick_kernels() {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return {l2_avx512, ip_avx512, "avx512"};
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return {l2_avx2, ip_avx2, "avx2"};
+    }
+#endif
+    return {l2_scalar, ip_scalar, "scalar"};
+}
+static const VecKernels g_kern = pick_kernels();
+
+const char *vec_kernel_name() {
+    return g_kern.name;
+}
+
+// ranking distance: smaller is closer for both metrics
+static inline float vec_dist(VecMetric m, const float *a, const float *b, uint32_t n) {
+    return m == VEC_L2 ? g_kern.l2(a, b, n) : -g_kern.ip(a, b, n);
+}
+
+static float *vec_alloc(size_t rows, uint32_t stride) {
+    size_t bytes = rows * stride * sizeof(float);
+    return (float*)aligned_alloc(64, bytes ? bytes : 64);
+}
+
+// ---------------------------- index ----------------------------
+
+static uint32_t nearest_list(const VecIVF *ivf, uint32_t stride, const float *v) {
+    uint32_t best = 0;
+    float best_d = 0;
+    for (uint32_t c = 0; c < ivf->nlist; ++c) {
+        float d = g_kern.l2(ivf->centroids + (size_t)c * stride, v, stride);
+        if (c == 0 || d < best_d) { best = c; best_d = d; }
+    }
+    return best;
+}
+
+static void list_remove(std::vector<uint32_t> &list, uint32_t row) {
+    for (size_t i = 0; i < list.size(); ++i) {
+        if (list[i] == row) {
+            list[i] = list.back();
+            list.pop_back();
+            return;
+        }
+    }
+    assert(!"row not in list");
+}
+
+static void list_replace(std::vector<uint32_t> &list, uint32_t from, uint32_t to) {
+    for (uint32_t &r : list) {
+        if (r == from) { r = to; return; }
+    }
+    assert(!"row not in list");
+}
+
+static void ivf_free(VecIVF *ivf) {
+    if (!ivf) return;
+    free(ivf->centroids);
+    delete ivf;
+}
+
+// ---------------------------- set ------------------------------
+
+struct VKey {
+    HNode       node;
+    const char *id  = nullptr;
+    size_t      len = 0;
+};
+
+static bool vcmp(HNode *lhs, HNode *rhs) {
+    VecItem *item = container_of(lhs, VecItem, hmap);
+    VKey    *key  = container_of(rhs, VKey, node);
+    return item->len == key->len && memcmp(item->id, key->id, key->len) == 0;
+}
+
+static VecItem *vecset_lookup(VecSet *vs, const char *id, size_t len) {
+    VKey key;
+    key.node.hcode = str_hash((const uint8_t*)id, len);
+    key.id  = id;
+    key.len = len;
+    HNode *found = hm_lookup(&vs->hmap, &key.node, &vcmp);
+    return found ? container_of(found, VecItem, hmap) : nullptr;
+}
+
+void vecset_init(VecSet *vs, uint32_t dim) {
+    vs->dim    = dim;
+    vs->stride = (dim + 15) / 16 * 16;
+    vs->n = vs->cap = 0;
+    vs->data = nullptr;
+    vs->items.clear();
+    hm_init(&vs->hmap);
+    vs->ivf = nullptr;
+    vs->build_id = 0;
+    vs->build_n  = 0;
+    vs->build_dirty.clear();
+}
+
+void vecset_clear(VecSet *vs) {
+    for (VecItem *item : vs->items) free(item);
+    vs->items.clear();
+    hm_destroy(&vs->hmap);
+    free(vs->data);
+    vs->data = nullptr;
+    vs->n = vs->cap = 0;
+    ivf_free(vs->ivf);
+    vs->ivf = nullptr;
+    vs->build_id = 0;
+    vs->build_dirty.clear();
+}
+
+static void mark_dirty(VecSet *vs, uint32_t row) {
+    if (vs->build_id && row < vs->build_n) vs->build_dirty[row] = 1;
+}
+
+static void store_row(VecSet *vs, uint32_t row, const float *vec) {
+    float *dst = vs->data + (size_t)row * vs->stride;
+    memcpy(dst, vec, vs->dim * sizeof(float));
+    memset(dst + vs->dim, 0, (vs->stride - vs->dim) * sizeof(float));
+}
+
+bool vecset_add(VecSet *vs, const char *id, size_t len, const float *vec) {
+    if (VecItem *item = vecset_lookup(vs, id, len)) {
+        store_row(vs, item->row, vec);
+        mark_dirty(vs, item->row);
+        if (vs->ivf) {
+            uint32_t &list = vs->ivf->assign[item->row];
+            list_remove(vs->ivf->lists[list], item->row);
+            list = nearest_list(vs->ivf, vs->stride, vs->data + (size_t)item->row * vs->stride);
+            vs->ivf->lists[list].push_back(item->row);
+        }
+        return false;
+    }
+
+    if (vs->n == vs->cap) {
+        size_t ncap = vs->cap ? vs->cap * 2 : 16;
+        float *ndata = vec_alloc(ncap, vs->stride);
+        if (vs->n) memcpy(ndata, vs->data, vs->n * vs->stride * sizeof(float));
+        free(vs->data);
+        vs->data = ndata;
+        vs->cap  = ncap;
+    }
+    uint32_t row = (uint32_t)vs->n++;
+    store_row(vs, row, vec);
+    mark_dirty(vs, row);    // a row freed since the snapshot was taken
+
+    VecItem *item = (VecItem*)malloc(sizeof(VecItem) + len);
+    item->hmap.next  = nullptr;
+    item->hmap.hcode = str_hash((const uint8_t*)id, len);
+    item->row = row;
+    item->len = len;
+    memcpy(item->id, id, len);
+    hm_insert(&vs->hmap, &item->hmap);
+    vs->items.push_back(item);
+
+    if (vs->ivf) {
+        uint32_t list = nearest_list(vs->ivf, vs->stride, vs->data + (size_t)row * vs->stride);
+        vs->ivf->assign.push_back(list);
+        vs->ivf->lists[list].push_back(row);
+    }
+    return true;
+}
+
+bool vecset_remove(VecSet *vs, const char *id, size_t len) {
+    VKey key;
+    key.node.hcode = str_hash((const uint8_t*)id, len);
+    key.id  = id;
+    key.len = len;
+    HNode *found = hm_delete(&vs->hmap, &key.node, &vcmp);
+    if (!found) return false;
+    VecItem *item = container_of(found, VecItem, hmap);
+
+    // keep rows dense: the last row moves into the hole
+    uint32_t row  = item->row;
+    uint32_t last = (uint32_t)vs->n - 1;
+    if (vs->ivf) list_remove(vs->ivf->lists[vs->ivf->assign[row]], row);
+    if (row != last) {
+        memcpy(vs->data + (size_t)row * vs->stride,
+               vs->data + (size_t)last * vs->stride, vs->stride * sizeof(float));
+        vs->items[row] = vs->items[last];
+        vs->items[row]->row = row;
+        mark_dirty(vs, row);
+        if (vs->ivf) {
+            vs->ivf->assign[row] = vs->ivf->assign[last];
+            list_replace(vs->ivf->lists[vs->ivf->assign[row]], last, row);
+        }
+    }
+    vs->items.pop_back();
+    if (vs->ivf) vs->ivf->assign.pop_back();
+    vs->n--;
+    free(item);
+    return true;
+}
+
+void vecset_drop_index(VecSet *vs) {
+    ivf_free(vs->ivf);
+    vs->ivf = nullptr;
+}
+
+// bounded max-heap on distance keeps the k best seen so far
+struct TopK {
+    uint32_t k;
+    std::vector<VecHit> heap;
+
+    static bool worse(const VecHit &a, const VecHit &b) { return a.score < b.score; }
+
+    void offer(uint32_t row, float d) {
+        if (heap.size() < k) {
+            heap.push_back({row, d});
+            std::push_heap(heap.begin(), heap.end(), &worse);
+        } else if (d < heap.front().score) {
+            std::pop_heap(heap.begin(), heap.end(), &worse);
+            heap.back() = {row, d};
+            std::push_heap(heap.begin(), heap.end(), &worse);
+        }
+    }
+};
+
+void vecset_search(const VecSet *vs, const float *query, uint32_t k,
+                   VecMetric metric, uint32_t nprobe, std::vector<VecHit> &out) {
+    out.clear();
+    if (k == 0 || vs->n == 0) return;
+
+    float *q = vec_alloc(1, vs->stride);
+    memcpy(q, query, vs->dim * sizeof(float));
+    memset(q + vs->dim, 0, (vs->stride - vs->dim) * sizeof(float));
+
+    TopK top;
+    top.k = k;
+    top.heap.reserve(k);
+    if (!vs->ivf || nprobe >= vs->ivf->nlist) {
+        // brute force: one sequential pass over the array
+        const float *row = vs->data;
+        for (size_t i = 0; i < vs->n; ++i, row += vs->stride) {
+            top.offer((uint32_t)i, vec_dist(metric, q, row, vs->stride));
+        }
+    } else {
+        const VecIVF *ivf = vs->ivf;
+        std::vector<VecHit> lists(ivf->nlist);
+        for (uint32_t c = 0; c < ivf->nlist; ++c) {
+            lists[c] = {c, vec_dist(metric, q, ivf->centroids + (size_t)c * vs->stride, vs->stride)};
+        }
+        uint32_t np = nprobe ? nprobe : 1;
+        std::partial_sort(lists.begin(), lists.begin() + np, lists.end(),
+            [](const VecHit &a, const VecHit &b) { return a.score < b.score; });
+        for (uint32_t i = 0; i < np; ++i) {
+            for (uint32_t row : ivf->lists[lists[i].row]) {
+                top.offer(row, vec_dist(metric, q, vs->data + (size_t)row * vs->stride, vs->stride));
+            }
+        }
+    }
+    free(q);
+
+    std::sort_heap(top.heap.begin(), top.heap.end(), &TopK::worse);
+    out.swap(top.heap);
+    if (metric == VEC_IP) {
+        for (VecHit &h : out) h.score = -h.score;
+    }
+}
+
+// ---------------------------- build ----------------------------
+
+static uint64_t g_next_build_id = 1;
+
+VecBuild *vecset_build_begin(VecSet *vs, uint32_t nlist, uint32_t iters) {
+    if (vs->build_id) return nullptr;   // one build at a time
+    VecBuild *b = new VecBuild();
+    b->id     = g_next_build_id++;
+    b->dim    = vs->dim;
+    b->stride = vs->stride;
+    b->nlist  = nlist;
+    b->iters  = iters;
+    b->n      = vs->n;
+    b->data   = vec_alloc(vs->n, vs->stride);
+    if (vs->n) memcpy(b->data, vs->data, vs->n * vs->stride * sizeof(float));
+
+    vs->build_id = b->id;
+    vs->build_n  = vs->n;
+    vs->build_dirty.assign(vs->n, 0);
+    return b;
+}
+
+void vecbuild_run(VecBuild *b) {
+    const uint32_t stride = b->stride;
+    uint32_t nlist = (uint32_t)std::min<size_t>(b->nlist, b->n);
+    VecIVF *ivf = new VecIVF();
+    ivf->nlist = nlist;
+    ivf->centroids = vec_alloc(nlist, stride);
+    ivf->lists.resize(nlist);
+    b->ivf = ivf;
+    if (nlist == 0) return;
+
+    // train on a sample of at most 64 rows per list
+    std::mt19937_64 rng(b->id);
+    std::vector<uint32_t> sample(b->n);
+    for (size_t i = 0; i < b->n; ++i) sample[i] = (uint32_t)i;
+    std::shuffle(sample.begin(), sample.end(), rng);
+    sample.resize(std::min<size_t>(b->n, (size_t)nlist * 64));
+
+    for (uint32_t c = 0; c < nlist; ++c) {
+        memcpy(ivf->centroids + (size_t)c * stride,
+               b->data + (size_t)sample[c] * stride, stride * sizeof(float));
+    }
+
+    std::vector<double>   sums((size_t)nlist * stride);
+    std::vector<uint32_t> counts(nlist);
+    for (uint32_t it = 0; it < b->iters; ++it) {
+        std::fill(sums.begin(), sums.end(), 0.0);
+        std::fill(counts.begin(), counts.end(), 0);
+        for (uint32_t row : sample) {
+            const float *v = b->data + (size_t)row * stride;
+            uint32_t c = nearest_list(ivf, stride, v);
+            counts[c]++;
+            double *s = &sums[(size_t)c * stride];
+            for (uint32_t d = 0; d < stride; ++d) s[d] += v[d];
+        }
+        for (uint32_t c = 0; c < nlist; ++c) {
+            float *cent = ivf->centroids + (size_t)c * stride;
+            if (!counts[c]) {
+                // reseed an empty list from a random sample row
+                uint32_t row = sample[rng() % sample.size()];
+                memcpy(cent, b->data + (size_t)row * stride, stride * sizeof(float));
+                continue;
+            }
+            for (uint32_t d = 0; d < stride; ++d) {
+                cent[d] = (float)(sums[(size_t)c * stride + d] / counts[c]);
+            }
+        }
+    }
+
+    ivf->assign.resize(b->n);
+    for (size_t i = 0; i < b->n; ++i) {
+        ivf->assign[i] = nearest_list(ivf, stride, b->data + i * stride);
+    }
+}
+
+void vecset_build_finish(VecSet *vs, VecBuild *b) {
+    assert(vs->build_id == b->id);
+    ivf_free(vs->ivf);
+    VecIVF *ivf = vs->ivf = b->ivf;
+    b->ivf = nullptr;
+
+    // rows added or rewritten after the snapshot are assigned here
+    ivf->assign.resize(vs->n);
+    for (size_t i = 0; i < vs->n; ++i) {
+        if (i >= vs->build_n || vs->build_dirty[i] || ivf->nlist == 0) {
+            ivf->assign[i] = ivf->nlist
+                ? nearest_list(ivf, vs->stride, vs->data + i * vs->stride) : 0;
+        }
+    }
+    if (ivf->nlist == 0) {
+        // nothing to partition yet
+        ivf_free(ivf);
+        vs->ivf = nullptr;
+    } else {
+        for (size_t i = 0; i < vs->n; ++i) ivf->lists[ivf->assign[i]].push_back((uint32_t)i);
+    }
+    vs->build_id = 0;
+    vs->build_n  = 0;
+    vs->build_dirty.clear();
+}
+
+void vecbuild_free(VecBuild *b) {
+    free(b->data);
+    ivf_free(b->ivf);
+    delete b;
+}
@@ -0,0 +1,84 @@
+// vecset.h
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "hashtable.h"
+
+// One member: id -> row in the flat array
+struct VecItem {
+    HNode    hmap;
+    uint32_t row = 0;
+    size_t   len = 0;
+    char     id[0];     // flexible array
+};
+
+// Inverted-file index: rows partitioned by their nearest k-means centroid
+struct VecIVF {
+    uint32_t nlist = 0;
+    float   *centroids = nullptr;               // nlist * stride, aligned
+    std::vector<std::vector<uint32_t>> lists;   // rows per centroid
+    std::vector<uint32_t> assign;               // row -> list
+};
+
+// Vectors are stored row-major in one 64-byte aligned array. Rows are
+// zero-padded to `stride` (a multiple of 16 floats), so the kernels run
+// whole SIMD registers with no tail handling.
+struct VecSet {
+    uint32_t dim    = 0;
+    uint32_t stride = 0;
+    size_t   n      = 0;
+    size_t   cap    = 0;
+    float   *data   = nullptr;
+    std::vector<VecItem*> items;    // row -> member
+    HMap     hmap;                  // id -> member
+    VecIVF  *ivf = nullptr;
+    // background index build in flight, see vecset_build_begin()
+    uint64_t build_id = 0;
+    size_t   build_n  = 0;          // rows in the build's snapshot
+    std::vector<uint8_t> build_dirty;   // snapshot rows changed since
+};
+
+enum VecMetric : uint8_t {
+    VEC_L2 = 0,     // squared euclidean distance, smaller is closer
+    VEC_IP = 1,     // inner product, larger is closer
+};
+
+struct VecHit {
+    uint32_t row;
+    float    score;
+};
+
+void   vecset_init(VecSet *vs, uint32_t dim);
+void   vecset_clear(VecSet *vs);
+// Returns true if `id` is new, false if its vector was replaced.
+bool   vecset_add(VecSet *vs, const char *id, size_t len, const float *vec);
+bool   vecset_remove(VecSet *vs, const char *id, size_t len);
+// k nearest rows, best first. Scans everything unless an IVF index is
+// present, in which case only the `nprobe` closest lists are visited.
+void   vecset_search(const VecSet *vs, const float *query, uint32_t k,
+                     VecMetric metric, uint32_t nprobe, std::vector<VecHit> &out);
+void   vecset_drop_index(VecSet *vs);
+
+// Name of the kernel set picked at startup ("avx512", "avx2", "scalar")
+const char *vec_kernel_name();
+
+// IVF build in three steps so the k-means can run off the main thread:
+// begin() snapshots the vectors, run() trains and assigns on the copy
+// (no access to the VecSet), finish() installs the result and reassigns
+// rows written since the snapshot.
+struct VecBuild {
+    uint64_t id     = 0;
+    uint32_t dim    = 0;
+    uint32_t stride = 0;
+    uint32_t nlist  = 0;
+    uint32_t iters  = 0;
+    size_t   n      = 0;
+    float   *data   = nullptr;      // private copy of the rows
+    VecIVF  *ivf    = nullptr;      // result
+};
+
+VecBuild *vecset_build_begin(VecSet *vs, uint32_t nlist, uint32_t iters);
+void      vecbuild_run(VecBuild *b);
+void      vecset_build_finish(VecSet *vs, VecBuild *b);
+void      vecbuild_free(VecBuild *b);